@@ -0,0 +1,86 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: UDP message type dispatch benchmark: the perfect hash of Tempest::GetUdpEvent() against a chain of
+//              string comparisons
+//
+// Usage:       dispatch [<rounds>]             default: 50 rounds over 65536 types, best of 3
+//
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "codec.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+using namespace std;
+using namespace tempest;
+
+using UdpEvent = Tempest::UdpEvent;
+
+static UdpEvent __attribute__((noinline)) Chain(string_view type) {
+  //
+  // The type lookup the handler table replaced
+  //
+  if (type == "hub_status") return (UdpEvent::HUB_STATUS);
+  if (type == "evt_precip") return (UdpEvent::EVT_PRECIP);
+  if (type == "evt_strike") return (UdpEvent::EVT_STRIKE);
+  if (type == "rapid_wind") return (UdpEvent::RAPID_WIND);
+  if (type == "obs_air") return (UdpEvent::OBS_AIR);
+  if (type == "obs_sky") return (UdpEvent::OBS_SKY);
+  if (type == "obs_st") return (UdpEvent::OBS_ST);
+  if (type == "device_status") return (UdpEvent::DEVICE_STATUS);
+  if (type.find("debug") != string_view::npos) return (UdpEvent::DEBUG);
+
+  return (UdpEvent::UNKNOWN);
+}
+
+static UdpEvent __attribute__((noinline)) Hash(string_view type) {
+  return (Tempest::GetUdpEvent(type));
+}
+
+static void Run(const char* name, UdpEvent (*lookup)(string_view), const vector<string>& type, int rounds) {
+  double best = numeric_limits<double>::max();
+  size_t sum = 0;
+
+  for (int repeat = 0; repeat < 3; repeat++) {
+    auto start = chrono::steady_clock::now();
+
+    for (int round = 0; round < rounds; round++) {
+      for (const string& t: type) sum += lookup(t);
+    }
+
+    best = min(best, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ((double)rounds * type.size()));
+  }
+
+  printf("%s: %.1f ns per type (checksum %zu)\n", name, best, sum);
+}
+
+int main(int argc, char* argv[]) {
+  int rounds = (argc > 1)? atoi(argv[1]): 50;
+
+  // A hub's mix: rapid_wind every 3 seconds, the rest once a minute or less, plus some debug
+  static const char* const mix[] = {"obs_st", "rapid_wind", "rapid_wind", "rapid_wind", "device_status", "hub_status", "light_debug", "evt_strike"};
+  vector<string> type;
+
+  for (size_t idx = 0; idx < 65536; idx++) type.push_back(mix[(idx * 7919) % size(mix)]);
+
+  for (const string& t: type) {
+    if (Chain(t) != Hash(t)) {
+      printf("Mismatch on %s.\n", t.c_str());
+      return (EXIT_FAILURE);
+    }
+  }
+
+  Run("comparison chain", Chain, type, rounds);
+  Run("perfect hash", Hash, type, rounds);
+
+  return (EXIT_SUCCESS);
+}
+
+// EOF -------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,144 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: HTTP client benchmark: POSTs to a keep-alive sink, sequential and pipelined
+//
+// Usage:       http [<requests> [<url>]]       default: 10000 requests to a sink of its own on loopback
+//              (make bench HTTP=curl to measure the curl backend)
+//
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "http.hpp"
+#include "curl.hpp"
+
+#include <sys/resource.h>
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+using namespace std;
+using namespace tempest;
+
+#ifdef TEMPEST_CURL
+using Client = CurlClient;
+static const char* backend = "curl";
+#else
+using Client = HttpClient;
+static const char* backend = "built-in";
+#endif
+
+static void Serve(int fd) {
+  //
+  // Answer every request of a connection with an empty 200, in a single write
+  //
+  static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nOK";
+  string in;
+  char buffer[65536];
+  int one = 1;
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  for (ssize_t len; (len = recv(fd, buffer, sizeof(buffer), 0)) > 0; ) {
+    in.append(buffer, len);
+
+    for (size_t head; (head = in.find("\r\n\r\n")) != string::npos; ) {
+      size_t length = 0, pos = in.find("Content-Length: ");
+      if (pos != string::npos && pos < head) length = strtoul(in.c_str() + pos + 16, nullptr, 10);
+      if (in.size() < head + 4 + length) break;
+
+      in.erase(0, head + 4 + length);
+      send(fd, response, sizeof(response) - 1, MSG_NOSIGNAL);
+    }
+  }
+
+  close(fd);
+}
+
+static int Sink(void) {
+  //
+  // Start a keep-alive sink on a loopback ephemeral port and return the port (0 if error)
+  //
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (sock < 0 || bind(sock, (sockaddr*)&addr, sizeof(addr)) || listen(sock, 64) || getsockname(sock, (sockaddr*)&addr, &len)) return (0);
+
+  thread([sock]{
+    for (int fd; (fd = accept(sock, nullptr, nullptr)) >= 0; ) thread(Serve, fd).detach();
+  }).detach();
+
+  return (ntohs(addr.sin_port));
+}
+
+static void Run(const string& url, int requests, int burst) {
+  //
+  // Post requests of 600 bytes (an Ecowitt body), burst at a time, and print throughput and latency
+  //
+  HttpOptions options;
+  Client client{url, "application/x-www-form-urlencoded", options};
+  vector<Client*> clients{&client};
+  string body(600, 'x');
+  vector<double> latency;
+  int failed = 0;
+  string error;
+
+  auto start = chrono::steady_clock::now();
+
+  for (int idx = 0; idx < requests; idx += burst) {
+    for (int req = idx; req < idx + burst && req < requests; req++) client.Post(body, req);
+
+    while (client.Pending()) {
+      Client::Run(clients, 1000, [&](size_t, const HttpResult& result) {
+        if (result.status == 200) latency.push_back(result.latency);
+        else {
+          failed++;
+          error = result.error;
+        }
+      });
+    }
+  }
+
+  double total = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  sort(latency.begin(), latency.end());
+
+  double p50 = latency.empty()? 0: latency[latency.size() / 2] * 1e6;
+  double p99 = latency.empty()? 0: latency[latency.size() * 99 / 100] * 1e6;
+
+  printf("%s x%d: %d requests in %.3fs (p50 %.0fus, p99 %.0fus), %d failed%s%s\n", backend, burst, requests, total, p50, p99, failed,
+         error.empty()? "": ": ", error.c_str());
+}
+
+int main(int argc, char* argv[]) {
+  int requests = (argc > 1)? atoi(argv[1]): 10000;
+  string url = (argc > 2)? argv[2]: "";
+
+  if (url.empty()) {
+    int port = Sink();
+    if (!port) {
+      printf("Error starting the sink: %s.\n", strerror(errno));
+      return (EXIT_FAILURE);
+    }
+    url = "http://127.0.0.1:" + to_string(port) + "/";
+  }
+
+  Run(url, requests, 1);
+  Run(url, requests, 8);
+
+  // Sink included, when it's ours
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("max RSS: %.1fMB\n", usage.ru_maxrss / 1024.0);
+
+  return (EXIT_SUCCESS);
+}
+
+// EOF -------------------------------------------------------------------------------------------------------------------------
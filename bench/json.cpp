@@ -0,0 +1,84 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: JSON parser benchmark: UDP datagrams parsed and looked up as the relay does, copying or borrowing strings
+//
+// Usage:       json [<iterations>]             default: 100000 datagrams, best of 7 rounds
+//
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+using namespace std;
+using namespace tempest;
+
+// Every allocation of the process goes through here: the parser's are the only ones in the timed loop
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  if (void* ptr = malloc(size)) return (ptr);
+  throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+static const char* const datagram[] = {
+  R"({"serial_number":"ST-00000512","type":"obs_st","hub_sn":"HB-00013030","obs":[[1588948614,0.18,0.22,0.27,144,6,1017.57,22.37,50.26,328,0.03,3,0.000000,0,0,0,2.410,1]],"firmware_revision":129})",
+  R"({"serial_number":"ST-00000512","type":"rapid_wind","hub_sn":"HB-00013030","ob":[1588948614,2.3,128]})",
+  R"({"serial_number":"ST-00000512","type":"device_status","hub_sn":"HB-00013030","timestamp":1588948614,"uptime":2189,"voltage":2.50,"firmware_revision":17,"rssi":-17,"hub_rssi":-87,"sensor_status":0,"debug":0})",
+  R"({"serial_number":"HB-00013030","type":"hub_status","firmware_revision":"35","uptime":1670133,"rssi":-62,"timestamp":1588948614,"reset_flags":"BOR,PIN,POR","seq":48,"fs":[1,0,15675411,524288],"radio_stats":[2,1,0,3],"mqtt_stats":[1,0]})"
+};
+
+static void Run(const char* name, const vector<string>& input, int iterations, JsonStrings strings) {
+  //
+  // Parse each input in turn and look up type, hub, serial number and a value, as WriteUdp() does
+  //
+  double best = numeric_limits<double>::max();
+  size_t allocated = 0;
+  volatile double sink = 0;                                     // keeps the lookups from being optimized away
+  string error;
+
+  for (int round = 0; round < 7; round++) {
+    size_t mark = allocations;
+    auto start = chrono::steady_clock::now();
+
+    for (int idx = 0; idx < iterations; idx++) {
+      Json event = Json::parse(input[idx % input.size()], error, JsonParse::STANDARD, strings);
+
+      sink += event["type"].string_view_value().size() + event["hub_sn"].string_view_value().size() + event["serial_number"].string_view_value().size();
+      sink += event["obs"][0][1].number_value() + event["timestamp"].number_value() + event["ob"][1].number_value();
+    }
+
+    best = min(best, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations);
+    allocated = allocations - mark;
+  }
+
+  printf("%s: %.0f ns, %.1f allocations per parse\n", name, best, (double)allocated / iterations);
+}
+
+int main(int argc, char* argv[]) {
+  int iterations = (argc > 1)? atoi(argv[1]): 100000;
+
+  vector<string> udp(begin(datagram), end(datagram));
+
+  // An object well past the flat object limit, with a duplicate key, for the map path
+  string wide = "{";
+  for (int idx = 0; idx < 256; idx++) wide += (idx? ",\"key": "\"key") + to_string(idx) + "\":" + to_string(idx);
+  wide += ",\"key0\":0}";
+
+  Run("udp, copy", udp, iterations, JsonStrings::COPY);
+  Run("udp, borrow", udp, iterations, JsonStrings::BORROW);
+  Run("256 members, borrow", {wide}, max(iterations / 100, 1), JsonStrings::BORROW);
+
+  return (EXIT_SUCCESS);
+}
+
+// EOF -------------------------------------------------------------------------------------------------------------------------
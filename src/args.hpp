@@ -16,6 +16,7 @@
 
 #include "log.hpp"
 #include "relay.hpp"
+#include "config.hpp"
 
 // Source ----------------------------------------------------------------------------------------------------------------------
 
@@ -25,26 +26,51 @@ using namespace std;
 
 // Argument presence
 
-#define TEMPEST_ARG_URL         0b0000000000000001
-#define TEMPEST_ARG_INTERVAL    0b0000000000000010
-#define TEMPEST_ARG_LOG         0b0000000000000100
-#define TEMPEST_ARG_DAEMON      0b0000000000001000
-#define TEMPEST_ARG_TRACE       0b0000000000010000
-#define TEMPEST_ARG_STOP        0b0000000000100000
-#define TEMPEST_ARG_STATS       0b0000000001000000
-#define TEMPEST_ARG_VERSION     0b0000000010000000
-#define TEMPEST_ARG_HELP        0b0000000100000000
-
-#define TEMPEST_ARG_EMPTY       0b0100000000000000
-#define TEMPEST_ARG_INVALID     0b1000000000000000
+#define TEMPEST_ARG_URL         0b00000000000000000000000000000001
+#define TEMPEST_ARG_INTERVAL    0b00000000000000000000000000000010
+#define TEMPEST_ARG_LOG         0b00000000000000000000000000000100
+#define TEMPEST_ARG_DAEMON      0b00000000000000000000000000001000
+#define TEMPEST_ARG_TRACE       0b00000000000000000000000000010000
+#define TEMPEST_ARG_STOP        0b00000000000000000000000000100000
+#define TEMPEST_ARG_STATS       0b00000000000000000000000001000000
+#define TEMPEST_ARG_VERSION     0b00000000000000000000000010000000
+#define TEMPEST_ARG_HELP        0b00000000000000000000000100000000
+#define TEMPEST_ARG_GAPS        0b00000000000000000000001000000000
+#define TEMPEST_ARG_RCVBUF      0b00000000000000000000010000000000
+#define TEMPEST_ARG_RING        0b00000000000000000000100000000000
+#define TEMPEST_ARG_WORKERS     0b00000000000000000001000000000000
+#define TEMPEST_ARG_CPURX       0b00000000000000000010000000000000
+#define TEMPEST_ARG_CPUTX       0b00000000000000000100000000000000
+#define TEMPEST_ARG_CPUWORKERS  0b00000000000000001000000000000000
+#define TEMPEST_ARG_FIFO        0b00000000000000010000000000000000
+#define TEMPEST_ARG_MLOCK       0b00000000000000100000000000000000
+#define TEMPEST_ARG_RATE        0b00000000000001000000000000000000
+#define TEMPEST_ARG_COMPRESS    0b00000000000010000000000000000000
+#define TEMPEST_ARG_ELEVATION   0b00000000000100000000000000000000
+#define TEMPEST_ARG_ALERTS      0b00000000001000000000000000000000
+#define TEMPEST_ARG_STRIKE      0b00000000010000000000000000000000
+#define TEMPEST_ARG_STREAM      0b00000000100000000000000000000000
+#define TEMPEST_ARG_QUANTILES   0b00000001000000000000000000000000
+#define TEMPEST_ARG_DESKEW      0b00000010000000000000000000000000
+#define TEMPEST_ARG_CHANNELS    0b00000100000000000000000000000000
+#define TEMPEST_ARG_CONFIG      0b00001000000000000000000000000000
+
+#define TEMPEST_ARG_EMPTY       0b01000000000000000000000000000000
+#define TEMPEST_ARG_INVALID     0b10000000000000000000000000000000
+
+// Thread scheduling options, valid with both relay and trace
+
+#define TEMPEST_ARG_SCHED       (TEMPEST_ARG_CPURX | TEMPEST_ARG_CPUTX | TEMPEST_ARG_CPUWORKERS | TEMPEST_ARG_FIFO | TEMPEST_ARG_MLOCK)
 
 // Mask to validate the presence of all required argument(s) that make a specific command valid
 // Expand to TRUE if all required arguments are present
 
-#define TEMPEST_REQ_RELAY(c)    ((c & TEMPEST_ARG_URL) == TEMPEST_ARG_URL)
+#define TEMPEST_REQ_RELAY(c)    ((c & TEMPEST_ARG_URL) == TEMPEST_ARG_URL || (c & (TEMPEST_ARG_CONFIG | TEMPEST_ARG_TRACE)) == TEMPEST_ARG_CONFIG)
 #define TEMPEST_REQ_TRACE(c)    ((c & TEMPEST_ARG_TRACE) == TEMPEST_ARG_TRACE)
 #define TEMPEST_REQ_STOP(c)     ((c & TEMPEST_ARG_STOP) == TEMPEST_ARG_STOP)
 #define TEMPEST_REQ_STATS(c)    ((c & TEMPEST_ARG_STATS) == TEMPEST_ARG_STATS)
+#define TEMPEST_REQ_GAPS(c)     ((c & TEMPEST_ARG_GAPS) == TEMPEST_ARG_GAPS)
+#define TEMPEST_REQ_QUANTILES(c) ((c & TEMPEST_ARG_QUANTILES) == TEMPEST_ARG_QUANTILES)
 #define TEMPEST_REQ_VERSION(c)  ((c & TEMPEST_ARG_VERSION) == TEMPEST_ARG_VERSION)
 #define TEMPEST_REQ_HELP(c)     ((c & TEMPEST_ARG_HELP) == TEMPEST_ARG_HELP)
 
@@ -53,10 +79,12 @@ using namespace std;
 // Mask to validate the presence of only required and optional argument(s) that make a specific command valid
 // Expand to TRUE if not only required and optional arguments are present
 
-#define TEMPEST_INV_RELAY(c)    (c & ~(TEMPEST_ARG_URL | TEMPEST_ARG_INTERVAL | TEMPEST_ARG_LOG | TEMPEST_ARG_DAEMON))
-#define TEMPEST_INV_TRACE(c)    (c & ~(TEMPEST_ARG_TRACE | TEMPEST_ARG_INTERVAL | TEMPEST_ARG_LOG))
+#define TEMPEST_INV_RELAY(c)    (c & ~(TEMPEST_ARG_URL | TEMPEST_ARG_INTERVAL | TEMPEST_ARG_LOG | TEMPEST_ARG_DAEMON | TEMPEST_ARG_RCVBUF | TEMPEST_ARG_RING | TEMPEST_ARG_WORKERS | TEMPEST_ARG_RATE | TEMPEST_ARG_COMPRESS | TEMPEST_ARG_ELEVATION | TEMPEST_ARG_ALERTS | TEMPEST_ARG_STRIKE | TEMPEST_ARG_STREAM | TEMPEST_ARG_DESKEW | TEMPEST_ARG_CHANNELS | TEMPEST_ARG_CONFIG | TEMPEST_ARG_SCHED))
+#define TEMPEST_INV_TRACE(c)    (c & ~(TEMPEST_ARG_TRACE | TEMPEST_ARG_INTERVAL | TEMPEST_ARG_LOG | TEMPEST_ARG_RCVBUF | TEMPEST_ARG_RING | TEMPEST_ARG_WORKERS | TEMPEST_ARG_ELEVATION | TEMPEST_ARG_ALERTS | TEMPEST_ARG_STRIKE | TEMPEST_ARG_STREAM | TEMPEST_ARG_DESKEW | TEMPEST_ARG_CHANNELS | TEMPEST_ARG_CONFIG | TEMPEST_ARG_SCHED))
 #define TEMPEST_INV_STOP(c)     (c & ~(TEMPEST_ARG_STOP))
 #define TEMPEST_INV_STATS(c)    (c & ~(TEMPEST_ARG_STATS))
+#define TEMPEST_INV_GAPS(c)     (c & ~(TEMPEST_ARG_GAPS))
+#define TEMPEST_INV_QUANTILES(c) (c & ~(TEMPEST_ARG_QUANTILES))
 #define TEMPEST_INV_VERSION(c)  (c & ~(TEMPEST_ARG_VERSION))
 #define TEMPEST_INV_HELP(c)     (c & ~(TEMPEST_ARG_HELP | TEMPEST_ARG_EMPTY))
 
@@ -109,6 +137,16 @@ public:
       opterr = 0;
       option_short = ShortOptions();
 
+      // The configuration file goes first so that any option on the command line overrides it
+      while ((value = getopt_long(argc, argv, option_short.c_str(), option_, nullptr)) != -1) {
+        if (value == 'C') config_file_ = Trim(optarg);
+      }
+
+      if (!config_file_.empty()) Config::Load(config_file_, options_, config_error_);
+
+      // Rescan
+      optind = 0;
+
       while ((value = getopt_long(argc, argv, option_short.c_str(), option_, nullptr)) != -1) {
         arg = Trim(optarg);
 
@@ -136,6 +174,146 @@ public:
             cmdl_ |= TEMPEST_ARG_LOG;
             break;
 
+          case 'r':
+            num = stoi(arg);
+            if (num < 1 || num > 65536) throw out_of_range(arg);
+            options_.receive_buffer = num * 1024;
+
+            cmdl_ |= TEMPEST_ARG_RCVBUF;
+            break;
+
+          case 'q':
+            num = stoi(arg);
+            if (num < 16 || num > 65536) throw out_of_range(arg);
+            options_.ring_depth = num;
+
+            cmdl_ |= TEMPEST_ARG_RING;
+            break;
+
+          case 'w':
+            num = stoi(arg);
+            if (num < 1 || num > 256) throw out_of_range(arg);
+            options_.workers = num;
+
+            cmdl_ |= TEMPEST_ARG_WORKERS;
+            break;
+
+          case 'a':
+            num = stoi(arg);
+            if (num < 1 || num > 6000) throw out_of_range(arg);
+            options_.rate_limit = num;
+
+            cmdl_ |= TEMPEST_ARG_RATE;
+            break;
+
+          case 'z':
+            options_.compress = Compressor::Parse(arg);
+            if (options_.compress == Compressor::Encoding::IDENTITY || !Compressor::Supported(options_.compress)) throw invalid_argument(arg);
+
+            cmdl_ |= TEMPEST_ARG_COMPRESS;
+            break;
+
+          case 'e':
+            num = stoi(arg);
+            if (num < -500 || num > 9000) throw out_of_range(arg);
+            options_.elevation = num;
+
+            cmdl_ |= TEMPEST_ARG_ELEVATION;
+            break;
+
+          case 'A':
+            if (arg.empty()) throw invalid_argument(arg);
+            options_.alerts_file = arg;
+
+            cmdl_ |= TEMPEST_ARG_ALERTS;
+            break;
+
+          case 'k': {
+            stringstream list{arg};
+            string sink;
+
+            // The command line replaces the sinks of the configuration file; repeating the option adds to them
+            if (!(cmdl_ & TEMPEST_ARG_STRIKE)) options_.strike_sinks.clear();
+
+            while (getline(list, sink, ',')) {
+              if (!Lane::Supported(sink)) throw invalid_argument(arg);
+              options_.strike_sinks.push_back(sink);
+            }
+            if (options_.strike_sinks.empty()) throw invalid_argument(arg);
+
+            cmdl_ |= TEMPEST_ARG_STRIKE;
+            break;
+          }
+
+          case 'S': {
+            // [<address>:]<port>
+            size_t colon = arg.rfind(':');
+            struct in_addr address;
+
+            if (colon != string::npos) {
+              options_.stream_address = arg.substr(0, colon);
+              if (inet_pton(AF_INET, options_.stream_address.c_str(), &address) != 1) throw invalid_argument(arg);
+            }
+
+            num = stoi(arg.substr(colon + 1));
+            if (num < 1 || num > 65535) throw out_of_range(arg);
+            options_.stream_port = num;
+
+            cmdl_ |= TEMPEST_ARG_STREAM;
+            break;
+          }
+
+          case 'D':
+            options_.deskew = true;
+
+            cmdl_ |= TEMPEST_ARG_DESKEW;
+            break;
+
+          case 'c':
+            if (arg.empty()) throw invalid_argument(arg);
+            options_.channels_file = arg;
+
+            cmdl_ |= TEMPEST_ARG_CHANNELS;
+            break;
+
+          case 'C':
+            if (arg.empty()) throw invalid_argument(arg);
+
+            cmdl_ |= TEMPEST_ARG_CONFIG;
+            break;
+
+          case 'R':
+            options_.cpu_receiver = Sched::ParseCpuList(arg);
+
+            cmdl_ |= TEMPEST_ARG_CPURX;
+            break;
+
+          case 'T':
+            options_.cpu_transmitter = Sched::ParseCpuList(arg);
+
+            cmdl_ |= TEMPEST_ARG_CPUTX;
+            break;
+
+          case 'W':
+            options_.cpu_workers = Sched::ParseCpuList(arg);
+
+            cmdl_ |= TEMPEST_ARG_CPUWORKERS;
+            break;
+
+          case 'f':
+            num = stoi(arg);
+            if (num < 1 || num > 99) throw out_of_range(arg);
+            options_.fifo_priority = num;
+
+            cmdl_ |= TEMPEST_ARG_FIFO;
+            break;
+
+          case 'm':
+            options_.lock_memory = true;
+
+            cmdl_ |= TEMPEST_ARG_MLOCK;
+            break;
+
           case 'd':
             cmdl_ |= TEMPEST_ARG_DAEMON;
             break;
@@ -152,6 +330,14 @@ public:
             cmdl_ |= TEMPEST_ARG_STATS;
             break;
 
+          case 'g':
+            cmdl_ |= TEMPEST_ARG_GAPS;
+            break;
+
+          case 'Q':
+            cmdl_ |= TEMPEST_ARG_QUANTILES;
+            break;
+
           case 'v':
             cmdl_ |= TEMPEST_ARG_VERSION;
             break;
@@ -171,11 +357,16 @@ public:
       if (TEMPEST_REQ_RELAY(cmdl_)) {
         // Relay command
         if (TEMPEST_INV_RELAY(cmdl_)) throw invalid_argument("relay");
+
+        if (url_.empty() && options_.destinations.empty() && config_error_.empty()) config_error_ = "no destinations";
       }
       else if (TEMPEST_REQ_TRACE(cmdl_)) {
         // Trace command
         if (TEMPEST_INV_TRACE(cmdl_)) throw invalid_argument("trace");
 
+        // Nothing leaves the relay
+        options_.destinations.clear();
+
         if (TEMPEST_UDP_TRACE(cmdl_)) {
           interval_ = 0;
         }
@@ -188,6 +379,14 @@ public:
         // Stop command
         if (TEMPEST_INV_STATS(cmdl_)) throw invalid_argument("stats");
       }
+      else if (TEMPEST_REQ_GAPS(cmdl_)) {
+        // Gaps command
+        if (TEMPEST_INV_GAPS(cmdl_)) throw invalid_argument("gaps");
+      }
+      else if (TEMPEST_REQ_QUANTILES(cmdl_)) {
+        // Quantiles command
+        if (TEMPEST_INV_QUANTILES(cmdl_)) throw invalid_argument("quantiles");
+      }
       else if (TEMPEST_REQ_VERSION(cmdl_)) {
         // Version command
         if (TEMPEST_INV_VERSION(cmdl_)) throw invalid_argument("version");
@@ -229,6 +428,22 @@ public:
     return (LogNum2Enum(log_));
   }
 
+  inline const string& GetConfigFile(void) const { return (config_file_); }
+
+  inline const string& GetConfigError(void) const {
+    //
+    // Return why the configuration file could not be loaded (empty: loaded or none)
+    //
+    return (config_error_);
+  }
+
+  inline const Relay::Options& GetRelayOptions(void) const {
+    //
+    // Return the relay tuning options: if not specified we return defaults
+    //
+    return (options_);
+  }
+
   bool IsCommandDaemon(void) const {
     //
     // Return whether we are going to run as a daemon
@@ -249,9 +464,23 @@ public:
 
     ostringstream text{""};
 
-    text << "tempest --url=" << url_;
+    text << "tempest";
+    if (!url_.empty()) text << " --url=" << url_;
     text << " --interval=" << interval_;
+    if (!config_file_.empty()) text << " --config=" << config_file_;
     text << " --log=" << log_;
+    if (options_.receive_buffer) text << " --rcvbuf=" << (options_.receive_buffer / 1024);
+    text << " --ring=" << options_.ring_depth;
+    if (options_.workers) text << " --workers=" << options_.workers;
+    if (options_.rate_limit) text << " --rate=" << options_.rate_limit;
+    if (options_.compress != Compressor::Encoding::IDENTITY) text << " --compress=" << Compressor::Name(options_.compress);
+    if (options_.elevation) text << " --elevation=" << options_.elevation;
+    if (!options_.alerts_file.empty()) text << " --alerts=" << options_.alerts_file;
+    for (size_t idx = 0; idx < options_.strike_sinks.size(); idx++) text << (idx? ",": " --strike=") << options_.strike_sinks[idx];
+    if (options_.stream_port) text << " --stream=" << options_.stream_address << ":" << options_.stream_port;
+    if (options_.deskew) text << " --deskew";
+    if (!options_.channels_file.empty()) text << " --channels=" << options_.channels_file;
+    text << SchedOptions();
     if (IsCommandDaemon()) text << " --daemon";
     str = text.str();
 
@@ -270,7 +499,18 @@ public:
 
     text << "tempest --trace";
     text << " --interval=" << interval_;
+    if (!config_file_.empty()) text << " --config=" << config_file_;
     text << " --log=" << log_;
+    if (options_.receive_buffer) text << " --rcvbuf=" << (options_.receive_buffer / 1024);
+    text << " --ring=" << options_.ring_depth;
+    if (options_.workers) text << " --workers=" << options_.workers;
+    if (options_.elevation) text << " --elevation=" << options_.elevation;
+    if (!options_.alerts_file.empty()) text << " --alerts=" << options_.alerts_file;
+    for (size_t idx = 0; idx < options_.strike_sinks.size(); idx++) text << (idx? ",": " --strike=") << options_.strike_sinks[idx];
+    if (options_.stream_port) text << " --stream=" << options_.stream_address << ":" << options_.stream_port;
+    if (options_.deskew) text << " --deskew";
+    if (!options_.channels_file.empty()) text << " --channels=" << options_.channels_file;
+    text << SchedOptions();
     str = text.str();
 
     return (true);
@@ -298,6 +538,28 @@ public:
     return (true);
   }
 
+  bool IsCommandGaps(string& str) const {
+    //
+    // Return whether the gaps command was invoked
+    //
+    if (TEMPEST_INV_GAPS(cmdl_)) return (false);
+
+    str = "tempest --gaps";
+
+    return (true);
+  }
+
+  bool IsCommandQuantiles(string& str) const {
+    //
+    // Return whether the quantiles command was invoked
+    //
+    if (TEMPEST_INV_QUANTILES(cmdl_)) return (false);
+
+    str = "tempest --quantiles";
+
+    return (true);
+  }
+
   bool IsCommandVersion(string& str) const {
     //
     // Return whether the version command was invoked
@@ -322,6 +584,27 @@ public:
 
  private:
 
+  string SchedOptions(void) const {
+    //
+    // Print the thread scheduling options that were specified
+    //
+    ostringstream text{""};
+
+    auto cpus = [](const vector<int>& cpu) {
+      string list;
+      for (int idx: cpu) list += (list.empty()? "": ",") + to_string(idx);
+      return (list);
+    };
+
+    if (!options_.cpu_receiver.empty()) text << " --cpu-rx=" << cpus(options_.cpu_receiver);
+    if (!options_.cpu_transmitter.empty()) text << " --cpu-tx=" << cpus(options_.cpu_transmitter);
+    if (!options_.cpu_workers.empty()) text << " --cpu-workers=" << cpus(options_.cpu_workers);
+    if (options_.fifo_priority) text << " --fifo=" << options_.fifo_priority;
+    if (options_.lock_memory) text << " --mlock";
+
+    return (text.str());
+  }
+
   static Log::Level LogNum2Enum(int num) {
     const Log::Level log_native[5]{Log::Level::emergency, Log::Level::error, Log::Level::warning, Log::Level::info, Log::Level::debug};
 
@@ -355,8 +638,12 @@ public:
   string url_;
   int interval_;
   int log_;
+  string config_file_;
+  string config_error_;
 
-  int cmdl_;
+  Relay::Options options_;
+
+  uint cmdl_;
 
   static const char* const usage_[];                            // see initialization below
   static const struct option option_[];                         // see initialization below
@@ -367,31 +654,79 @@ const char* const Arguments::usage_[] = {
   "",
   "Commands:",
   "",
-  "Relay:        tempest --url=<url> [--interval=<min>] [--log=<lev>] [--daemon]",
-  "Trace:        tempest --trace [--interval=<min>] [--log=<lev>]",
+  "Relay:        tempest --url=<url> | --config=<file> [--interval=<min>] [--log=<lev>] [--rcvbuf=<kb>] [--ring=<n>] [--workers=<n>] [--rate=<n>] [--compress=<enc>] [--elevation=<m>] [--alerts=<file>] [--strike=<urls>] [--stream=[<addr>:]<port>] [--deskew] [--channels=<file>] [SCHED] [--daemon]",
+  "Trace:        tempest --trace [--interval=<min>] [--config=<file>] [--log=<lev>] [--rcvbuf=<kb>] [--ring=<n>] [--workers=<n>] [--elevation=<m>] [--alerts=<file>] [--strike=<urls>] [--stream=[<addr>:]<port>] [--deskew] [--channels=<file>] [SCHED]",
   "Stop:         tempest --stop",
   "Stats:        tempest --stats",
+  "Gaps:         tempest --gaps",
+  "Quantiles:    tempest --quantiles",
   "Version:      tempest --version",
   "Help:         tempest [--help]",
   "",
   "Options:",
   "",
   "-u | --url=<url>      full URL to relay data to",
+  "-C | --config=<file>  configuration file (JSON): listener, stations, destinations",
+  "                      with their own interval and format (ecowitt or json),",
+  "                      channels, alerts and sinks; options override it and",
+  "                      --url is relayed to besides its destinations",
   "-i | --interval=<min> interval in minutes at which data is relayed:",
   "                      1 <= min <= 30 (default if omitted: 5)",
   "-l | --log=<lev>      1) only errors",
   "                      2) errors and warnings",
   "                      3) errors, warnings and info (default if omitted)",
   "                      4) errors, warnings, info and debug (everything)",
+  "-r | --rcvbuf=<kb>    UDP socket receive buffer size in KB:",
+  "                      1 <= kb <= 65536 (default if omitted: system)",
+  "-q | --ring=<n>       datagrams queued between the receive and parse stages:",
+  "                      16 <= n <= 65536 (default if omitted: 256)",
+  "-w | --workers=<n>    threads parsing and encoding data:",
+  "                      1 <= n <= 256 (default if omitted: number of cores)",
+  "-a | --rate=<n>       maximum requests per minute to the destination:",
+  "                      1 <= n <= 6000 (default if omitted: unlimited)",
+  "-z | --compress=<enc> compress request bodies: gzip or zstd (if built in)",
+  "                      falls back to identity for a destination replying 415",
+  "-e | --elevation=<m>  station elevation in meters, for sea-level pressure:",
+  "                      -500 <= m <= 9000 (default if omitted: 0)",
+  "-A | --alerts=<file>  alert rules (JSON) evaluated on every observation,",
+  "                      firings are sent right away to the rule sinks",
+  "-k | --strike=<urls>  send lightning strikes as soon as they are received to",
+  "                      a comma separated list of udp://host:port, unix:/path",
+  "                      or http:// (https:// with curl) sinks",
+  "-S | --stream=[<addr>:]<port>",
+  "                      stream live events to Server-Sent Events and WebSocket",
+  "                      clients: http://<host>:<port>/events[?types=obs_st,...]",
+  "                      and fleet metrics: http://<host>:<port>/metrics; listens",
+  "                      on 127.0.0.1 unless given another address (0.0.0.0: all)",
+  "-D | --deskew         correct the relayed date by the measured hub clock offset",
+  "-c | --channels=<file>",
+  "                      sensor channel map, one \"<serial> <channel>\" per line,",
+  "                      new sensors are added: channels survive restarts",
   "-d | --daemon         run as a background daemon",
   "-t | --trace          relay data to the terminal standard output",
   "                      (if --interval is omitted the source UDP JSON",
   "                      will be traced instead)",
   "-s | --stop           stop relaying/tracing and exit gracefully",
   "-x | --stats          print relay statistics",
+  "-g | --gaps           print missing observation intervals, one per line:",
+  "                      <hub> <sensor> <first> <last> <cadence seconds>",
+  "-Q | --quantiles      print wind gust, temperature and rain rate p50/p95/p99/max",
+  "                      per sensor and fleet wide, by hour, day, week, month, year",
   "-v | --version        print version information",
   "-h | --help           print this help",
   "",
+  "Scheduling Options (SCHED):",
+  "",
+  "-R | --cpu-rx=<cpus>  pin the receiver thread to a CPU list (i.e. 0,2-3)",
+  "-T | --cpu-tx=<cpus>  pin the transmitter thread to a CPU list",
+  "-W | --cpu-workers=<cpus>",
+  "                      spread the parser and worker threads over a CPU list",
+  "                      (one CPU each, round-robin)",
+  "-f | --fifo=<prio>    run the receiver thread with SCHED_FIFO real-time policy:",
+  "                      1 <= prio <= 99 (requires CAP_SYS_NICE)",
+  "-m | --mlock          lock the relay memory in RAM (requires CAP_IPC_LOCK",
+  "                      or a sufficient RLIMIT_MEMLOCK)",
+  "",
   "Examples:",
   "",
   "tempest --url=http://hubitat.local:39501 --interval=5 --daemon",
@@ -401,16 +736,35 @@ const char* const Arguments::usage_[] = {
 };
 
 const struct option Arguments::option_[] = {
-  {"url",      required_argument, 0, 'u'},
-  {"interval", required_argument, 0, 'i'},
-  {"log",      required_argument, 0, 'l'},
-  {"daemon",   no_argument,       0, 'd'},
-  {"trace",    no_argument,       0, 't'},
-  {"stop",     no_argument,       0, 's'},
-  {"stats",    no_argument,       0, 'x'},  
-  {"version",  no_argument,       0, 'v'},
-  {"help",     no_argument,       0, 'h'},
-  {nullptr,    0,                 0, 0  }
+  {"url",         required_argument, 0, 'u'},
+  {"config",      required_argument, 0, 'C'},
+  {"interval",    required_argument, 0, 'i'},
+  {"log",         required_argument, 0, 'l'},
+  {"rcvbuf",      required_argument, 0, 'r'},
+  {"ring",        required_argument, 0, 'q'},
+  {"workers",     required_argument, 0, 'w'},
+  {"rate",        required_argument, 0, 'a'},
+  {"compress",    required_argument, 0, 'z'},
+  {"elevation",   required_argument, 0, 'e'},
+  {"alerts",      required_argument, 0, 'A'},
+  {"strike",      required_argument, 0, 'k'},
+  {"stream",      required_argument, 0, 'S'},
+  {"deskew",      no_argument,       0, 'D'},
+  {"channels",    required_argument, 0, 'c'},
+  {"cpu-rx",      required_argument, 0, 'R'},
+  {"cpu-tx",      required_argument, 0, 'T'},
+  {"cpu-workers", required_argument, 0, 'W'},
+  {"fifo",        required_argument, 0, 'f'},
+  {"mlock",       no_argument,       0, 'm'},
+  {"daemon",      no_argument,       0, 'd'},
+  {"trace",       no_argument,       0, 't'},
+  {"stop",        no_argument,       0, 's'},
+  {"stats",       no_argument,       0, 'x'},
+  {"gaps",        no_argument,       0, 'g'},
+  {"quantiles",   no_argument,       0, 'Q'},
+  {"version",     no_argument,       0, 'v'},
+  {"help",        no_argument,       0, 'h'},
+  {nullptr,       0,                 0, 0  }
 };
 
 } // namespace tempest
@@ -0,0 +1,204 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: pool of size-classed, reusable datagram buffers
+//
+
+#ifndef TEMPEST_BUFFER
+#define TEMPEST_BUFFER
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+class BufferPool;
+
+//
+// Move-only handle to a pooled buffer: the memory goes back to its pool when the handle is destroyed
+// so ownership can be passed down the pipeline without copying the data
+//
+
+class Buffer {
+public:
+
+  Buffer() noexcept: pool_{nullptr}, data_{nullptr}, size_{0}, capacity_{0}, class_{0} {}
+
+  Buffer(Buffer&& other) noexcept: Buffer() { Swap(other); }
+
+  Buffer& operator=(Buffer&& other) noexcept {
+    Buffer tmp{move(other)};
+    Swap(tmp);
+    return (*this);
+  }
+
+  Buffer(const Buffer&) = delete;
+  Buffer& operator=(const Buffer&) = delete;
+
+  ~Buffer();
+
+  inline char* Data(void) noexcept { return (data_); }
+  inline const char* Data(void) const noexcept { return (data_); }
+  inline size_t Size(void) const noexcept { return (size_); }
+  inline size_t Capacity(void) const noexcept { return (capacity_); }
+  inline bool Empty(void) const noexcept { return (!data_); }
+
+  void Resize(size_t size) noexcept {
+    //
+    // Set the length of the data and keep it null terminated
+    //
+    assert(size < capacity_);
+
+    size_ = size;
+    data_[size_] = '\0';
+  }
+
+private:
+
+  friend class BufferPool;
+
+  Buffer(BufferPool* pool, char* data, size_t capacity, size_t cls) noexcept: pool_{pool}, data_{data}, size_{0}, capacity_{capacity}, class_{cls} {
+    data_[0] = '\0';
+  }
+
+  void Swap(Buffer& other) noexcept {
+    swap(pool_, other.pool_);
+    swap(data_, other.data_);
+    swap(size_, other.size_);
+    swap(capacity_, other.capacity_);
+    swap(class_, other.class_);
+  }
+
+  BufferPool* pool_;
+  char* data_;
+  size_t size_;
+  size_t capacity_;
+  size_t class_;
+};
+
+class BufferPool {
+public:
+
+  //
+  // Size classes grow by a factor of 4 from size_min up to the first one that can hold size_max bytes
+  // The largest class is always able to hold any UDP datagram when size_max = 65536
+  //
+  BufferPool(size_t size_min = 1024, size_t size_max = 65536, size_t free_max = 64): free_max_{free_max} {
+    for (size_t size = size_min; ; size *= 4) {
+      class_.emplace_back(size);
+      if (size >= size_max) break;
+    }
+  }
+
+  ~BufferPool() {
+    for (Class& cls: class_) {
+      for (char* data: cls.free) delete[] data;
+    }
+  }
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  inline size_t MaxSize(void) const { return (class_.back().size - 1); }
+
+  Buffer Acquire(size_t size) {
+    //
+    // Return a buffer able to hold at least size bytes plus the null terminator
+    // or an empty buffer if size exceeds the largest class
+    //
+    size_t idx;
+
+    for (idx = 0; idx < class_.size() && class_[idx].size <= size; idx++);
+    if (idx == class_.size()) return (Buffer{});
+
+    Class& cls = class_[idx];
+    char* data = nullptr;
+
+    {
+      scoped_lock<mutex> lock{access_};
+
+      cls.acquired++;
+      if (!cls.free.empty()) {
+        data = cls.free.back();
+        cls.free.pop_back();
+        cls.reused++;
+      }
+    }
+
+    if (!data) data = new char[cls.size];
+
+    return (Buffer{this, data, cls.size, idx});
+  }
+
+  string Stats(void) {
+    //
+    // Return per class usage statistics
+    //
+    scoped_lock<mutex> lock{access_};
+    ostringstream stats{""};
+
+    stats << "Buffer Pool:" << endl;
+    for (const Class& cls: class_) {
+      stats << "     " << cls.size << " bytes: " << cls.acquired << " acquired, " << cls.reused << " reused, " << cls.free.size() << " free" << endl;
+    }
+
+    return (stats.str());
+  }
+
+private:
+
+  friend class Buffer;
+
+  void Release(char* data, size_t idx) {
+    Class& cls = class_[idx];
+
+    {
+      scoped_lock<mutex> lock{access_};
+
+      if (cls.free.size() < free_max_) {
+        cls.free.push_back(data);
+        data = nullptr;
+      }
+    }
+
+    delete[] data;
+  }
+
+  struct Class {
+    explicit Class(size_t sz): size{sz}, acquired{0}, reused{0} {}
+
+    size_t size;
+    uint acquired;
+    uint reused;
+    vector<char*> free;
+  };
+
+  const size_t free_max_;
+
+  vector<Class> class_;
+  mutex access_;
+};
+
+inline Buffer::~Buffer() {
+  if (pool_) pool_->Release(data_, class_);
+}
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_BUFFER
@@ -0,0 +1,127 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: stable sensor channel assignment
+//
+
+#ifndef TEMPEST_CHANNELS
+#define TEMPEST_CHANNELS
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Each sensor keeps its Ecowitt channel (the N of the _wfN field suffix) for life, whatever the order sensors show up in:
+// the map is a text file, one "<serial number> <channel>" per line ('#' starts a comment), loaded at startup; a sensor
+// not in the map gets the lowest channel neither used by its hub nor reserved by the map, which is appended to the file
+// Without a file channels are only unique within a hub, in order of appearance
+//
+
+class Channels {
+public:
+
+  static const int channel_max_ = 99;
+
+  static bool Load(string& file, map<string, int>& channel, string& error) {
+    //
+    // Read the map (a missing file is an empty map, it will be created): file is made absolute, daemons run from /
+    //
+    if (file.front() != '/') {
+      char cwd[PATH_MAX];
+      if (getcwd(cwd, sizeof(cwd))) file = string(cwd) + "/" + file;
+    }
+
+    channel.clear();
+
+    ifstream in{file};
+    if (!in) {
+      if (errno == ENOENT) return (true);
+
+      error = strerror(errno);
+      return (false);
+    }
+
+    set<int> used;
+    string line;
+
+    for (int number = 1; getline(in, line); number++) {
+      line = line.substr(0, line.find('#'));
+
+      istringstream fields{line};
+      string serial, extra;
+      int ch;
+
+      if (!(fields >> serial)) continue;
+      if (!(fields >> ch) || (fields >> extra) || ch < 1 || ch > channel_max_) {
+        error = "line " + to_string(number) + ": expected <serial number> <channel 1-" + to_string(channel_max_) + ">";
+        return (false);
+      }
+      if (channel.count(serial) || used.count(ch)) {
+        error = "line " + to_string(number) + ": " + (channel.count(serial)? ("duplicate sensor " + serial): ("duplicate channel " + to_string(ch)));
+        return (false);
+      }
+
+      channel[serial] = ch;
+      used.insert(ch);
+    }
+
+    return (true);
+  }
+
+  Channels(const string& file = "", const map<string, int>& channel = {}): file_{file}, channel_{channel} {
+    for (const auto& c: channel_) reserved_.insert(c.second);
+  }
+
+  int Assign(const string& serial, const vector<int>& taken, string& error) {
+    //
+    // Return the channel of a sensor, given the ones taken by the other sensors of its hub (0 if they are all taken)
+    // error is set if a new assignment couldn't be saved
+    //
+    auto it = channel_.find(serial);
+    if (it != channel_.end()) return (it->second);
+
+    int ch;
+    for (ch = 1; ch <= channel_max_; ch++) {
+      if (!reserved_.count(ch) && find(taken.begin(), taken.end(), ch) == taken.end()) break;
+    }
+    if (ch > channel_max_) return (0);
+
+    channel_[serial] = ch;
+    if (file_.empty()) return (ch);
+
+    reserved_.insert(ch);
+
+    ofstream out{file_, ios::app};
+    if (!(out << serial << " " << ch << endl)) error = file_ + ": " + strerror(errno);
+
+    return (ch);
+  }
+
+private:
+
+  const string file_;                                           // empty: assignments are not saved
+  map<string, int> channel_;
+  set<int> reserved_;
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_CHANNELS
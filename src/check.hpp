@@ -0,0 +1,104 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: strict validation of JSON files (configuration, alert rules)
+//
+
+#ifndef TEMPEST_CHECK
+#define TEMPEST_CHECK
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Every check returns false and the reason in error, prefixed by where the value is
+// A value left out (null) passes and leaves the destination alone: a typo or a wrong type is an error, not a silent default
+//
+
+class Check {
+public:
+
+  static bool Keys(const Json& json, const string& where, const set<string>& known, string& error) {
+    //
+    // A section must be an object (or left out) with only known keys
+    //
+    if (json.is_null()) return (true);
+
+    if (!json.is_object()) {
+      error = where + ": expected an object";
+      return (false);
+    }
+
+    for (const auto& item: json.object_items()) {
+      if (!known.count(item.first)) {
+        error = where + ": unknown key '" + item.first + "'";
+        return (false);
+      }
+    }
+
+    return (true);
+  }
+
+  static bool Integer(const Json& json, const string& where, int low, int high, int& value, string& error) {
+    if (json.is_null()) return (true);
+
+    double number = json.number_value();
+    if (!json.is_number() || number != floor(number) || number < low || number > high) {
+      error = where + ": expected an integer between " + to_string(low) + " and " + to_string(high);
+      return (false);
+    }
+
+    value = (int)number;
+    return (true);
+  }
+
+  static bool Number(const Json& json, const string& where, double low, double high, double& value, string& error) {
+    if (json.is_null()) return (true);
+
+    double number = json.number_value();
+    if (!json.is_number() || number < low || number > high) {
+      ostringstream range{""};
+      range << setprecision(15) << low << " and " << high;
+
+      error = where + ": expected a number between " + range.str();
+      return (false);
+    }
+
+    value = number;
+    return (true);
+  }
+
+  static bool Text(const Json& json, const string& where, string& value, string& error) {
+    if (json.is_null()) return (true);
+
+    if (!json.is_string() || json.string_value().empty()) {
+      error = where + ": expected a non empty string";
+      return (false);
+    }
+
+    value = json.string_value();
+    return (true);
+  }
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_CHECK
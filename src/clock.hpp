@@ -0,0 +1,117 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: device to relay latency and clock skew
+//
+
+#ifndef TEMPEST_CLOCK
+#define TEMPEST_CLOCK
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Each message of a hub compares its arrival time (relay clock) with the device timestamp it carries (hub clock):
+// - every difference goes into a latency histogram
+// - the ones of messages sent as soon as they happen (live) estimate the clock offset: delivery only ever adds delay, so
+//   the offset is a low percentile (p10) of the latest 63 differences, which shrugs off delayed and replayed messages
+// Device timestamps are whole seconds: differences read up to a second high
+//
+
+class Clock {
+public:
+
+  enum Bucket {
+    NEG_10S,
+    NEG_1S,
+    NEG_0S,
+    POS_1S,
+    POS_2S,
+    POS_5S,
+    POS_10S,
+    POS_1M,
+    POS_10M,
+    OVER,
+    BUCKETS
+  };
+
+  static const char* BucketName(Bucket bucket) {
+    static const char* const name[Bucket::BUCKETS] = {"<-10s", "<-1s", "<0s", "<1s", "<2s", "<5s", "<10s", "<1m", "<10m", "10m+"};
+
+    return (name[bucket]);
+  }
+
+  void Add(double arrival, time_t device, bool live) {
+    if (!device || arrival <= 0) return;
+
+    double delta = arrival - device;
+
+    static const double bound[Bucket::OVER] = {-10, -1, 0, 1, 2, 5, 10, 60, 600};
+    int bucket = upper_bound(bound, bound + Bucket::OVER, delta) - bound;
+    bucket_[bucket]++;
+    count_++;
+
+    if (!live) return;
+
+    window_[next_] = (float)delta;
+    next_ = (next_ + 1) % window_max_;
+    if (size_ < window_max_) size_++;
+
+    if (size_ >= window_min_) {
+      float sorted[window_max_];
+      copy(window_, window_ + size_, sorted);
+
+      size_t rank = size_ / 10;
+      nth_element(sorted, sorted + rank, sorted + size_);
+      offset_ = sorted[rank];
+    }
+  }
+
+  bool Offset(double& offset) const {
+    //
+    // Relay clock minus device clock, in seconds: false until there are enough live messages
+    //
+    if (size_ < window_min_) return (false);
+
+    offset = offset_;
+    return (true);
+  }
+
+  inline uint64_t Count(void) const { return (count_); }
+  inline uint64_t Count(Bucket bucket) const { return (bucket_[bucket]); }
+
+private:
+
+  static const size_t window_max_ = 63;
+  static const size_t window_min_ = 8;
+
+  uint64_t bucket_[Bucket::BUCKETS]{};
+  uint64_t count_{0};
+
+  float window_[window_max_];                                   // latest live differences
+  size_t next_{0};
+  size_t size_{0};
+  double offset_{0};
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_CLOCK
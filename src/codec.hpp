@@ -17,6 +17,15 @@
 
 #include "log.hpp"
 #include "convert.hpp"
+#include "meteo.hpp"
+#include "rules.hpp"
+#include "sketch.hpp"
+#include "fleet.hpp"
+#include "qc.hpp"
+#include "health.hpp"
+#include "clock.hpp"
+#include "channels.hpp"
+#include "worker.hpp"
 
 // Source ---------------------------------------------------------------------------------------------------------------------
 
@@ -55,6 +64,23 @@ public:
       lightning_failed =    (status & 0b000000001);
     }
 
+    uint32_t Failed(void) const {
+      //
+      // Mask of the Qc::Quantity the failed sensors measure
+      //
+      uint32_t failed = 0;
+
+      if (light_uv_failed) failed |= Qc::light_;
+      if (precip_failed) failed |= (1u << Qc::Quantity::RAIN_RATE);
+      if (wind_failed) failed |= Qc::wind_;
+      if (rh_failed) failed |= (1u << Qc::Quantity::HUMIDITY);
+      if (temperature_failed) failed |= (1u << Qc::Quantity::TEMPERATURE);
+      if (pressure_failed) failed |= (1u << Qc::Quantity::PRESSURE);
+      if (lightning_failed) failed |= (1u << Qc::Quantity::LIGHTNING);
+
+      return (failed);
+    }
+
     bool light_uv_failed        : 1;                              // 0b100000000
     bool precip_failed          : 1;                              // 0b010000000
     bool wind_failed            : 1;                              // 0b001000000
@@ -66,7 +92,119 @@ public:
     bool lightning_failed       : 1;                              // 0b000000001
   };
 
-  Sensor(const string& id, size_t queue_max): id_{id}, model_{GetModel(id)}, queue_max_{queue_max} {
+  enum Rollup {
+    HOURLY  = 0b00000001,
+    DAILY   = 0b00000010,
+    WEEKLY  = 0b00000100,
+    MONTHLY = 0b00001000,
+    YEARLY  = 0b00010000,
+    TOTAL   = 0b00100000,
+    EVENT   = 0b01000000,
+    AVG10M  = 0b10000000
+  };
+
+  class Gaps {
+  public:
+    //
+    // Compact set of missing observation intervals, oldest first
+    // Intervals are kept sorted and disjoint in a fixed size ring: when full the oldest is dropped
+    //
+    struct Interval {
+      time_t begin;                                             // timestamp of the first missing observation
+      time_t end;                                               // timestamp of the last missing observation
+      int span;                                                 // expected cadence in seconds
+    };
+
+    static const size_t interval_max_ = 16;
+
+    Gaps() {
+      first_ = size_ = 0;
+      missed_ = 0;
+    }
+
+    inline size_t Size(void) const { return (size_); }
+    inline uint Missed(void) const { return (missed_); }
+    inline const Interval& operator[](size_t idx) const { return (interval_[(first_ + idx) % interval_max_]); }
+
+    void Insert(time_t begin, time_t end, int span) {
+      //
+      // Gaps are detected in chronological order so we only need to look at the newest interval
+      //
+      missed_ += ((end - begin) / span) + 1;
+
+      if (size_) {
+        Interval& last = Item(size_ - 1);
+        if (begin <= last.end + span) {
+          last.end = max(last.end, end);
+          return;
+        }
+      }
+
+      if (size_ == interval_max_) {
+        first_ = (first_ + 1) % interval_max_;
+        size_--;
+      }
+
+      Item(size_++) = {begin, end, span};
+    }
+
+    bool Fill(time_t time) {
+      //
+      // A late (replayed) observation arrived: remove it from the interval containing it, if any
+      //
+      for (size_t idx = 0; idx < size_; idx++) {
+        Interval& gap = Item(idx);
+        if (time < gap.begin - gap.span / 2) break;
+        if (time > gap.end + gap.span / 2) continue;
+
+        if (time - gap.begin < gap.span) gap.begin += gap.span;
+        else if (gap.end - time < gap.span) gap.end -= gap.span;
+        else {
+          // Split: the right half goes in the ring after this one
+          Interval right = {time + gap.span, gap.end, gap.span};
+          gap.end = time - gap.span;
+          Split(idx, right);
+          return (true);
+        }
+
+        if (gap.begin > gap.end) Erase(idx);
+        return (true);
+      }
+
+      return (false);
+    }
+
+  private:
+
+    inline Interval& Item(size_t idx) { return (interval_[(first_ + idx) % interval_max_]); }
+
+    void Erase(size_t idx) {
+      for (; idx + 1 < size_; idx++) Item(idx) = Item(idx + 1);
+      size_--;
+    }
+
+    void Split(size_t idx, const Interval& right) {
+      if (size_ == interval_max_) {
+        // No room: keep the most recent intervals
+        if (!idx) { Item(0) = right; return; }
+        first_ = (first_ + 1) % interval_max_;
+        size_--;
+        idx--;
+      }
+
+      for (size_t pos = size_; pos > idx + 1; pos--) Item(pos) = Item(pos - 1);
+      Item(idx + 1) = right;
+      size_++;
+    }
+
+    Interval interval_[interval_max_];
+    size_t first_;
+    size_t size_;
+    uint missed_;                                               // total number of missed observations
+  };
+
+  Sensor(const string& id, size_t queue_max, const Station& station):
+    id_{id}, model_{GetModel(id)}, queue_max_{queue_max}, station_{station}, pressure_short_{station.TrendShort()}, pressure_long_{station.TrendLong()} {
 
     memset(&precipitation_, 0, sizeof(precipitation_));
     memset(&lightning_, 0, sizeof(lightning_));
@@ -75,6 +213,7 @@ public:
     memset(&status_, 0, sizeof(status_));
     memset(&obs_stats_, 0, sizeof(obs_stats_));
     memset(&event_stats_, 0, sizeof(event_stats_));
+    memset(&cadence_, 0, sizeof(cadence_));
   }
 
   size_t UdpPrecipitation(const Json& event) {
@@ -114,6 +253,7 @@ public:
     // We can have a vector of observations (WF developers confirmed oldest is first in the array)
     const Json::array& obs = event["obs"].array_items();
     size_t idx, size = obs.size();
+    time_t gap;
 
     obs_.version = event["firmware_revision"].number_value();
 
@@ -129,9 +269,17 @@ public:
       obs_.battery = evt[6].number_value();
       obs_.timespan = evt[7].number_value() * 60;
 
+      bool order = Track(obs_.timestamp, obs_.timespan, gap);
+      uint32_t flagged = Quality(order);
+
+      if (order && Qc::Good(flagged, Qc::Quantity::PRESSURE)) Pressure(obs_.timestamp, obs_.pressure);
+      if (Qc::Good(flagged, Qc::Quantity::TEMPERATURE)) quantiles_.Add(Quantiles::Metric::TEMPERATURE, obs_.timestamp, obs_.temperature);
       event_stats_.observation++;
     }
 
+    // No wind on an Air: no wind chill either
+    if (idx && Derivable()) derived_.Update(station_, obs_.temperature, obs_.humidity, obs_.pressure, 0);
+
     return (idx);
   }
 
@@ -139,6 +287,7 @@ public:
     // We can have a vector of observations (WF developers confirmed oldest is first in the array)
     const Json::array& obs = event["obs"].array_items();
     size_t idx, size = obs.size();
+    time_t gap;
 
     obs_.version = event["firmware_revision"].number_value();
 
@@ -160,7 +309,14 @@ public:
       obs_.precipitation_type = (Precipitation)evt[12].number_value();
       obs_.wind_sample = evt[13].number_value();
 
-      obs_stats_.Update(obs_.timestamp, obs_.timespan, obs_.precipitation_accumulation, obs_.wind_direction, obs_.wind_speed, obs_.wind_gust);
+      bool order = Track(obs_.timestamp, obs_.timespan, gap);
+      uint32_t flagged = Quality(order);
+
+      Statistics(flagged, gap);
+
+      if (Qc::Good(flagged, Qc::Quantity::WIND_GUST)) quantiles_.Add(Quantiles::Metric::WIND_GUST, obs_.timestamp, obs_.wind_gust);
+      if (Qc::Good(flagged, Qc::Quantity::RAIN_RATE)) quantiles_.Add(Quantiles::Metric::RAIN_RATE, obs_.timestamp, obs_stats_.precip_rate);
+
       event_stats_.observation++;
     }
 
@@ -171,6 +327,7 @@ public:
     // We can have a vector of observations (WF developers confirmed oldest is first in the array)
     const Json::array& obs = event["obs"].array_items();
     size_t idx, size = obs.size();
+    time_t gap;
 
     obs_.version = event["firmware_revision"].number_value();
 
@@ -196,10 +353,23 @@ public:
       obs_.battery = evt[16].number_value();
       obs_.timespan = evt[17].number_value() * 60;
 
-      obs_stats_.Update(obs_.timestamp, obs_.timespan, obs_.precipitation_accumulation, obs_.wind_direction, obs_.wind_speed, obs_.wind_gust);
+      bool order = Track(obs_.timestamp, obs_.timespan, gap);
+      uint32_t flagged = Quality(order);
+
+      if (order && Qc::Good(flagged, Qc::Quantity::PRESSURE)) Pressure(obs_.timestamp, obs_.pressure);
+
+      Statistics(flagged, gap);
+
+      if (Qc::Good(flagged, Qc::Quantity::WIND_GUST)) quantiles_.Add(Quantiles::Metric::WIND_GUST, obs_.timestamp, obs_.wind_gust);
+      if (Qc::Good(flagged, Qc::Quantity::TEMPERATURE)) quantiles_.Add(Quantiles::Metric::TEMPERATURE, obs_.timestamp, obs_.temperature);
+      if (Qc::Good(flagged, Qc::Quantity::RAIN_RATE)) quantiles_.Add(Quantiles::Metric::RAIN_RATE, obs_.timestamp, obs_stats_.precip_rate);
+
       event_stats_.observation++;
     }
 
+    // Only the latest observation is relayed: derive from that one
+    if (idx && Derivable()) derived_.Update(station_, obs_.temperature, obs_.humidity, obs_.pressure, obs_.wind_speed);
+
     return (idx);
   }
 
@@ -213,13 +383,253 @@ public:
     status_.status = event["sensor_status"].number_value();
     status_.debug = event["debug"].number_value();
 
+    health_.Uptime(status_.timestamp, status_.uptime);
+    health_.Battery(status_.timestamp, status_.battery);
+    health_.Rssi(status_.rssi);
+
     event_stats_.status++;
     return (1);
   }
 
+  uint32_t Quality(bool order) {
+    //
+    // Run the latest observation through the quality control, returning the mask of its flagged Qc::Quantity
+    //
+    using Q = Qc::Quantity;
+
+    double value[Q::QUANTITIES];
+    uint32_t measured = 0;
+
+    if (model_ == Model::AIR || model_ == Model::TEMPEST) {
+      value[Q::TEMPERATURE] = obs_.temperature;
+      value[Q::HUMIDITY] = obs_.humidity;
+      value[Q::PRESSURE] = obs_.pressure;
+      value[Q::LIGHTNING] = obs_.lightning_distance;
+      measured |= (1u << Q::TEMPERATURE) | (1u << Q::HUMIDITY) | (1u << Q::PRESSURE) | (1u << Q::LIGHTNING);
+    }
+
+    if (model_ == Model::SKY || model_ == Model::TEMPEST) {
+      value[Q::ILLUMINANCE] = obs_.illuminance;
+      value[Q::UV] = obs_.uv;
+      value[Q::SOLAR_RADIATION] = obs_.solar_radiation;
+      value[Q::RAIN_RATE] = (obs_.timespan > 0)? (obs_.precipitation_accumulation * 3600 / obs_.timespan): 0;
+      value[Q::WIND_LULL] = obs_.wind_lull;
+      value[Q::WIND_SPEED] = obs_.wind_speed;
+      value[Q::WIND_GUST] = obs_.wind_gust;
+      value[Q::WIND_DIRECTION] = obs_.wind_direction;
+      measured |= Qc::light_ | Qc::wind_ | (1u << Q::RAIN_RATE);
+    }
+
+    return (qc_.Verify(obs_.timestamp, value, measured, status_.status.Failed(), order));
+  }
+
+  void Statistics(uint32_t flagged, time_t gap) {
+    //
+    // Roll the latest observation into the statistics leaving the flagged quantities out: a flagged wind holds the last
+    // good one, a flagged rain gauge adds nothing and marks the precipitation rollups as incomplete
+    //
+    bool rain = Qc::Good(flagged, Qc::Quantity::RAIN_RATE);
+    bool wind = !(flagged & Qc::wind_);
+
+    obs_stats_.Update(obs_.timestamp, obs_.timespan, rain? obs_.precipitation_accumulation: 0,
+                      wind? obs_.wind_direction: obs_stats_.wind_direction, wind? obs_.wind_speed: obs_stats_.wind_speed, wind? obs_.wind_gust: obs_stats_.wind_gust);
+
+    if (gap) obs_stats_.Incomplete(gap, obs_.timestamp);
+    if (!rain) obs_stats_.Incomplete(obs_.timestamp, obs_.timestamp);
+  }
+
+  bool Derivable(void) const {
+    //
+    // Derived values are only recomputed from good inputs: otherwise they keep the last good ones
+    //
+    const uint32_t input = (1u << Qc::Quantity::TEMPERATURE) | (1u << Qc::Quantity::HUMIDITY) | (1u << Qc::Quantity::PRESSURE) | (1u << Qc::Quantity::WIND_SPEED);
+
+    return (!(qc_.Flagged() & input));
+  }
+
+  bool Track(time_t time, int span, time_t& gap) {
+    //
+    // Compare each observation against the expected cadence to detect missing ones in O(1)
+    // Return false if the observation is late (replayed from the hub backlog), in which case it is removed from the gaps
+    // If observations were missed, gap is set to the timestamp of the last missing one, otherwise to 0
+    //
+    time_t last = cadence_.timestamp;
+    gap = 0;
+
+    if (time <= last) {
+      if (gaps_.Fill(time)) cadence_.filled++;
+      return (false);
+    }
+
+    cadence_.timestamp = time;
+    if (last && span > 0 && (time - last) > (span + span / 2)) {
+      gap = time - span;
+      gaps_.Insert(last + span, gap, span);
+    }
+
+    return (true);
+  }
+
+  void Alert(const Rules& rules, const string& hub_id, time_t now, vector<string>& alert) {
+    //
+    // Evaluate the alert rules reading the fields changed by the last update, appending a JSON message per firing
+    //
+    double value[Rules::Field::FIELDS];
+    uint32_t known = Fields(value);
+    uint32_t changed = 0;
+
+    for (int field = 0; field < Rules::Field::FIELDS; field++) {
+      if (!alert_.valid || value[field] != alert_.value[field]) changed |= (1u << field);
+    }
+
+    // Event fields only count when their event arrives, even if the values are the same as last time
+    changed &= ~Rules::event_fields_;
+    if (lightning_.timestamp != alert_strike_) changed |= Rules::event_fields_;
+    alert_strike_ = lightning_.timestamp;
+
+    memcpy(alert_.value, value, sizeof(value));
+    alert_.valid = true;
+
+    thread_local vector<Rules::Firing> firing;
+    firing.clear();
+
+    rules.Evaluate(value, changed, known, now, alert_, firing);
+
+    for (const Rules::Firing& f: firing) {
+      ostringstream message{""};
+
+      message << "{\"type\":\"alert\",\"rule\":\"" << rules.Name(f.rule) << "\",\"state\":\"" << (f.fired? "fired": "cleared") << "\"";
+      message << ",\"hub_sn\":\"" << hub_id << "\",\"serial_number\":\"" << id_ << "\",\"timestamp\":" << now << ",\"fields\":{";
+
+      const char* sep = "";
+      for (int field = 0; field < Rules::Field::FIELDS; field++) {
+        if (!(rules.Depends(f.rule) & (1u << field))) continue;
+        message << sep << "\"" << Rules::FieldName((Rules::Field)field) << "\":" << value[field];
+        sep = ",";
+      }
+      message << "}}";
+
+      alert.push_back(message.str());
+    }
+  }
+
+  uint32_t Fields(double value[]) const {
+    //
+    // Current value of each alert rule field (metric), returning the mask of the ones this sensor has reported
+    //
+    using F = Rules::Field;
+
+    value[F::TEMPERATURE] = obs_.temperature;
+    value[F::HUMIDITY] = obs_.humidity;
+    value[F::PRESSURE] = obs_.pressure;
+    value[F::SEA_LEVEL_PRESSURE] = derived_.sea_level;
+    value[F::PRESSURE_TREND] = pressure_long_.Change();
+    value[F::DEW_POINT] = derived_.dew_point;
+    value[F::FEELS_LIKE] = derived_.feels_like;
+    value[F::WIND_SPEED] = obs_.wind_speed;
+    value[F::WIND_GUST] = obs_.wind_gust;
+    value[F::WIND_LULL] = obs_.wind_lull;
+    value[F::WIND_DIRECTION] = obs_.wind_direction;
+    value[F::RAPID_WIND_SPEED] = wind_.speed;
+    value[F::RAIN_RATE] = obs_stats_.precip_rate;
+    value[F::RAIN_DAILY] = obs_stats_.precip_daily;
+    value[F::UV] = obs_.uv;
+    value[F::SOLAR_RADIATION] = obs_.solar_radiation;
+    value[F::ILLUMINANCE] = obs_.illuminance;
+    value[F::LIGHTNING_COUNT] = obs_.lightning_count;
+    value[F::LIGHTNING_DISTANCE] = lightning_.distance;
+    value[F::LIGHTNING_ENERGY] = lightning_.energy;
+    value[F::BATTERY] = obs_.battery;
+
+    const uint32_t air = (1u << F::TEMPERATURE) | (1u << F::HUMIDITY) | (1u << F::PRESSURE) | (1u << F::LIGHTNING_COUNT);
+    const uint32_t sky = (1u << F::WIND_SPEED) | (1u << F::WIND_GUST) | (1u << F::WIND_LULL) | (1u << F::WIND_DIRECTION) |
+                         (1u << F::RAIN_RATE) | (1u << F::RAIN_DAILY) | (1u << F::UV) | (1u << F::SOLAR_RADIATION) | (1u << F::ILLUMINANCE);
+
+    uint32_t known = 0;
+
+    if (obs_.timestamp) {
+      known |= (1u << F::BATTERY);
+      if (model_ == Model::AIR || model_ == Model::TEMPEST) known |= air;
+      if (model_ == Model::SKY || model_ == Model::TEMPEST) known |= sky;
+    }
+
+    // Rules never see flagged values
+    static const pair<Qc::Quantity, uint32_t> quality[] = {
+      {Qc::Quantity::TEMPERATURE,     1u << F::TEMPERATURE},
+      {Qc::Quantity::HUMIDITY,        1u << F::HUMIDITY},
+      {Qc::Quantity::PRESSURE,        1u << F::PRESSURE},
+      {Qc::Quantity::ILLUMINANCE,     1u << F::ILLUMINANCE},
+      {Qc::Quantity::UV,              1u << F::UV},
+      {Qc::Quantity::SOLAR_RADIATION, 1u << F::SOLAR_RADIATION},
+      {Qc::Quantity::RAIN_RATE,       (1u << F::RAIN_RATE) | (1u << F::RAIN_DAILY)},
+      {Qc::Quantity::WIND_LULL,       1u << F::WIND_LULL},
+      {Qc::Quantity::WIND_SPEED,      1u << F::WIND_SPEED},
+      {Qc::Quantity::WIND_GUST,       1u << F::WIND_GUST},
+      {Qc::Quantity::WIND_DIRECTION,  1u << F::WIND_DIRECTION},
+      {Qc::Quantity::LIGHTNING,       1u << F::LIGHTNING_COUNT}
+    };
+
+    for (const auto& q: quality) {
+      if (!Qc::Good(qc_.Flagged(), q.first)) known &= ~q.second;
+    }
+    if (derived_.Valid()) known |= (1u << F::SEA_LEVEL_PRESSURE) | (1u << F::DEW_POINT) | (1u << F::FEELS_LIKE);
+    if (pressure_long_.Valid()) known |= (1u << F::PRESSURE_TREND);
+    if (wind_.timestamp) known |= (1u << F::RAPID_WIND_SPEED);
+    if (lightning_.timestamp) known |= Rules::event_fields_;
+
+    return (known);
+  }
+
+  void Pressure(time_t time, double pressure) {
+    //
+    // Feed the pressure trends with an in order observation (a failed barometer reports 0)
+    //
+    if (pressure <= 0) return;
+
+    pressure_short_.Add(time, pressure);
+    pressure_long_.Add(time, pressure);
+  }
+
   const string id_;
   const Model model_;
   const size_t queue_max_;
+  const Station station_;
+
+  // Dew point, feels like, sea-level pressure, ...
+  Derived derived_;
+
+  // Station pressure trends (hPa)
+  Trend pressure_short_;
+  Trend pressure_long_;
+
+  // Distributions per rollup tier
+  Quantiles quantiles_;
+
+  // Fleet aggregates column
+  size_t fleet_slot_{Fleet::npos};
+
+  // Quality control
+  Qc qc_;
+
+  // Ecowitt channel and its field keys ("&tempf_wf1=", ...)
+  int channel_{0};
+  vector<string> key_;
+
+  // Reboots, battery, signal
+  Health health_;
+
+  // Alert rules evaluation
+  Rules::State alert_;
+  time_t alert_strike_{0};                                      // lightning strike the rules have seen
+
+  // Observation cadence tracking
+  struct {
+    time_t timestamp;                                           // latest observation
+    uint filled;                                                // late observations that filled a gap
+  }
+  cadence_;
+
+  Gaps gaps_;
 
   // Rain Start Event
   struct {
@@ -308,6 +718,9 @@ public:
     double wind_sample[2][10];  // 10m wind direction and speed samples
     size_t wind_index;          // 0-9
 
+    uint incomplete;            // Rollup mask of statistics missing observations
+    time_t incomplete_time;     // last missing observation
+
     void PrecipitationStarted(time_t time) {
       // A rain start event arrived and it's not raining: add a minimal amount just to signal it
       // next observation should then report things correclty
@@ -316,33 +729,42 @@ public:
 
     void Update(time_t time, int span, double level, double direction, double speed, double gust) {
       // Roll-over time
-      struct tm roll = *gmtime(&time);
+      struct tm roll;
+      gmtime_r(&time, &roll);
 
       if (roll.tm_year != track.tm_year) {
         track = roll;
         precip_hourly = precip_daily = precip_weekly = precip_monthly = precip_yearly = 0;
         wind_gust_daily = 0;
+        incomplete &= ~(HOURLY | DAILY | WEEKLY | MONTHLY | YEARLY);
       }
       else if (roll.tm_mon != track.tm_mon) {
         track = roll;
         precip_hourly = precip_daily = precip_weekly = precip_monthly = 0;
         wind_gust_daily = 0;
+        incomplete &= ~(HOURLY | DAILY | WEEKLY | MONTHLY);
       }
       else if (roll.tm_wday == 0 && track.tm_wday == 6) {
         track = roll;
         precip_hourly = precip_daily = precip_weekly = 0;
         wind_gust_daily = 0;
+        incomplete &= ~(HOURLY | DAILY | WEEKLY);
       }
       else if (roll.tm_yday != track.tm_yday) {
         track = roll;
         precip_hourly = precip_daily = 0;
         wind_gust_daily = 0;
+        incomplete &= ~(HOURLY | DAILY);
       }
       else if (roll.tm_hour != track.tm_hour) {
         track = roll;
         precip_hourly = 0;
+        incomplete &= ~HOURLY;
       }
 
+      if (!precip_rate) incomplete &= ~EVENT;
+      if (time - incomplete_time >= 600) incomplete &= ~AVG10M;
+
       // Precipitation stats
       precip_event = precip_rate? (precip_event + level): level;
       precip_hourly += level;
@@ -370,6 +792,31 @@ public:
       
       Convert::wind_vector_to_avg(wind_sample[0], wind_sample[1], 10, wind_direction_avg10m, wind_speed_avg10m);
     }
+
+    void Incomplete(time_t gap, time_t time) {
+      //
+      // Flag the rollups whose current period (ending at time) overlaps missing observations up to gap
+      //
+      struct tm from, to;
+      gmtime_r(&gap, &from);
+      gmtime_r(&time, &to);
+      uint mask = TOTAL | AVG10M;
+
+      if (precip_rate) mask |= EVENT;
+
+      if (from.tm_year == to.tm_year) {
+        mask |= YEARLY;
+        if (from.tm_mon == to.tm_mon) mask |= MONTHLY;
+        if ((to.tm_yday - from.tm_yday) <= to.tm_wday) mask |= WEEKLY;
+        if (from.tm_yday == to.tm_yday) {
+          mask |= DAILY;
+          if (from.tm_hour == to.tm_hour) mask |= HOURLY;
+        }
+      }
+
+      incomplete |= mask;
+      incomplete_time = gap;
+    }
   }
   obs_stats_;
 
@@ -445,35 +892,45 @@ public:
     return ("WF-HB01");
   }
 
-  Hub(const string& id, size_t queue_max): id_{id}, model_{Model(id)}, queue_max_{queue_max} {
+  Hub(const string& id, size_t queue_max, const Station& station): id_{id}, model_{Model(id)}, queue_max_{queue_max}, station_{station} {
 
     memset(&status_, 0, sizeof(status_));
     memset(&event_stats_, 0, sizeof(event_stats_));
   }
 
-  Sensor& GetSensor(const string& sensor_id) {
+  inline Sensor& GetSensor(const string& sensor_id) { return (sensor_[GetSensorIndex(sensor_id)]); }
+
+  size_t GetSensorIndex(string_view sensor_id) {
     size_t idx;
 
     assert(!sensor_id.empty());
 
     for (idx = 0; idx < sensor_.size(); idx++) {
-      if (sensor_[idx].id_ == sensor_id) return (sensor_[idx]);
+      if (sensor_[idx].id_ == sensor_id) return (idx);
     }
 
-    sensor_.emplace_back(sensor_id, queue_max_);
-    return (sensor_[idx]);
+    sensor_.emplace_back(string(sensor_id), queue_max_, station_);
+    return (idx);
   }
 
   size_t UdpStatus(const Json& event) {
+    int uptime = event["uptime"].number_value();
+    int seq = event["seq"].number_value();
+
+    time_t timestamp = event["timestamp"].number_value();
+
+    // A hub reboot restarts both uptime and sequence: observations in between were most likely lost
+    bool reboot = health_.Uptime(timestamp, uptime);
+    if (status_.timestamp && (reboot || seq < status_.seq)) event_stats_.reboot++;
 
     status_.version = strtod(event["firmware_revision"].string_value().c_str(), nullptr);
-    status_.timestamp = event["timestamp"].number_value();
+    status_.timestamp = timestamp;
 
-    status_.uptime = event["uptime"].number_value();
+    status_.uptime = uptime;
     status_.rssi = event["rssi"].number_value();
 
     status_.reset = ResetFlags(event["reset_flags"].string_value());
-    status_.seq = event["seq"].number_value();
+    status_.seq = seq;
 
     const Json::array& fs = event["fs"].array_items();
     status_.fs[0] = fs[0].number_value();
@@ -491,6 +948,9 @@ public:
     status_.mqtt[0] = mqtt[0].number_value();
     status_.mqtt[1] = mqtt[1].number_value();
 
+    health_.Rssi(status_.rssi);
+    health_.Errors(timestamp, status_.radio_i2c_bus_err_count);
+
     event_stats_.status++;
     return (1);
   }
@@ -498,9 +958,16 @@ public:
   const string id_;
   const string model_;
   const size_t queue_max_;
+  const Station station_;                                       // shared by all its sensors
 
   vector<Sensor> sensor_;
 
+  // Signal, I2C bus errors
+  Health health_;
+
+  // Latency and clock offset of all its messages
+  Clock clock_;
+
   struct {
     time_t timestamp;
 
@@ -524,6 +991,7 @@ public:
   // Event Statistics
   struct {
     uint status;
+    uint reboot;
   }
   event_stats_;
 };
@@ -531,8 +999,67 @@ public:
 class Tempest {
 public:
 
-  Tempest(size_t queue_max = 128): start_time_{time(nullptr)}, queue_max_{queue_max} {
+  enum Format {
+    ECOWITT,
+    JSON,
+    FORMATS
+  };
+
+  static const char* FormatName(Format format) {
+    static const char* const name[Format::FORMATS] = {"ecowitt", "json"};
+
+    return ((format < Format::FORMATS)? name[format]: "?");
+  }
+
+  static Format ParseFormat(const string& name) {
+    //
+    // Return the format of a name or FORMATS if unknown
+    //
+    for (int idx = 0; idx < Format::FORMATS; idx++) {
+      if (name == FormatName((Format)idx)) return ((Format)idx);
+    }
+
+    return (Format::FORMATS);
+  }
+
+  static void EncodeJson(const string& ecowitt, string& data) {
+    //
+    // Encode an Ecowitt body as a flat JSON object with the same fields: numbers stay numbers, everything else is a string
+    //
+    data = "{";
+
+    for (size_t begin = 0, end; begin < ecowitt.size(); begin = end + 1) {
+      if ((end = ecowitt.find('&', begin)) == string::npos) end = ecowitt.size();
+
+      size_t equal = ecowitt.find('=', begin);
+      if (equal >= end) continue;
+
+      string key = ecowitt.substr(begin, equal - begin);
+      string value = ecowitt.substr(equal + 1, end - equal - 1);
+
+      if (data.size() > 1) data += ',';
+      dump(key, data);
+      data += ':';
+
+      char* last;
+      double number = strtod(value.c_str(), &last);
+
+      if (!value.empty() && (isdigit(value[0]) || value[0] == '-') && !*last && isfinite(number)) data += value;
+      else {
+        // Form encoded space (dateutc)
+        replace(value.begin(), value.end(), '+', ' ');
+        dump(value, data);
+      }
+    }
+
+    data += '}';
+  }
+
+  Tempest(size_t queue_max = 128, const Station& station = Station{}, const shared_ptr<const Rules>& rules = nullptr, const Channels& channels = Channels{},
+          const map<string, Station>& stations = {}):
+    start_time_{time(nullptr)}, queue_max_{queue_max}, station_{station}, stations_{stations}, rules_{rules}, channels_{channels} {
     memset(&event_stats_, 0, sizeof(event_stats_));
+    memset(&socket_stats_, 0, sizeof(socket_stats_));
   }
 
   string StatsUdp(void) const {
@@ -550,195 +1077,1028 @@ public:
 
     stats << "Uptime: " << days << "d." << hours << "h." << minutes << "m." << seconds << "s" << endl;
     stats << "Invalid Events: " << event_stats_.invalid << endl;
-    stats << "Debug Events: " << event_stats_.debug << endl;
-    stats << "Unknown Events: " << event_stats_.unknown << endl;
+    stats << "Debug Events: " << event_stats_.type[UdpEvent::DEBUG] << endl;
+    stats << "Unknown Events: " << event_stats_.type[UdpEvent::UNKNOWN] << endl;
+    stats << "Events by Type:";
+    for (int type = 0; type < UdpEvent::DEBUG; type++) stats << (type? ", ": " ") << udp_handler_[type].type << " " << event_stats_.type[type];
+    stats << endl;
+    stats << "Kernel Drops: " << socket_stats_.dropped << " (" << DropRate() << "/min, receive buffer: " << socket_stats_.buffer << " bytes)" << endl;
+    if (DropRate() > 0) stats << "Warning: datagrams are being dropped by the kernel, increase --rcvbuf" << endl;
     hubs = hub_.size();
     stats << "Hubs: " << hubs << endl;
     for (size_t i = 0; i < hubs; i++ ) {
       const Hub& hub = hub_[i];
       stats << "[" << i << "]: " << hub.id_ << " " << hub.status_.version << endl;
       stats << "     Status Events: " << hub.event_stats_.status << endl;
+      stats << "     Reboots: " << hub.event_stats_.reboot << endl;
+      stats << "     Health: rssi " << hub.health_.RssiText() << ", i2c errors " << ErrorRateText(hub.health_) << ", radio reboots " << hub.status_.radio_reboot_count << endl;
+      stats << "     Clock: " << ClockText(hub.clock_) << endl;
       sensors = hub.sensor_.size();
       stats << "     Sensors: " << sensors << endl;
       for (size_t i = 0; i < sensors; i++ ) {
         const Sensor& sensor = hub.sensor_[i];
         stats << "     [" << i << "]: " << sensor.id_ << " " << sensor.status_.version << endl;
+        stats << "          Channel: " << sensor.channel_ << endl;
         stats << "          Rain Start Events: " << sensor.event_stats_.precipitation << endl;
         stats << "          Lightning Strike Events: " << sensor.event_stats_.lightning << endl;
         stats << "          Rapid wind Events: " << sensor.event_stats_.wind << endl;
         stats << "          Observation Events: " << sensor.event_stats_.observation << endl;
         stats << "          Status Events: " << sensor.event_stats_.status << endl;
+        stats << "          Derived Values: " << sensor.derived_.Updates() << " update(s) (cached: " << sensor.derived_.Cached() << ")" << endl;
+        if (sensor.model_ == Sensor::Model::AIR || sensor.model_ == Sensor::Model::TEMPEST) {
+          stats << "          Pressure Trend: " << TrendText(sensor.pressure_short_) << ", " << TrendText(sensor.pressure_long_);
+          stats << " (" << Trend::TendencyName(sensor.pressure_long_.GetTendency()) << ")" << endl;
+        }
+        stats << "          Gaps: " << sensor.gaps_.Size() << " (missed observations: " << sensor.gaps_.Missed() << ", backfilled: " << sensor.cadence_.filled << ")" << endl;
+        stats << "          Quality: " << sensor.qc_.Checked() << " checked (flags:";
+        for (int check = 0; check < Qc::Check::CHECKS; check++) stats << (check? ", ": " ") << Qc::CheckName((Qc::Check)check) << " " << sensor.qc_.Flags((Qc::Check)check);
+        stats << ")" << endl;
+        if (sensor.qc_.Flagged()) stats << "          Flagged: " << Qc::List(sensor.qc_.Flagged()) << endl;
+        stats << "          Health: " << sensor.health_.Reboots() << " reboot(s), battery " << sensor.status_.battery << " V (" << BatterySlopeText(sensor.health_);
+        stats << "), rssi " << sensor.health_.RssiText() << endl;
       }
     }
 
     return (stats.str());
   }
 
-  size_t WriteUdp(Log& log, const char udp[], size_t udp_len, bool& notify) {
+  string StatsGaps(void) const {
+    //
+    // Return the missing observation intervals of all sensors, one per line:
+    // <hub> <sensor> <first missing timestamp> <last missing timestamp> <cadence in seconds>
+    //
+    ostringstream gaps{""};
+
+    for (const Hub& hub: hub_) {
+      for (const Sensor& sensor: hub.sensor_) {
+        for (size_t i = 0; i < sensor.gaps_.Size(); i++) {
+          const Sensor::Gaps::Interval& gap = sensor.gaps_[i];
+          gaps << hub.id_ << " " << sensor.id_ << " " << gap.begin << " " << gap.end << " " << gap.span << endl;
+        }
+      }
+    }
+
+    return (gaps.str());
+  }
+
+  string StatsQuantiles(void) const {
+    //
+    // Return p50/p95/p99/max of each sensor measurement distribution per rollup tier, then the whole fleet's
     //
-    // Return the number of events/observation written to tempest
+    ostringstream quantiles{""};
+    Kll fleet[Quantiles::Metric::METRICS][Quantiles::Tier::TIERS];
+    size_t sensors = 0;
+
+    // Only the sensors measuring something: a fleet percentile merges the sketches of the same period
+    int64_t period[Quantiles::Tier::TIERS];
+    Quantiles::Periods(time(nullptr), period);
+
+    for (const Hub& hub: hub_) {
+      for (const Sensor& sensor: hub.sensor_) {
+        const Quantiles& q = sensor.quantiles_;
+        bool header = false;
+
+        for (int metric = 0; metric < Quantiles::Metric::METRICS; metric++) {
+          bool any = false;
+          for (int tier = 0; tier < Quantiles::Tier::TIERS && !any; tier++) any = q.Current((Quantiles::Metric)metric, (Quantiles::Tier)tier).Count();
+          if (!any) continue;
+
+          if (!header) {
+            quantiles << "Sensor " << sensor.id_ << " (hub: " << hub.id_ << "), p50/p95/p99/max (samples):" << endl;
+            header = true;
+            sensors++;
+          }
+
+          QuantilesLine(quantiles, (Quantiles::Metric)metric, [&](Quantiles::Tier tier){ return (&q.Current((Quantiles::Metric)metric, tier)); },
+                                                              [&](Quantiles::Tier tier){ return (&q.Previous((Quantiles::Metric)metric, tier)); });
+
+          for (int tier = 0; tier < Quantiles::Tier::TIERS; tier++) {
+            if (q.Period((Quantiles::Metric)metric, (Quantiles::Tier)tier) == period[tier]) fleet[metric][tier].Merge(q.Current((Quantiles::Metric)metric, (Quantiles::Tier)tier));
+          }
+        }
+      }
+    }
+
+    if (sensors) {
+      quantiles << "Fleet (" << sensors << " sensor(s)), p50/p95/p99/max (samples):" << endl;
+      for (int metric = 0; metric < Quantiles::Metric::METRICS; metric++) {
+        QuantilesLine(quantiles, (Quantiles::Metric)metric, [&](Quantiles::Tier tier){ return (&fleet[metric][tier]); }, nullptr);
+      }
+    }
+
+    return (quantiles.str());
+  }
+
+  string StatsFleet(void) {
+    //
+    // Return the fleet aggregates
+    //
+    ostringstream stats{""};
+
+    fleet_.Expire(time(nullptr));
+
+    size_t slot;
+    double gust = fleet_.MaxGust(slot), mean;
+
+    stats << "Fleet: " << fleet_.Sensors() << " sensor(s), " << fleet_.Raining() << " raining (recomputed: " << fleet_.Recomputes() << ")" << endl;
+    if (slot != Fleet::npos) stats << "     Max Gust: " << gust << " m/s (" << FleetSensor(slot)->id_ << ")" << endl;
+    if (fleet_.MeanTemperature(mean)) stats << "     Mean Temperature: " << mean << " °C" << endl;
+
+    for (size_t hub = 0; hub < hub_.size(); hub++) {
+      if (fleet_.HubTemperature(hub, mean)) stats << "     Hub " << hub_[hub].id_ << ": mean temperature " << mean << " °C" << endl;
+    }
+
+    if (fleet_.Raining()) {
+      stats << "     Raining:";
+      for (const Hub& hub: hub_) {
+        for (const Sensor& sensor: hub.sensor_) if (fleet_.IsRaining(sensor.fleet_slot_)) stats << " " << sensor.id_ << " (" << sensor.obs_stats_.precip_rate << " mm/h)";
+      }
+      stats << endl;
+    }
+
+    return (stats.str());
+  }
+
+  string MetricsFleet(void) {
+    //
+    // Return the fleet aggregates in the Prometheus text exposition format
+    //
+    ostringstream metrics{""};
+
+    fleet_.Expire(time(nullptr));
+
+    size_t slot;
+    double gust = fleet_.MaxGust(slot), mean;
+
+    metrics << "# HELP tempest_fleet_sensors Sensors known to the relay." << endl << "# TYPE tempest_fleet_sensors gauge" << endl;
+    metrics << "tempest_fleet_sensors " << fleet_.Sensors() << endl;
+    metrics << "# HELP tempest_fleet_raining Sensors currently reporting rain." << endl << "# TYPE tempest_fleet_raining gauge" << endl;
+    metrics << "tempest_fleet_raining " << fleet_.Raining() << endl;
+
+    if (slot != Fleet::npos) {
+      metrics << "# HELP tempest_fleet_max_gust_mps Highest wind gust reported by any sensor." << endl << "# TYPE tempest_fleet_max_gust_mps gauge" << endl;
+      metrics << "tempest_fleet_max_gust_mps{serial_number=\"" << FleetSensor(slot)->id_ << "\"} " << gust << endl;
+    }
+
+    if (fleet_.MeanTemperature(mean)) {
+      metrics << "# HELP tempest_fleet_temperature_celsius Mean temperature of all the sensors." << endl << "# TYPE tempest_fleet_temperature_celsius gauge" << endl;
+      metrics << "tempest_fleet_temperature_celsius " << mean << endl;
+    }
+
+    metrics << "# HELP tempest_hub_temperature_celsius Mean temperature of the sensors of a hub." << endl << "# TYPE tempest_hub_temperature_celsius gauge" << endl;
+    for (size_t hub = 0; hub < hub_.size(); hub++) {
+      if (fleet_.HubTemperature(hub, mean)) metrics << "tempest_hub_temperature_celsius{hub_sn=\"" << hub_[hub].id_ << "\"} " << mean << endl;
+    }
+
+    metrics << "# HELP tempest_sensor_raining Whether a sensor is reporting rain." << endl << "# TYPE tempest_sensor_raining gauge" << endl;
+    for (const Hub& hub: hub_) {
+      for (const Sensor& sensor: hub.sensor_) {
+        if (sensor.model_ == Sensor::Model::AIR) continue;
+        metrics << "tempest_sensor_raining{hub_sn=\"" << hub.id_ << "\",serial_number=\"" << sensor.id_ << "\"} " << (fleet_.IsRaining(sensor.fleet_slot_)? 1: 0) << endl;
+      }
+    }
+
+    return (metrics.str());
+  }
+
+  string MetricsHealth(void) const {
+    //
+    // Return the device and hub health indicators in the Prometheus text exposition format
+    //
+    ostringstream metrics{""};
+    time_t now = time(nullptr);
+    double value;
+
+    metrics << "# HELP tempest_hub_reboots_total Hub reboots seen by the relay." << endl << "# TYPE tempest_hub_reboots_total counter" << endl;
+    for (const Hub& hub: hub_) metrics << "tempest_hub_reboots_total{hub_sn=\"" << hub.id_ << "\"} " << hub.event_stats_.reboot << endl;
+
+    metrics << "# HELP tempest_hub_rssi_dbm Hub WiFi signal distribution." << endl << "# TYPE tempest_hub_rssi_dbm summary" << endl;
+    for (const Hub& hub: hub_) MetricsRssi(metrics, "tempest_hub_rssi_dbm", "hub_sn=\"" + hub.id_ + "\"", hub.health_.RssiSketch());
+
+    metrics << "# HELP tempest_hub_i2c_errors_per_hour Hub radio I2C bus errors per hour over the last day." << endl << "# TYPE tempest_hub_i2c_errors_per_hour gauge" << endl;
+    for (const Hub& hub: hub_) {
+      if (hub.health_.ErrorRate(value, now)) metrics << "tempest_hub_i2c_errors_per_hour{hub_sn=\"" << hub.id_ << "\"} " << value << endl;
+    }
+
+    metrics << "# HELP tempest_device_reboots_total Device reboots seen by the relay." << endl << "# TYPE tempest_device_reboots_total counter" << endl;
+    for (const Hub& hub: hub_) {
+      for (const Sensor& sensor: hub.sensor_) metrics << "tempest_device_reboots_total{hub_sn=\"" << hub.id_ << "\",serial_number=\"" << sensor.id_ << "\"} " << sensor.health_.Reboots() << endl;
+    }
+
+    metrics << "# HELP tempest_device_battery_volts Device battery voltage." << endl << "# TYPE tempest_device_battery_volts gauge" << endl;
+    for (const Hub& hub: hub_) {
+      for (const Sensor& sensor: hub.sensor_) {
+        if (sensor.status_.battery > 0) metrics << "tempest_device_battery_volts{hub_sn=\"" << hub.id_ << "\",serial_number=\"" << sensor.id_ << "\"} " << sensor.status_.battery << endl;
+      }
+    }
+
+    metrics << "# HELP tempest_device_battery_slope_volts_per_day Device battery voltage trend over the last week." << endl << "# TYPE tempest_device_battery_slope_volts_per_day gauge" << endl;
+    for (const Hub& hub: hub_) {
+      for (const Sensor& sensor: hub.sensor_) {
+        if (sensor.health_.BatterySlope(value)) metrics << "tempest_device_battery_slope_volts_per_day{hub_sn=\"" << hub.id_ << "\",serial_number=\"" << sensor.id_ << "\"} " << value << endl;
+      }
+    }
+
+    metrics << "# HELP tempest_device_rssi_dbm Device radio signal distribution." << endl << "# TYPE tempest_device_rssi_dbm summary" << endl;
+    for (const Hub& hub: hub_) {
+      for (const Sensor& sensor: hub.sensor_) MetricsRssi(metrics, "tempest_device_rssi_dbm", "hub_sn=\"" + hub.id_ + "\",serial_number=\"" + sensor.id_ + "\"", sensor.health_.RssiSketch());
+    }
+
+    return (metrics.str());
+  }
+
+  inline void SetSocketBuffer(int size) { socket_stats_.buffer = size; }
+  inline void SetDeskew(bool deskew) { deskew_ = deskew; }
+
+  void UpdateDropped(uint32_t dropped, time_t now) {
+    //
+    // Record the kernel cumulative drop counter and refresh the per minute drop rate gauge
+    //
+    socket_stats_.dropped = dropped;
+
+    if (!socket_stats_.window) {
+      socket_stats_.window = now;
+      socket_stats_.mark = dropped;
+    }
+    else if (now - socket_stats_.window >= 60) {
+      socket_stats_.rate = (dropped - socket_stats_.mark) * 60.0 / (now - socket_stats_.window);
+      socket_stats_.window = now;
+      socket_stats_.mark = dropped;
+    }
+  }
+
+  size_t WriteUdp(Log& log, const vector<string_view>& udp, const vector<double>& arrival, WorkerPool& workers, bool& notify) {
+    //
+    // Write a batch of datagrams and return the number of events/observation written to tempest
     // or 0 if error/debug/unrecognized
+    // arrival is the wall clock time each datagram was received at
     //
-    size_t obs = 0;
+    // JSON parsing is spread over the worker pool; hubs and sensors are then resolved in arrival order and
+    // each one gets a single task applying its events in order, so per-sensor ordering is preserved
+    //
+    size_t count = udp.size();
+    vector<Json> event(count);
+    vector<string> err(count);
+
     notify = false;
 
-    string err;
-    Json event = Json::parse(udp, err);
-    if (event == nullptr) {
-      event_stats_.invalid++;
-      TLOG_ERROR(log) << "JSON error: " << err << " parsing: " << udp << "." << endl;
-    }
-    else {
-      const string& type = event["type"].string_value();
+    // Parsed in place: strings reference the batch buffers, which outlive event
+    workers.Run(count, [&](size_t idx) {
+      event[idx] = Json::parse(udp[idx], err[idx], JsonParse::STANDARD, JsonStrings::BORROW);
+    });
+
+    // Resolve targets: this is where hubs and sensors get created so it must be sequential
+    struct Shard {
+      size_t hub;
+      size_t sensor;                                            // npos for hub events
+      vector<pair<size_t, UdpEvent>> event;
+      size_t obs;
+      bool notify;
+      vector<string> alert;
+    };
+
+    vector<Shard> shard;
+    map<pair<size_t, size_t>, size_t> shard_idx;
+
+    for (size_t idx = 0; idx < count; idx++) {
+      if (event[idx] == nullptr) {
+        event_stats_.invalid++;
+        TLOG_ERROR(log) << "JSON error: " << err[idx] << " parsing: " << udp[idx] << "." << endl;
+        continue;
+      }
+
+      UdpEvent type = GetUdpEvent(event[idx]["type"].string_view_value());
+      const UdpHandler& handler = udp_handler_[type];
+      pair<size_t, size_t> target;
 
-      if (type == "hub_status") {
-        Hub& hub = GetHub(event["serial_number"].string_value());
-        obs = hub.UdpStatus(event);
+      event_stats_.type[type]++;
+
+      if (!handler.apply) {
+        if (type == UdpEvent::UNKNOWN) TLOG_WARNING(log) << "Unrecognized UDP event: " << udp[idx] << "." << endl;
+        continue;
+      }
+      else if (handler.hub) {
+        target = {GetHubIndex(event[idx]["serial_number"].string_view_value()), string::npos};
       }
       else {
-        Sensor& sensor = GetHub(event["hub_sn"].string_value()).GetSensor(event["serial_number"].string_value());
-
-        if (type == "evt_precip") {
-          obs = sensor.UdpPrecipitation(event);
-          if (obs > 0) notify = true;
-        }
-        else if (type == "evt_strike") {
-          obs = sensor.UdpLightning(event);
-          if (obs > 0) notify = true;
-        }
-        else if (type == "rapid_wind") {
-          obs = sensor.UdpWind(event);
-        }
-        else if (type == "obs_air") {
-          obs = sensor.UdpObservationAir(event);
-        }
-        else if (type == "obs_sky") {
-          obs = sensor.UdpObservationSky(event);
-        }
-        else if (type == "obs_st") {
-          obs = sensor.UdpObservationTempest(event);
-        }
-        else if (type == "device_status") {
-          obs = sensor.UdpStatus(event);
-        }
-        else if (type.find("debug") != string::npos) {
-          event_stats_.debug++;
-        }
-        else {
-          event_stats_.unknown++;
-          TLOG_WARNING(log) << "Unrecognized UDP event: " << udp << "." << endl;
+        size_t hub = GetHubIndex(event[idx]["hub_sn"].string_view_value());
+        size_t sensors = hub_[hub].sensor_.size();
+        target = {hub, hub_[hub].GetSensorIndex(event[idx]["serial_number"].string_view_value())};
+        if (target.second == sensors) {
+          Channel(log, hub, target.second);
+          added_.push_back(target);
+          hub_[hub].sensor_[target.second].fleet_slot_ = fleet_.Add(hub);
+          fleet_sensor_.push_back(target);
         }
       }
+
+      hub_[target.first].clock_.Add(arrival[idx], handler.time(event[idx]), handler.live);
+
+      auto it = shard_idx.find(target);
+      if (it == shard_idx.end()) {
+        it = shard_idx.emplace(target, shard.size()).first;
+        shard.push_back({target.first, target.second, {}, 0, false, {}});
+      }
+
+      shard[it->second].event.emplace_back(idx, type);
+    }
+
+    // Apply: hub and sensor vectors are stable from here on
+    // Alert rules are evaluated right after each sensor update, by the same task
+    time_t now = time(nullptr);
+
+    workers.Run(shard.size(), [&](size_t idx) {
+      Shard& target = shard[idx];
+      Hub& hub = hub_[target.hub];
+      Sensor* sensor = (target.sensor == string::npos)? nullptr: &hub.sensor_[target.sensor];
+
+      for (const auto& item: target.event) {
+        const UdpHandler& handler = udp_handler_[item.second];
+        size_t obs = handler.apply(event[item.first], hub, sensor);
+
+        if (obs > 0 && handler.urgent) target.notify = true;
+        target.obs += obs;
+        if (sensor && rules_) sensor->Alert(*rules_, hub.id_, now, target.alert);
+      }
+    });
+
+    size_t obs = 0;
+
+    for (Shard& target: shard) {
+      obs += target.obs;
+      notify |= target.notify;
+      if (target.notify && target.sensor != string::npos) urgent_.emplace_back(target.hub, target.sensor);
+      for (string& alert: target.alert) alert_.push_back(move(alert));
+      if (target.obs && target.sensor != string::npos) FleetUpdate(hub_[target.hub].sensor_[target.sensor]);
     }
 
     return (obs);
   }
 
-  size_t ReadEcowitt(Log& log, vector<string>& data) {
+  size_t ReadEcowitt(Log& log, vector<string>& data, WorkerPool& workers, const vector<pair<size_t, size_t>>& target) {
     //
-    // Return the number of events/observation read from tempest
+    // Return the number of events/observation read from tempest for the (hub, sensor) targets
     // or 0 if error
+    // Each sensor is encoded by its own task
     //
     data.clear();
+    data.resize(target.size());
 
-    ostringstream event;
-    size_t hubs, sensors;
-    string ch;
+    workers.Run(target.size(), [&](size_t idx) {
+      const Hub& hub = hub_[target[idx].first];
+      EncodeEcowitt(hub, hub.sensor_[target[idx].second], deskew_, data[idx]);
+    });
 
-    hubs = hub_.size();
-    for (size_t i = 0; i < hubs; i++ ) {
-      Hub& hub = hub_[i];
-      sensors = hub.sensor_.size();
-      for (size_t i = 0; i < sensors; i++ ) {
-        Sensor& sensor = hub.sensor_[i];
-        ch = "_wf" + std::to_string(i + 1) + "=";
+    return (data.size());
+  }
 
-          event.str("");
+  static bool EncodeStrike(string_view udp, string& message) {
+    //
+    // Lightning fast path: if the datagram is a strike event, encode it into message and return true
+    // Called by the receiver for every datagram, so it only scans the text: no parsing, no allocation once warmed up
+    //
+    if (udp.find("\"evt_strike\"") == string_view::npos) return (false);
 
-          // Hub attributes (head)
-          event << "PASSKEY=" << hub.id_;
-          event << "&stationtype=" << hub.model_ << "_V" << hub.status_.version << ".0.0";
-          event << "&dateutc=" << Convert::epoch_to_dateutc(hub.status_.timestamp);
+    string_view serial, hub, evt;
+    if (!JsonValue(udp, "serial_number", serial) || !JsonValue(udp, "hub_sn", hub) || !JsonValue(udp, "evt", evt)) return (false);
 
-          // Sensor attributes
-          event << "&batt" << ch << sensor.obs_.battery;
+    // evt: [timestamp, distance (km), energy]
+    double value[3];
+    const char* pos = evt.data() + 1;
+    const char* end = evt.data() + evt.size();
 
-        if (sensor.model_ == Sensor::Model::AIR || sensor.model_ == Sensor::Model::TEMPEST) {
-          // Temperature, humidity and pressure
-          event << "&tempf" << ch << Convert::C_to_F(sensor.obs_.temperature);
-          event << "&humidity" << ch << sensor.obs_.humidity;
-          event << "&baromrelin" << ch << "0";
-          event << "&baromabsin" << ch << Convert::hPa_to_inHg(sensor.obs_.pressure);
-
-          // Lightning: if we got a strike after the last observation we temporarely increase the count
-          if (sensor.lightning_.timestamp > sensor.obs_.timestamp) sensor.obs_.lightning_count++;
-          event << "&lightning" << ch << sensor.lightning_.distance;
-          event << "&lightning_time" << ch << sensor.lightning_.timestamp;
-          event << "&lightning_energy" << ch << sensor.lightning_.energy;
-          event << "&lightning_num" << ch << sensor.obs_.lightning_count;
-        }
+    for (int idx = 0; idx < 3; idx++) {
+      char* next;
+      value[idx] = strtod(pos, &next);
+      if (next == pos || next >= end || !isfinite(value[idx])) return (false);
+      pos = next + strspn(next, " \t,");
+    }
 
-        if (sensor.model_ == Sensor::Model::SKY || sensor.model_ == Sensor::Model::TEMPEST) {
-          // Solar
-          event << "&uv" << ch << sensor.obs_.uv;
-          event << "&solarradiation" << ch << sensor.obs_.solar_radiation;
-
-          // Precipitation
-          event << "&rainratein" << ch << Convert::mm_to_in(sensor.obs_stats_.precip_rate);
-          event << "&eventrainin" << ch << Convert::mm_to_in(sensor.obs_stats_.precip_event);
-          event << "&hourlyrainin" << ch << Convert::mm_to_in(sensor.obs_stats_.precip_hourly);
-          event << "&dailyrainin" << ch << Convert::mm_to_in(sensor.obs_stats_.precip_daily);
-          event << "&weeklyrainin" << ch << Convert::mm_to_in(sensor.obs_stats_.precip_weekly);
-          event << "&monthlyrainin" << ch << Convert::mm_to_in(sensor.obs_stats_.precip_monthly);
-          event << "&yearlyrainin" << ch << Convert::mm_to_in(sensor.obs_stats_.precip_yearly);
-          event << "&totalrainin" << ch << Convert::mm_to_in(sensor.obs_stats_.precip_total);
-
-          // Wind
-          event << "&winddir" << ch << sensor.obs_stats_.wind_direction;
-          event << "&winddir_avg10m" << ch << sensor.obs_stats_.wind_direction_avg10m;
-          event << "&windspeedmph" << ch << Convert::km_to_mi(Convert::ms_to_kmh(sensor.obs_stats_.wind_speed));
-          event << "&windspdmph_avg10m" << ch << Convert::km_to_mi(Convert::ms_to_kmh(sensor.obs_stats_.wind_speed_avg10m));
-          event << "&windgustmph" << ch << Convert::km_to_mi(Convert::ms_to_kmh(sensor.obs_stats_.wind_gust));
-          event << "&maxdailygust" << ch << Convert::km_to_mi(Convert::ms_to_kmh(sensor.obs_stats_.wind_gust_daily));
-        }
+    char text[256];
+    int len = snprintf(text, sizeof(text), "{\"type\":\"strike\",\"hub_sn\":\"%.*s\",\"serial_number\":\"%.*s\",\"timestamp\":%.0f,\"distance\":%g,\"energy\":%g}",
+                       (int)hub.size(), hub.data(), (int)serial.size(), serial.data(), value[0], value[1], value[2]);
+    if (len <= 0 || len >= (int)sizeof(text)) return (false);
+
+    message.assign(text, len);
+    return (true);
+  }
+
+  static string_view UdpType(string_view udp) {
+    //
+    // The "type" of a datagram, by scanning its text (empty if not found)
+    //
+    string_view type;
+    JsonValue(udp, "type", type);
+
+    return (type);
+  }
+
+  void TakeAdded(vector<pair<size_t, size_t>>& added) {
+    //
+    // Return the (hub, sensor) indexes of the sensors created since the last call
+    //
+    added.swap(added_);
+    added_.clear();
+  }
+
+  void TakeUrgent(vector<pair<size_t, size_t>>& urgent) {
+    //
+    // Append the (hub, sensor) indexes of the sensors with events to relay right away (rain start, lightning)
+    //
+    urgent.insert(urgent.end(), urgent_.begin(), urgent_.end());
+    urgent_.clear();
+  }
+
+  void TakeAlerts(vector<string>& alert) {
+    //
+    // Return the alert messages fired since the last call
+    //
+    alert.swap(alert_);
+    alert_.clear();
+  }
+
+  inline const string& GetSensorId(size_t hub, size_t sensor) const { return (hub_[hub].sensor_[sensor].id_); }
+
+  string StatsRules(void) const { return (rules_? rules_->Stats(): ""); }
+
+  //
+  // UDP message type dispatch (public for bench/dispatch.cpp)
+  //
+  enum UdpEvent {
+    HUB_STATUS,
+    EVT_PRECIP,
+    EVT_STRIKE,
+    RAPID_WIND,
+    OBS_AIR,
+    OBS_SKY,
+    OBS_ST,
+    DEVICE_STATUS,
+    DEBUG,
+    UNKNOWN,
+    UDP_EVENTS
+  };
+
+  //
+  // Device timestamp of an event (0 if missing): the latest one for observations
+  //
+  static time_t TimeStatus(const Json& event) { return (event["timestamp"].number_value()); }
+  static time_t TimeEvt(const Json& event) { return (event["evt"][0].number_value()); }
+  static time_t TimeOb(const Json& event) { return (event["ob"][0].number_value()); }
+  static time_t TimeObs(const Json& event) { return (event["obs"][event["obs"].array_items().size() - 1][0].number_value()); }
+
+  //
+  // Everything the relay does with a message type is its entry here, indexed by UdpEvent
+  // DEBUG is any type containing "debug" (e.g. "light_debug"), UNKNOWN any other one: both are only counted
+  //
+  struct UdpHandler {
+    UdpEvent event;                                             // its own index in udp_handler_
+    string_view type;                                           // "type" field
+    bool hub;                                                   // applies to the hub of serial_number, not to a sensor of hub_sn
+    bool live;                                                  // sent as soon as it happens (observations can be replayed from the hub backlog)
+    bool urgent;                                                // relayed right away once applied
+    time_t (*time)(const Json& event);
+    size_t (*apply)(const Json& event, Hub& hub, Sensor* sensor); // return the observations applied (nullptr: only counted)
+  };
+
+  static constexpr UdpHandler udp_handler_[UdpEvent::UDP_EVENTS] = {
+    {UdpEvent::HUB_STATUS,    "hub_status",    true,  true,  false, TimeStatus, [](const Json& event, Hub& hub, Sensor*) { return (hub.UdpStatus(event)); }},
+    {UdpEvent::EVT_PRECIP,    "evt_precip",    false, true,  true,  TimeEvt,    [](const Json& event, Hub&, Sensor* sensor) { return (sensor->UdpPrecipitation(event)); }},
+    {UdpEvent::EVT_STRIKE,    "evt_strike",    false, true,  true,  TimeEvt,    [](const Json& event, Hub&, Sensor* sensor) { return (sensor->UdpLightning(event)); }},
+    {UdpEvent::RAPID_WIND,    "rapid_wind",    false, true,  false, TimeOb,     [](const Json& event, Hub&, Sensor* sensor) { return (sensor->UdpWind(event)); }},
+    {UdpEvent::OBS_AIR,       "obs_air",       false, false, false, TimeObs,    [](const Json& event, Hub&, Sensor* sensor) { return (sensor->UdpObservationAir(event)); }},
+    {UdpEvent::OBS_SKY,       "obs_sky",       false, false, false, TimeObs,    [](const Json& event, Hub&, Sensor* sensor) { return (sensor->UdpObservationSky(event)); }},
+    {UdpEvent::OBS_ST,        "obs_st",        false, false, false, TimeObs,    [](const Json& event, Hub&, Sensor* sensor) { return (sensor->UdpObservationTempest(event)); }},
+    {UdpEvent::DEVICE_STATUS, "device_status", false, true,  false, TimeStatus, [](const Json& event, Hub&, Sensor* sensor) { return (sensor->UdpStatus(event)); }},
+    {UdpEvent::DEBUG,         "debug",         false, false, false, nullptr,    nullptr},
+    {UdpEvent::UNKNOWN,       "unknown",       false, false, false, nullptr,    nullptr}
+  };
+
+  //
+  // Perfect hash of the known types (the ones before DEBUG), built at compile time: length, first, middle and last
+  // character of a type, times the first multiplier giving each known type its own slot
+  // A slot also keeps the first and last 8 bytes of its type (4 if shorter), overlapping: that's the whole type for
+  // 4 to 16 characters, so matching it takes two comparisons
+  //
+  static const size_t udp_slots_ = 32;                          // the top 5 bits of the product
+
+  struct UdpHash {
+    uint32_t seed;                                              // multiplier (0: none found)
+    uint8_t event[udp_slots_];                                  // UdpEvent of each slot (UNKNOWN if free)
+    uint64_t head[udp_slots_];
+    uint64_t tail[udp_slots_];
+  };
 
-          // Hub attributes (tail)
-          event << "&freq=RSSI" << hub.status_.rssi;
-          event << "&model=" << hub.model_;
+  static constexpr size_t UdpSlot(string_view type, uint32_t seed) {
+    uint32_t key = type.empty()? 0: (type.size() | (uint8_t)type.front() << 8 | (uint8_t)type[type.size() / 2] << 16 | (uint8_t)type.back() << 24);
+    return ((key * seed) >> 27);
+  }
+
+  static constexpr uint64_t UdpWord(const char* text, size_t len) {
+    //
+    // The len (4 or 8) bytes at text, as a memory load reads them
+    //
+    uint64_t word = 0;
+    for (size_t idx = 0; idx < len; idx++) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      word = word << 8 | (uint8_t)text[idx];
+#else
+      word |= (uint64_t)(uint8_t)text[idx] << (8 * idx);
+#endif
+    }
+    return (word);
+  }
+
+  static inline uint64_t UdpLoad8(const char* text) { uint64_t word; memcpy(&word, text, 8); return (word); }
+  static inline uint64_t UdpLoad4(const char* text) { uint32_t word; memcpy(&word, text, 4); return (word); }
+
+  static constexpr bool UdpHandlerOrder(void) {
+    //
+    // Whether each handler sits at the index of its UdpEvent
+    //
+    for (int event = 0; event < UdpEvent::UDP_EVENTS; event++) {
+      if (udp_handler_[event].event != event) return (false);
+    }
+    return (true);
+  }
+
+  static constexpr UdpHash MakeUdpHash(void) {
+    UdpHash hash{};
+
+    for (hash.seed = 0x9E3779B1u; hash.seed < 0x9E3779B1u + 65536; hash.seed += 2) {
+      int type = 0;
 
-        if (!(event.str().empty())) data.emplace_back(event.str());
+      for (size_t slot = 0; slot < udp_slots_; slot++) hash.event[slot] = UdpEvent::UNKNOWN;
+      for (; type < UdpEvent::DEBUG; type++) {
+        string_view name = udp_handler_[type].type;
+        size_t slot = UdpSlot(name, hash.seed);
+        if (hash.event[slot] != UdpEvent::UNKNOWN) break;
+
+        size_t len = (name.size() >= 8)? 8: 4;
+        hash.event[slot] = type;
+        hash.head[slot] = UdpWord(name.data(), len);
+        hash.tail[slot] = UdpWord(name.data() + name.size() - len, len);
       }
+      if (type == UdpEvent::DEBUG) return (hash);
     }
 
-    return (data.size());
+    hash.seed = 0;
+    return (hash);
+  }
+
+  static UdpEvent GetUdpEvent(string_view type) {
+    //
+    // One hash and two comparisons for a known type: the "debug" scan is left to the others
+    //
+    static constexpr UdpHash hash = MakeUdpHash();
+    static_assert(UdpHandlerOrder(), "UDP message types: udp_handler_ out of UdpEvent order");
+    static_assert(hash.seed, "UDP message types: no perfect hash, two of them share length, first, middle and last character");
+
+    size_t slot = UdpSlot(type, hash.seed);
+    UdpEvent event = (UdpEvent)hash.event[slot];
+
+    if (event != UdpEvent::UNKNOWN && type.size() == udp_handler_[event].type.size()) {
+      const char* end = type.data() + type.size();
+
+      if (type.size() >= 8) {
+        if (UdpLoad8(type.data()) == hash.head[slot] && UdpLoad8(end - 8) == hash.tail[slot] && (type.size() <= 16 || type == udp_handler_[event].type)) return (event);
+      }
+      else if (UdpLoad4(type.data()) == hash.head[slot] && UdpLoad4(end - 4) == hash.tail[slot]) return (event);
+    }
+
+    return ((type.find(udp_handler_[UdpEvent::DEBUG].type) != string_view::npos)? UdpEvent::DEBUG: UdpEvent::UNKNOWN);
   }
 
 private:
 
-  Hub& GetHub(const string& hub_id) {
+  static bool JsonValue(string_view udp, const char* key, string_view& value) {
+    //
+    // Find a top level "key": "string" or "key": [array] in a flat JSON object without parsing it
+    // value is the string content or the whole array, brackets included
+    // A string with escape sequences or control characters isn't found: callers copy value into JSON text as is
+    //
+    size_t len = strlen(key);
+
+    for (size_t pos = udp.find(key); pos != string_view::npos; pos = udp.find(key, pos + len)) {
+      if (!pos || udp[pos - 1] != '"' || pos + len >= udp.size() || udp[pos + len] != '"') continue;
+
+      size_t first = udp.find_first_not_of(" \t", pos + len + 1);
+      if (first == string_view::npos || udp[first] != ':') continue;
+
+      first = udp.find_first_not_of(" \t", first + 1);
+      if (first == string_view::npos) return (false);
+
+      size_t last = udp.find((udp[first] == '[')? ']': '"', first + 1);
+      if (last == string_view::npos || (udp[first] != '[' && udp[first] != '"')) return (false);
+
+      value = (udp[first] == '[')? udp.substr(first, last - first + 1): udp.substr(first + 1, last - first - 1);
+      if (udp[first] == '[') return (value.find('"') == string_view::npos);
+
+      for (char c: value) {
+        if (c == '\\' || (unsigned char)c < 0x20) return (false);
+      }
+      return (true);
+    }
+
+    return (false);
+  }
+
+  static void EncodeEcowitt(const Hub& hub, const Sensor& sensor, bool deskew, string& data) {
+    //
+    // Encode a single sensor in Ecowitt format, with the field keys of its channel
+    // deskew: move dateutc from the hub clock to the relay clock
+    // The sensor is only read: it can be encoded any number of times, for any number of destinations
+    //
+    using K = EcowittKey;
+
+    ostringstream event;
+    const vector<string>& key = sensor.key_;
+
+    // Hub attributes (head)
+    event << "PASSKEY=" << hub.id_;
+    event << "&stationtype=" << hub.model_ << "_V" << hub.status_.version << ".0.0";
+    double offset;
+    time_t timestamp = hub.status_.timestamp;
+    if (deskew && hub.clock_.Offset(offset)) timestamp += lround(offset);
+
+    event << "&dateutc=" << Convert::epoch_to_dateutc(timestamp);
+
+    // Sensor attributes
+    event << key[K::BATT] << sensor.obs_.battery;
+
+    if (sensor.model_ == Sensor::Model::AIR || sensor.model_ == Sensor::Model::TEMPEST) {
+      // Temperature, humidity and pressure
+      event << key[K::TEMPF] << Convert::C_to_F(sensor.obs_.temperature);
+      event << key[K::HUMIDITY] << sensor.obs_.humidity;
+      // Sea-level pressure and the other derived values only once they've been computed from an observation
+      if (sensor.derived_.Valid()) event << key[K::BAROMRELIN] << Convert::hPa_to_inHg(sensor.derived_.sea_level);
+      else event << key[K::BAROMRELIN] << "0";
+      event << key[K::BAROMABSIN] << Convert::hPa_to_inHg(sensor.obs_.pressure);
+
+      // Pressure trends, once there's enough history
+      if (sensor.pressure_short_.Valid()) event << key[K::BAROMTREND_SHORT] << Convert::hPa_to_inHg(sensor.pressure_short_.Change());
+      if (sensor.pressure_long_.Valid()) event << key[K::BAROMTREND_LONG] << Convert::hPa_to_inHg(sensor.pressure_long_.Change());
+      if (sensor.pressure_long_.Valid()) event << key[K::BAROMTENDENCY] << EcowittTendency(sensor.pressure_long_.GetTendency());
+
+      // Derived
+      if (sensor.derived_.Valid()) {
+        event << key[K::DEWPTF] << Convert::C_to_F(sensor.derived_.dew_point);
+        event << key[K::FEELSLIKEF] << Convert::C_to_F(sensor.derived_.feels_like);
+        event << key[K::HEATINDEXF] << Convert::C_to_F(sensor.derived_.heat_index);
+        event << key[K::WINDCHILLF] << Convert::C_to_F(sensor.derived_.wind_chill);
+        event << key[K::WETBULBF] << Convert::C_to_F(sensor.derived_.wet_bulb);
+      }
+
+      // Lightning: a strike after the last observation isn't counted by it yet
+      int lightning_count = sensor.obs_.lightning_count + ((sensor.lightning_.timestamp > sensor.obs_.timestamp)? 1: 0);
+      event << key[K::LIGHTNING] << sensor.lightning_.distance;
+      event << key[K::LIGHTNING_TIME] << sensor.lightning_.timestamp;
+      event << key[K::LIGHTNING_ENERGY] << sensor.lightning_.energy;
+      event << key[K::LIGHTNING_NUM] << lightning_count;
+    }
+
+    if (sensor.model_ == Sensor::Model::SKY || sensor.model_ == Sensor::Model::TEMPEST) {
+      // Solar
+      event << key[K::UV] << sensor.obs_.uv;
+      event << key[K::SOLARRADIATION] << sensor.obs_.solar_radiation;
+
+      // Precipitation
+      event << key[K::RAINRATEIN] << Convert::mm_to_in(sensor.obs_stats_.precip_rate);
+      event << key[K::EVENTRAININ] << Convert::mm_to_in(sensor.obs_stats_.precip_event);
+      event << key[K::HOURLYRAININ] << Convert::mm_to_in(sensor.obs_stats_.precip_hourly);
+      event << key[K::DAILYRAININ] << Convert::mm_to_in(sensor.obs_stats_.precip_daily);
+      event << key[K::WEEKLYRAININ] << Convert::mm_to_in(sensor.obs_stats_.precip_weekly);
+      event << key[K::MONTHLYRAININ] << Convert::mm_to_in(sensor.obs_stats_.precip_monthly);
+      event << key[K::YEARLYRAININ] << Convert::mm_to_in(sensor.obs_stats_.precip_yearly);
+      event << key[K::TOTALRAININ] << Convert::mm_to_in(sensor.obs_stats_.precip_total);
+
+      // Wind
+      event << key[K::WINDDIR] << sensor.obs_stats_.wind_direction;
+      event << key[K::WINDDIR_AVG10M] << sensor.obs_stats_.wind_direction_avg10m;
+      event << key[K::WINDSPEEDMPH] << Convert::km_to_mi(Convert::ms_to_kmh(sensor.obs_stats_.wind_speed));
+      event << key[K::WINDSPDMPH_AVG10M] << Convert::km_to_mi(Convert::ms_to_kmh(sensor.obs_stats_.wind_speed_avg10m));
+      event << key[K::WINDGUSTMPH] << Convert::km_to_mi(Convert::ms_to_kmh(sensor.obs_stats_.wind_gust));
+      event << key[K::MAXDAILYGUST] << Convert::km_to_mi(Convert::ms_to_kmh(sensor.obs_stats_.wind_gust_daily));
+
+      // Rollups computed over missing observations
+      if (sensor.obs_stats_.incomplete) event << key[K::INCOMPLETE] << EcowittIncomplete(sensor.obs_stats_.incomplete);
+    }
+
+    // Values that failed the quality control
+    if (sensor.qc_.Flagged()) event << key[K::FLAGGED] << EcowittFlagged(sensor.qc_.Flagged());
+
+    // Hub attributes (tail)
+    event << "&freq=RSSI" << hub.status_.rssi;
+    event << "&model=" << hub.model_;
+
+    data = event.str();
+  }
+
+  enum EcowittKey {
+    BATT,
+    TEMPF,
+    HUMIDITY,
+    BAROMRELIN,
+    BAROMABSIN,
+    BAROMTREND_SHORT,
+    BAROMTREND_LONG,
+    BAROMTENDENCY,
+    DEWPTF,
+    FEELSLIKEF,
+    HEATINDEXF,
+    WINDCHILLF,
+    WETBULBF,
+    LIGHTNING,
+    LIGHTNING_TIME,
+    LIGHTNING_ENERGY,
+    LIGHTNING_NUM,
+    UV,
+    SOLARRADIATION,
+    RAINRATEIN,
+    EVENTRAININ,
+    HOURLYRAININ,
+    DAILYRAININ,
+    WEEKLYRAININ,
+    MONTHLYRAININ,
+    YEARLYRAININ,
+    TOTALRAININ,
+    WINDDIR,
+    WINDDIR_AVG10M,
+    WINDSPEEDMPH,
+    WINDSPDMPH_AVG10M,
+    WINDGUSTMPH,
+    MAXDAILYGUST,
+    INCOMPLETE,
+    FLAGGED,
+    KEYS
+  };
+
+  static void EcowittKeys(Sensor& sensor, int channel) {
+    //
+    // Build the "&<field>_wf<channel>=" keys of a sensor once, when its channel is assigned
+    //
+    static const char* const name[EcowittKey::KEYS] = {
+      "batt", "tempf", "humidity", "baromrelin", "baromabsin", nullptr, nullptr, "baromtendency", "dewptf", "feelslikef",
+      "heatindexf", "windchillf", "wetbulbf", "lightning", "lightning_time", "lightning_energy", "lightning_num", "uv",
+      "solarradiation", "rainratein", "eventrainin", "hourlyrainin", "dailyrainin", "weeklyrainin", "monthlyrainin",
+      "yearlyrainin", "totalrainin", "winddir", "winddir_avg10m", "windspeedmph", "windspdmph_avg10m", "windgustmph",
+      "maxdailygust", "incomplete", "flagged"
+    };
+
+    string ch = "_wf" + to_string(channel) + "=";
+
+    sensor.channel_ = channel;
+    sensor.key_.resize(EcowittKey::KEYS);
+
+    for (int key = 0; key < EcowittKey::KEYS; key++) {
+      if (name[key]) sensor.key_[key] = string("&") + name[key] + ch;
+    }
+
+    // Trend keys carry their window: baromtrend3hin
+    sensor.key_[EcowittKey::BAROMTREND_SHORT] = "&baromtrend" + WindowName(sensor.pressure_short_.Window()) + "in" + ch;
+    sensor.key_[EcowittKey::BAROMTREND_LONG] = "&baromtrend" + WindowName(sensor.pressure_long_.Window()) + "in" + ch;
+  }
+
+  double DropRate(void) const {
+    //
+    // Drops per minute: the current window counts as soon as it sees a drop so the gauge raises immediately, its drops
+    // over the time elapsed (at least 10 seconds, not to blow a few early drops up to a rate)
+    //
+    double elapsed = difftime(time(nullptr), socket_stats_.window);
+
+    if (socket_stats_.dropped != socket_stats_.mark) return (max(socket_stats_.rate, (socket_stats_.dropped - socket_stats_.mark) * 60.0 / max(elapsed, 10.0)));
+    if (elapsed >= 120) return (0);
+    return (socket_stats_.rate);
+  }
+
+  void FleetUpdate(const Sensor& sensor) {
+    //
+    // Feed a sensor's latest observation to the fleet columns
+    //
+    if (sensor.fleet_slot_ == Fleet::npos || !sensor.obs_.timestamp) return;
+
+    bool air = (sensor.model_ == Sensor::Model::AIR || sensor.model_ == Sensor::Model::TEMPEST);
+    bool sky = (sensor.model_ == Sensor::Model::SKY || sensor.model_ == Sensor::Model::TEMPEST);
+
+    // Flagged values are left out (as not measured)
+    uint32_t flagged = sensor.qc_.Flagged();
+
+    fleet_.Update(sensor.fleet_slot_, sensor.obs_.timestamp, air && Qc::Good(flagged, Qc::Quantity::TEMPERATURE), sensor.obs_.temperature,
+                  sky && Qc::Good(flagged, Qc::Quantity::WIND_GUST), sensor.obs_.wind_gust, sky && Qc::Good(flagged, Qc::Quantity::RAIN_RATE), sensor.obs_stats_.precip_rate);
+  }
+
+  inline const Sensor* FleetSensor(size_t slot) const { return (&hub_[fleet_sensor_[slot].first].sensor_[fleet_sensor_[slot].second]); }
+
+  static void QuantilesLine(ostream& out, Quantiles::Metric metric, const function<const Kll*(Quantiles::Tier)>& current, const function<const Kll*(Quantiles::Tier)>& previous) {
+    out << "     " << Quantiles::MetricName(metric) << ":" << endl << "          now: ";
+    for (int tier = 0; tier < Quantiles::Tier::TIERS; tier++) out << (tier? ", ": "") << Quantiles::TierName((Quantiles::Tier)tier) << " " << Quantiles::Text(*current((Quantiles::Tier)tier));
+    out << endl;
+
+    // The periods before the ones in progress, once there are any
+    bool any = false;
+    for (int tier = 0; previous && tier < Quantiles::Tier::TIERS && !any; tier++) any = previous((Quantiles::Tier)tier)->Count();
+    if (!any) return;
+
+    out << "          last: ";
+    for (int tier = 0; tier < Quantiles::Tier::TIERS; tier++) out << (tier? ", ": "") << Quantiles::TierName((Quantiles::Tier)tier) << " " << Quantiles::Text(*previous((Quantiles::Tier)tier));
+    out << endl;
+  }
+
+  static void MetricsRssi(ostream& out, const string& name, const string& labels, const Kll& rssi) {
+    if (!rssi.Count()) return;
+
+    //
+    // A Prometheus summary: quantiles, sum and count of the signal samples
+    //
+    for (double q: {0.05, 0.5, 0.95}) out << name << "{" << labels << ",quantile=\"" << q << "\"} " << rssi.Quantile(q) << endl;
+    out << name << "_sum{" << labels << "} " << rssi.Sum() << endl;
+    out << name << "_count{" << labels << "} " << rssi.Count() << endl;
+  }
+
+  static string ClockText(const Clock& clock) {
+    //
+    // Offset and latency histogram (arrival minus device timestamp)
+    //
+    ostringstream text{""};
+    double offset;
+
+    if (clock.Offset(offset)) text << "offset " << showpos << offset << noshowpos << "s (relay minus hub)";
+    else text << "offset n/a";
+
+    text << ", latency";
+    for (int bucket = 0; bucket < Clock::Bucket::BUCKETS; bucket++) text << (bucket? ", ": " ") << Clock::BucketName((Clock::Bucket)bucket) << " " << clock.Count((Clock::Bucket)bucket);
+
+    return (text.str());
+  }
+
+  static string BatterySlopeText(const Health& health) {
+    double slope;
+    if (!health.BatterySlope(slope)) return ("trend n/a");
+
+    ostringstream text{""};
+    text << showpos << slope << noshowpos << " V/day";
+
+    return (text.str());
+  }
+
+  static string ErrorRateText(const Health& health) {
+    double rate;
+    if (!health.ErrorRate(rate, time(nullptr))) return ("n/a");
+
+    ostringstream text{""};
+    text << rate << "/h";
+
+    return (text.str());
+  }
+
+  static string WindowName(int seconds) {
+    //
+    // "3h", or "90m" if not whole hours
+    //
+    return ((seconds % 3600)? (to_string(seconds / 60) + "m"): (to_string(seconds / 3600) + "h"));
+  }
+
+  static string TrendText(const Trend& trend) {
+    ostringstream text{""};
+
+    if (!trend.Valid()) text << "n/a/" << WindowName(trend.Window());
+    else text << showpos << trend.Change() << noshowpos << " hPa/" << WindowName(trend.Window());
+
+    return (text.str());
+  }
+
+  static string EcowittTendency(Trend::Tendency tendency) {
+    //
+    // Tendency name, form encoded
+    //
+    string name = Trend::TendencyName(tendency);
+    replace(name.begin(), name.end(), ' ', '+');
+
+    return (name);
+  }
+
+  static string EcowittIncomplete(uint mask) {
+    //
+    // Return the comma separated list of Ecowitt fields affected by the Sensor::Rollup mask
+    //
+    static const pair<uint, const char*> field[] = {
+      {Sensor::Rollup::EVENT,   "eventrainin"},
+      {Sensor::Rollup::HOURLY,  "hourlyrainin"},
+      {Sensor::Rollup::DAILY,   "dailyrainin"},
+      {Sensor::Rollup::WEEKLY,  "weeklyrainin"},
+      {Sensor::Rollup::MONTHLY, "monthlyrainin"},
+      {Sensor::Rollup::YEARLY,  "yearlyrainin"},
+      {Sensor::Rollup::TOTAL,   "totalrainin"},
+      {Sensor::Rollup::AVG10M,  "winddir_avg10m,windspdmph_avg10m"},
+      {Sensor::Rollup::DAILY,   "maxdailygust"}
+    };
+
+    string list;
+
+    for (const auto& f: field) {
+      if (!(mask & f.first)) continue;
+      if (!list.empty()) list += ',';
+      list += f.second;
+    }
+
+    return (list);
+  }
+
+  static string EcowittFlagged(uint32_t mask) {
+    //
+    // Return the comma separated list of Ecowitt fields carrying the flagged Qc::Quantity in mask
+    //
+    static const pair<Qc::Quantity, const char*> field[] = {
+      {Qc::Quantity::TEMPERATURE,     "tempf"},
+      {Qc::Quantity::HUMIDITY,        "humidity"},
+      {Qc::Quantity::PRESSURE,        "baromrelin,baromabsin"},
+      {Qc::Quantity::UV,              "uv"},
+      {Qc::Quantity::SOLAR_RADIATION, "solarradiation"},
+      {Qc::Quantity::RAIN_RATE,       "rainratein"},
+      {Qc::Quantity::WIND_SPEED,      "windspeedmph"},
+      {Qc::Quantity::WIND_GUST,       "windgustmph"},
+      {Qc::Quantity::WIND_DIRECTION,  "winddir"},
+      {Qc::Quantity::LIGHTNING,       "lightning"}
+    };
+
+    string list;
+
+    for (const auto& f: field) {
+      if (Qc::Good(mask, f.first) || list.find(f.second) != string::npos) continue;
+      if (!list.empty()) list += ',';
+      list += f.second;
+    }
+
+    return (list);
+  }
+
+  void Channel(Log& log, size_t hub, size_t sensor) {
+    //
+    // Assign a new sensor its channel: the persistent one, or the first free one in its hub
+    //
+    vector<Sensor>& list = hub_[hub].sensor_;
+    vector<int> taken;
+    for (size_t idx = 0; idx < list.size(); idx++) if (idx != sensor) taken.push_back(list[idx].channel_);
+
+    string error;
+    int channel = channels_.Assign(list[sensor].id_, taken, error);
+    if (!error.empty()) TLOG_ERROR(log) << "Error saving the channel of " << list[sensor].id_ << ": " << error << "." << endl;
+
+    if (!channel) {
+      channel = sensor + 1;
+      TLOG_WARNING(log) << "No free channel for " << list[sensor].id_ << ", using " << channel << "." << endl;
+    }
+    else if (find(taken.begin(), taken.end(), channel) != taken.end()) {
+      TLOG_WARNING(log) << "Sensor " << list[sensor].id_ << " shares channel " << channel << " with another sensor of hub " << hub_[hub].id_ << "." << endl;
+    }
+
+    EcowittKeys(list[sensor], channel);
+  }
+
+  size_t GetHubIndex(string_view hub_id) {
     size_t idx;
 
     assert(!hub_id.empty());
 
     for (idx = 0; idx < hub_.size(); idx++) {
-      if (hub_[idx].id_ == hub_id) return (hub_[idx]);
+      if (hub_[idx].id_ == hub_id) return (idx);
     }
 
-    hub_.emplace_back(hub_id, queue_max_);
-    return (hub_[idx]);
+    auto station = stations_.find(string(hub_id));
+    hub_.emplace_back(string(hub_id), queue_max_, (station != stations_.end())? station->second: station_);
+    return (idx);
   }
 
   const time_t start_time_;
   const size_t queue_max_;
+  const Station station_;
+  const map<string, Station> stations_;                         // hubs with a station of their own
+  const shared_ptr<const Rules> rules_;                         // alert rules (nullptr: none)
+  bool deskew_{false};                                          // correct dateutc by the hub clock offset
+  Channels channels_;                                           // serial number to Ecowitt channel
 
   vector<Hub> hub_;
+  Fleet fleet_;
+  vector<pair<size_t, size_t>> fleet_sensor_;                   // (hub, sensor) of each fleet slot
+
+  vector<pair<size_t, size_t>> added_;                          // sensors created since the last TakeAdded()
+  vector<pair<size_t, size_t>> urgent_;                         // sensors to relay right away
+  vector<string> alert_;                                        // alert messages to send
 
   struct {
-    uint debug;
-    uint unknown;
+    uint type[UdpEvent::UDP_EVENTS];                            // by message type
     uint invalid;
   }
   event_stats_;
+
+  // Socket Statistics
+  struct {
+    uint32_t dropped;                                           // datagrams dropped by the kernel (receive queue overflow)
+    uint32_t mark;                                              // dropped count at the beginning of the rate window
+    time_t window;                                              // beginning of the rate window
+    double rate;                                                // drops per minute over the last window
+    int buffer;                                                 // effective receive buffer size
+  }
+  socket_stats_;
 };
 
 } // namespace tempest
@@ -0,0 +1,197 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: request body compression (gzip with ZLIB=yes, zstd with ZSTD=yes)
+//
+
+#ifndef TEMPEST_COMPRESS
+#define TEMPEST_COMPRESS
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// A compressor keeps its library contexts for its whole life and only resets them between bodies,
+// so it doesn't allocate once warmed up: use one per thread
+//
+
+class Compressor {
+public:
+
+  enum Encoding {
+    IDENTITY,
+    GZIP,
+    ZSTD,
+    ENCODINGS
+  };
+
+  Compressor() {
+    #ifdef TEMPEST_ZLIB
+    memset(&zlib_, 0, sizeof(zlib_));
+    // 15 + 16: maximum window with a gzip header and trailer
+    zlib_ok_ = (deflateInit2(&zlib_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    #endif
+
+    #ifdef TEMPEST_ZSTD
+    zstd_ = ZSTD_createCCtx();
+    if (zstd_) ZSTD_CCtx_setParameter(zstd_, ZSTD_c_compressionLevel, 3);
+    #endif
+  }
+
+  ~Compressor() {
+    #ifdef TEMPEST_ZLIB
+    if (zlib_ok_) deflateEnd(&zlib_);
+    #endif
+
+    #ifdef TEMPEST_ZSTD
+    if (zstd_) ZSTD_freeCCtx(zstd_);
+    #endif
+  }
+
+  Compressor(const Compressor&) = delete;
+  Compressor& operator=(const Compressor&) = delete;
+
+  static bool Supported(Encoding encoding) {
+    //
+    // Return whether the encoding was built in
+    //
+    switch (encoding) {
+    case Encoding::IDENTITY: return (true);
+    #ifdef TEMPEST_ZLIB
+    case Encoding::GZIP:     return (true);
+    #endif
+    #ifdef TEMPEST_ZSTD
+    case Encoding::ZSTD:     return (true);
+    #endif
+    default:                 return (false);
+    }
+  }
+
+  static const char* Name(Encoding encoding) {
+    //
+    // Content-Encoding token
+    //
+    switch (encoding) {
+    case Encoding::GZIP: return ("gzip");
+    case Encoding::ZSTD: return ("zstd");
+    default:             return ("identity");
+    }
+  }
+
+  static Encoding Parse(const string& name) {
+    //
+    // Return the encoding of a Content-Encoding token or ENCODINGS if unknown
+    //
+    for (int idx = 0; idx < Encoding::ENCODINGS; idx++) {
+      if (name == Name((Encoding)idx)) return ((Encoding)idx);
+    }
+
+    return (Encoding::ENCODINGS);
+  }
+
+  static Encoding Best(const string& accept_encoding, Encoding preferred) {
+    //
+    // Return the best supported encoding, no better than preferred, listed in an Accept-Encoding header value
+    // (RFC 7694: sent with a 415 response to tell which request encodings the server accepts)
+    //
+    Encoding best = Encoding::IDENTITY;
+    stringstream items{accept_encoding};
+    string item;
+
+    while (getline(items, item, ',')) {
+      item = item.substr(0, item.find(';'));
+      item.erase(0, item.find_first_not_of(" \t"));
+      item.erase(item.find_last_not_of(" \t") + 1);
+
+      Encoding encoding = Parse(item);
+      if (encoding != Encoding::ENCODINGS && encoding <= preferred && encoding > best && Supported(encoding)) best = encoding;
+    }
+
+    return (best);
+  }
+
+  bool Compress(Encoding encoding, const string& in, string& out) {
+    //
+    // Compress in into out, reusing out's capacity
+    // Return false if the encoding is not available, leaving out empty
+    //
+    out.clear();
+
+    switch (encoding) {
+    #ifdef TEMPEST_ZLIB
+    case Encoding::GZIP: {
+      if (!zlib_ok_ || deflateReset(&zlib_) != Z_OK) return (false);
+
+      out.resize(deflateBound(&zlib_, in.size()));
+
+      zlib_.next_in = (Bytef*)in.data();
+      zlib_.avail_in = in.size();
+      zlib_.next_out = (Bytef*)out.data();
+      zlib_.avail_out = out.size();
+
+      // The output buffer is large enough for a single pass
+      if (deflate(&zlib_, Z_FINISH) != Z_STREAM_END) {
+        out.clear();
+        return (false);
+      }
+
+      out.resize(zlib_.total_out);
+      return (true);
+    }
+    #endif
+
+    #ifdef TEMPEST_ZSTD
+    case Encoding::ZSTD: {
+      if (!zstd_) return (false);
+
+      out.resize(ZSTD_compressBound(in.size()));
+
+      size_t len = ZSTD_compress2(zstd_, out.data(), out.size(), in.data(), in.size());
+      if (ZSTD_isError(len)) {
+        out.clear();
+        return (false);
+      }
+
+      out.resize(len);
+      return (true);
+    }
+    #endif
+
+    default:
+      return (false);
+    }
+  }
+
+private:
+
+  #ifdef TEMPEST_ZLIB
+  z_stream zlib_;
+  bool zlib_ok_{false};
+  #endif
+
+  #ifdef TEMPEST_ZSTD
+  ZSTD_CCtx* zstd_{nullptr};
+  #endif
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_COMPRESS
@@ -0,0 +1,245 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: relay configuration file
+//
+
+#ifndef TEMPEST_CONFIG
+#define TEMPEST_CONFIG
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "check.hpp"
+#include "relay.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Configuration file (JSON), every section optional:
+//
+// {
+//   "listen": {"port": 50222, "rcvbuf": 1024, "ring": 256, "workers": 4},
+//   "station": {"elevation": 120, "trend_short": 60, "trend_long": 180},
+//   "stations": {
+//     "HB-00012345": {"elevation": 1650}
+//   },
+//   "destinations": [
+//     {"url": "http://hubitat.local:39501", "interval": 5},
+//     {"url": "https://example.com/weather", "interval": 1, "format": "json", "rate": 60, "burst": 5, "compress": "gzip"}
+//   ],
+//   "channels": "/etc/tempest/channels",
+//   "alerts": "/etc/tempest/alerts.json",
+//   "strike": ["udp://127.0.0.1:5001"],
+//   "stream": {"address": "127.0.0.1", "port": 8080, "queue": 64},
+//   "deskew": true
+// }
+//
+// Units and ranges are the ones of the command line options (trend windows in minutes); "stations" overrides the
+// station of single hubs, fields left out taking the "station" ones; "channels" is either a map file or a fixed
+// {"<serial>": <channel>} object; a destination takes --rate/--compress defaults, not the command line values
+// The file is read once, before the relay starts, into Relay::Options: command line options take precedence
+//
+
+class Config {
+public:
+
+  static bool Load(const string& path, Relay::Options& options, string& error) {
+    //
+    // Read and validate a configuration file into options: return false and the reason if it's not valid
+    //
+    ifstream file{path};
+    if (!file) {
+      error = strerror(errno);
+      return (false);
+    }
+
+    stringstream text;
+    text << file.rdbuf();
+
+    Json config = Json::parse(text.str(), error);
+    if (config == nullptr) return (false);
+
+    if (!Check::Keys(config, "configuration", {"listen", "station", "stations", "destinations", "channels", "alerts", "strike", "stream", "deskew"}, error)) return (false);
+
+    // Listener
+    const Json& listen = config["listen"];
+    int rcvbuf = 0;
+
+    if (!Check::Keys(listen, "listen", {"port", "rcvbuf", "ring", "workers"}, error) ||
+        !Check::Integer(listen["port"], "listen.port", 1, 65535, options.port, error) ||
+        !Check::Integer(listen["rcvbuf"], "listen.rcvbuf", 1, 65536, rcvbuf, error) ||
+        !Check::Integer(listen["ring"], "listen.ring", 16, 65536, options.ring_depth, error) ||
+        !Check::Integer(listen["workers"], "listen.workers", 1, 256, options.workers, error)) return (false);
+
+    if (rcvbuf) options.receive_buffer = rcvbuf * 1024;
+
+    // Stations
+    if (!GetStation(config["station"], "station", options.elevation, options.trend_short, options.trend_long, error)) return (false);
+
+    const Json& stations = config["stations"];
+    if (!stations.is_null() && !stations.is_object()) {
+      error = "stations: expected an object";
+      return (false);
+    }
+
+    for (const auto& [hub, station]: stations.object_items()) {
+      double elevation = options.elevation;
+      int trend_short = options.trend_short;
+      int trend_long = options.trend_long;
+
+      if (!GetStation(station, "stations." + hub, elevation, trend_short, trend_long, error)) return (false);
+      options.stations[hub] = Station{elevation, trend_short, trend_long};
+    }
+
+    // Destinations
+    const Json& destinations = config["destinations"];
+    if (!destinations.is_null() && !destinations.is_array()) {
+      error = "destinations: expected a list";
+      return (false);
+    }
+
+    for (size_t idx = 0; idx < destinations.array_items().size(); idx++) {
+      const Json& item = destinations[idx];
+      string where = "destinations[" + to_string(idx) + "]";
+      Relay::Target target;
+      int rate = 0;
+      string format = Tempest::FormatName(target.format), compress;
+
+      if (!Check::Keys(item, where, {"url", "interval", "format", "rate", "burst", "compress"}, error) ||
+          !Check::Text(item["url"], where + ".url", target.url, error) ||
+          !Check::Integer(item["interval"], where + ".interval", 1, 30, target.interval, error) ||
+          !Check::Text(item["format"], where + ".format", format, error) ||
+          !Check::Integer(item["rate"], where + ".rate", 1, 6000, rate, error) ||
+          !Check::Integer(item["burst"], where + ".burst", 1, 1000, target.rate_burst, error) ||
+          !Check::Text(item["compress"], where + ".compress", compress, error)) return (false);
+
+      if (target.url.empty()) {
+        error = where + ".url: missing";
+        return (false);
+      }
+
+      if ((target.format = Tempest::ParseFormat(format)) == Tempest::Format::FORMATS) {
+        error = where + ".format: unknown format '" + format + "'";
+        return (false);
+      }
+
+      if (!compress.empty()) {
+        target.compress = Compressor::Parse(compress);
+        if (target.compress == Compressor::Encoding::IDENTITY || !Compressor::Supported(target.compress)) {
+          error = where + ".compress: unsupported encoding '" + compress + "'";
+          return (false);
+        }
+      }
+
+      target.rate_limit = rate;
+      options.destinations.push_back(target);
+    }
+
+    // Sensor channels: a map file or a fixed map
+    const Json& channels = config["channels"];
+
+    if (channels.is_object()) {
+      set<int> used;
+
+      for (const auto& [serial, channel]: channels.object_items()) {
+        int ch = 0;
+        if (!Check::Integer(channel, "channels." + serial, 1, Channels::channel_max_, ch, error)) return (false);
+        if (!used.insert(ch).second) {
+          error = "channels." + serial + ": duplicate channel " + to_string(ch);
+          return (false);
+        }
+        options.channels[serial] = ch;
+      }
+    }
+    else if (!Check::Text(channels, "channels", options.channels_file, error)) return (false);
+
+    // Alerts, lightning fast path and live stream
+    if (!Check::Text(config["alerts"], "alerts", options.alerts_file, error)) return (false);
+
+    const Json& strike = config["strike"];
+    if (!strike.is_null() && !strike.is_array()) {
+      error = "strike: expected a list";
+      return (false);
+    }
+
+    for (const Json& sink: strike.array_items()) {
+      const string& url = sink.string_value();
+
+      if (!Lane::Supported(url)) {
+        error = "strike: invalid sink '" + url + "'";
+        return (false);
+      }
+      options.strike_sinks.push_back(url);
+    }
+
+    const Json& stream = config["stream"];
+
+    if (!Check::Keys(stream, "stream", {"address", "port", "queue"}, error) ||
+        !Check::Text(stream["address"], "stream.address", options.stream_address, error) ||
+        !Check::Integer(stream["port"], "stream.port", 1, 65535, options.stream_port, error) ||
+        !Check::Integer(stream["queue"], "stream.queue", 2, 65536, options.stream_queue, error)) return (false);
+
+    struct in_addr address;
+    if (inet_pton(AF_INET, options.stream_address.c_str(), &address) != 1) {
+      error = "stream.address: invalid IPv4 address '" + options.stream_address + "'";
+      return (false);
+    }
+
+    const Json& deskew = config["deskew"];
+    if (!deskew.is_null()) {
+      if (!deskew.is_bool()) {
+        error = "deskew: expected true or false";
+        return (false);
+      }
+      options.deskew = deskew.bool_value();
+    }
+
+    return (true);
+  }
+
+private:
+
+  static bool GetStation(const Json& json, const string& where, double& elevation, int& trend_short, int& trend_long, string& error) {
+    //
+    // Elevation in meters, trend windows in minutes (returned in seconds)
+    //
+    int meters = (int)elevation, short_min = trend_short / 60, long_min = trend_long / 60;
+
+    if (!Check::Keys(json, where, {"elevation", "trend_short", "trend_long"}, error) ||
+        !Check::Integer(json["elevation"], where + ".elevation", -500, 9000, meters, error) ||
+        !Check::Integer(json["trend_short"], where + ".trend_short", 10, 1440, short_min, error) ||
+        !Check::Integer(json["trend_long"], where + ".trend_long", 10, 1440, long_min, error)) return (false);
+
+    if (short_min >= long_min) {
+      error = where + ": trend_short must be shorter than trend_long";
+      return (false);
+    }
+
+    if (!json["elevation"].is_null()) elevation = meters;
+    trend_short = short_min * 60;
+    trend_long = long_min * 60;
+
+    return (true);
+  }
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_CONFIG
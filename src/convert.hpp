@@ -106,8 +106,9 @@ public:
   inline static string epoch_to_dateutc(time_t epoch) {
 
     char buf[128];
-    tm *ts = gmtime(&epoch);
-    strftime(buf, sizeof(buf), "%Y-%m-%d+%H:%M:%S", ts);
+    tm ts;
+    gmtime_r(&epoch, &ts);
+    strftime(buf, sizeof(buf), "%Y-%m-%d+%H:%M:%S", &ts);
 
     string date = buf;
 
@@ -0,0 +1,228 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: libcurl HTTP POST backend (make HTTP=curl)
+//
+
+#ifndef TEMPEST_CURL_CLIENT
+#define TEMPEST_CURL_CLIENT
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "http.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+#ifdef TEMPEST_CURL
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Same interface as HttpClient, for URLs the built-in client can't handle (i.e. https)
+// Requests are performed one at a time, blocking, by Run()
+//
+
+class CurlClient {
+public:
+
+  CurlClient(const string& url, const string& content_type, const HttpOptions& options) {
+    static once_flag global;
+    static CURLcode global_res;
+
+    // Initialize CURL library
+    call_once(global, []{ global_res = curl_global_init(CURL_GLOBAL_ALL); });
+    if (global_res != CURLE_OK) {
+      error_ = string("curl_global_init(): ") + curl_easy_strerror(global_res);
+      return;
+    }
+
+    // Add slist strings, one list per body encoding
+    for (int idx = 0; idx < Compressor::Encoding::ENCODINGS; idx++) {
+      slist_[idx] = curl_slist_append(nullptr, ("Content-Type: " + content_type).c_str());
+      if (slist_[idx] && idx != Compressor::Encoding::IDENTITY) {
+        slist_[idx] = curl_slist_append(slist_[idx], (string("Content-Encoding: ") + Compressor::Name((Compressor::Encoding)idx)).c_str());
+      }
+      if (!slist_[idx]) {
+        error_ = "curl_slist_append() returned a NULL pointer";
+        return;
+      }
+    }
+
+    // Get a curl handle
+    curl_ = curl_easy_init();
+    if (!curl_) {
+      error_ = "curl_easy_init() returned a NULL pointer";
+      return;
+    }
+
+    // Verbose
+    // curl_easy_setopt(curl_, CURLOPT_VERBOSE, 1L);
+
+    // Set the URL that is about to receive our POST
+    curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+
+    // Enable location redirects
+    curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1);
+    curl_easy_setopt(curl_, CURLOPT_MAXREDIRS, 1);
+    curl_easy_setopt(curl_, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+
+    // Drain the response body instead of writing it to stdout
+    curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, Discard);
+
+    // Look for Accept-Encoding in the response headers
+    curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, Header);
+    curl_easy_setopt(curl_, CURLOPT_HEADERDATA, &accept_encoding_);
+
+    // Set timeout
+    curl_easy_setopt(curl_, CURLOPT_TIMEOUT, (long)options.timeout);
+    curl_easy_setopt(curl_, CURLOPT_CONNECTTIMEOUT, (long)options.connect_timeout);
+  }
+
+  ~CurlClient() {
+    // Cleanup
+    if (curl_) curl_easy_cleanup(curl_);
+
+    // Free the lists again
+    for (struct curl_slist* slist: slist_) {
+      if (slist) curl_slist_free_all(slist);
+    }
+  }
+
+  CurlClient(const CurlClient&) = delete;
+  CurlClient& operator=(const CurlClient&) = delete;
+
+  inline const string& Error(void) const { return (error_); }
+  inline size_t Pending(void) const { return (waiting_.size()); }
+
+  void Post(string body, size_t tag, Compressor::Encoding encoding = Compressor::Encoding::IDENTITY) {
+    waiting_.push_back({tag, encoding, move(body), Now()});
+  }
+
+  static void Run(const vector<CurlClient*>& client, int, const function<void(size_t, const HttpResult&)>& done) {
+    //
+    // Perform one queued request per client
+    //
+    for (size_t idx = 0; idx < client.size(); idx++) {
+      if (!client[idx]->waiting_.empty()) done(idx, client[idx]->Perform());
+    }
+  }
+
+  string Stats(void) const {
+    ostringstream stats{""};
+
+    uint64_t responses = stats_.responses.load(memory_order_relaxed);
+    double latency = responses? (stats_.latency_us.load(memory_order_relaxed) / 1000.0 / responses): 0;
+
+    stats << "     HTTP (curl): " << stats_.requests.load(memory_order_relaxed) << " request(s), " << responses << " response(s)";
+    stats << " (average latency: " << latency << "ms)" << endl;
+
+    return (stats.str());
+  }
+
+private:
+
+  struct Request {
+    size_t tag;
+    Compressor::Encoding encoding;
+    string body;
+    double start;
+  };
+
+  static double Now(void) {
+    return (chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  static size_t Discard(char*, size_t size, size_t nmemb, void*) { return (size * nmemb); }
+
+  static size_t Header(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    string line{ptr, size * nmemb};
+    transform(line.begin(), line.end(), line.begin(), ::tolower);
+
+    if (!line.compare(0, 16, "accept-encoding:")) {
+      string& value = *(string*)userdata;
+      value = line.substr(16);
+      value.erase(0, value.find_first_not_of(" \t"));
+      value.erase(value.find_last_not_of(" \t\r\n") + 1);
+    }
+
+    return (size * nmemb);
+  }
+
+  HttpResult Perform(void) {
+    Request request = move(waiting_.front());
+    waiting_.pop_front();
+
+    if (!error_.empty()) return (HttpResult{request.tag, 0, error_, 0, request.encoding, {}});
+
+    stats_.requests.fetch_add(1, memory_order_relaxed);
+
+    curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, slist_[request.encoding]);
+    accept_encoding_.clear();
+
+    // Specify the POST data and its lenght
+    curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, request.body.c_str());
+    curl_easy_setopt(curl_, CURLOPT_POSTFIELDSIZE, request.body.length());
+
+    // Perform the request, res will get the return code
+    CURLcode res = curl_easy_perform(curl_);
+    double latency = Now() - request.start;
+
+    if (res != CURLE_OK) return (HttpResult{request.tag, 0, string("curl_easy_perform(): ") + curl_easy_strerror(res), latency, request.encoding, {}});
+
+    long code = 0;
+    curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &code);
+
+    stats_.responses.fetch_add(1, memory_order_relaxed);
+    stats_.latency_us.fetch_add((uint64_t)(latency * 1000000), memory_order_relaxed);
+
+    return (HttpResult{request.tag, (int)code, "", latency, request.encoding, accept_encoding_});
+  }
+
+  string error_;
+
+  struct curl_slist* slist_[Compressor::Encoding::ENCODINGS]{};
+  CURL* curl_{nullptr};
+  string accept_encoding_;                                      // of the last response
+
+  deque<Request> waiting_;
+
+  // Client Statistics (read by other threads)
+  struct {
+    atomic<uint64_t> requests{0};
+    atomic<uint64_t> responses{0};
+    atomic<uint64_t> latency_us{0};                             // sum, for the average
+  }
+  stats_;
+};
+
+} // namespace tempest
+
+#endif // TEMPEST_CURL
+
+namespace tempest {
+
+// The HTTP client in use
+#ifdef TEMPEST_CURL
+using HttpTransport = CurlClient;
+#else
+using HttpTransport = HttpClient;
+#endif
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_CURL_CLIENT
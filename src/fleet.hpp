@@ -0,0 +1,243 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: fleet wide aggregates over all the sensors
+//
+
+#ifndef TEMPEST_FLEET
+#define TEMPEST_FLEET
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// The latest values of every sensor are kept in columns (one contiguous array per field, one slot per sensor) next to
+// the aggregates built from them:
+// - Update() adjusts the aggregates by the difference a sensor update makes, in O(1)
+// - Recompute() rebuilds them from the columns in a single pass that the compiler can vectorize (it also clears the
+//   rounding a long sequence of differences accumulates, so it's run every so often and whenever the max gust sensor drops)
+// A sensor stops counting once its latest observation is older than stale seconds (Expire())
+//
+
+class Fleet {
+public:
+
+  explicit Fleet(int stale = 900): stale_{stale} {}
+
+  size_t Add(size_t hub) {
+    //
+    // Allocate the slot of a new sensor of hub
+    //
+    hub_.push_back((uint32_t)hub);
+    time_.push_back(0);
+    temperature_.push_back(0);
+    weight_.push_back(0);
+    gust_.push_back(-numeric_limits<double>::infinity());
+    rain_.push_back(0);
+
+    if (hub >= hub_sum_.size()) {
+      hub_sum_.resize(hub + 1, 0);
+      hub_count_.resize(hub + 1, 0);
+    }
+
+    return (hub_.size() - 1);
+  }
+
+  void Update(size_t slot, time_t time, bool temperature, double t, bool wind, double gust, bool rain, double rate) {
+    //
+    // Latest values of a sensor (flags: which ones it measures)
+    //
+    Remove(slot);
+
+    time_[slot] = time;
+    temperature_[slot] = temperature? t: 0;
+    weight_[slot] = temperature? 1: 0;
+    gust_[slot] = wind? gust: -numeric_limits<double>::infinity();
+    rain_[slot] = rain? rate: 0;
+
+    Insert(slot);
+
+    if (++updates_ % recompute_ == 0) Recompute();
+  }
+
+  void Expire(time_t now) {
+    //
+    // Take the sensors gone silent out of the aggregates
+    //
+    time_t limit = now - stale_;
+
+    for (size_t slot = 0; slot < time_.size(); slot++) {
+      if (!time_[slot] || time_[slot] >= limit) continue;
+
+      Remove(slot);
+      time_[slot] = 0;
+      temperature_[slot] = weight_[slot] = rain_[slot] = 0;
+      gust_[slot] = -numeric_limits<double>::infinity();
+    }
+  }
+
+  void Recompute(void) {
+    //
+    // Rebuild the aggregates from the columns
+    // Four independent accumulators per reduction so the loops vectorize without reassociation flags
+    //
+    size_t size = time_.size();
+
+    fill(hub_sum_.begin(), hub_sum_.end(), 0);
+    fill(hub_count_.begin(), hub_count_.end(), 0);
+
+    double gust[4] = {-numeric_limits<double>::infinity(), -numeric_limits<double>::infinity(), -numeric_limits<double>::infinity(), -numeric_limits<double>::infinity()};
+    double raining[4] = {0, 0, 0, 0};
+    double sum[4] = {0, 0, 0, 0}, count[4] = {0, 0, 0, 0};
+    size_t slot = 0;
+
+    for (; slot + 4 <= size; slot += 4) {
+      for (int lane = 0; lane < 4; lane++) {
+        double g = gust_[slot + lane];
+        gust[lane] = (g > gust[lane])? g: gust[lane];
+        raining[lane] += (rain_[slot + lane] > 0)? 1: 0;
+        sum[lane] += temperature_[slot + lane] * weight_[slot + lane];
+        count[lane] += weight_[slot + lane];
+      }
+    }
+    for (; slot < size; slot++) {
+      gust[0] = max(gust[0], gust_[slot]);
+      raining[0] += (rain_[slot] > 0)? 1: 0;
+      sum[0] += temperature_[slot] * weight_[slot];
+      count[0] += weight_[slot];
+    }
+
+    max_gust_ = max(max(gust[0], gust[1]), max(gust[2], gust[3]));
+    raining_ = (size_t)(raining[0] + raining[1] + raining[2] + raining[3]);
+    sum_ = sum[0] + sum[1] + sum[2] + sum[3];
+    count_ = count[0] + count[1] + count[2] + count[3];
+
+    // Per hub sums: a scatter, hubs are few
+    for (slot = 0; slot < size; slot++) {
+      hub_sum_[hub_[slot]] += temperature_[slot] * weight_[slot];
+      hub_count_[hub_[slot]] += weight_[slot];
+    }
+
+    max_slot_ = npos;
+    for (slot = 0; slot < size && max_gust_ > -numeric_limits<double>::infinity(); slot++) {
+      if (gust_[slot] == max_gust_) {
+        max_slot_ = slot;
+        break;
+      }
+    }
+
+    dirty_ = false;
+    recomputes_++;
+  }
+
+  inline size_t Sensors(void) const { return (time_.size()); }
+  inline size_t Raining(void) const { return (raining_); }
+  inline bool IsRaining(size_t slot) const { return (rain_[slot] > 0); }
+  inline uint64_t Recomputes(void) const { return (recomputes_); }
+
+  double MaxGust(size_t& slot) {
+    //
+    // Highest gust and its sensor slot (npos if no wind sensor is reporting)
+    //
+    if (dirty_) Recompute();
+
+    slot = max_slot_;
+    return ((max_slot_ == npos)? 0: max_gust_);
+  }
+
+  bool MeanTemperature(double& mean) const {
+    if (count_ < 0.5) return (false);
+
+    mean = sum_ / count_;
+    return (true);
+  }
+
+  bool HubTemperature(size_t hub, double& mean) const {
+    if (hub >= hub_count_.size() || hub_count_[hub] < 0.5) return (false);
+
+    mean = hub_sum_[hub] / hub_count_[hub];
+    return (true);
+  }
+
+  static const size_t npos = (size_t)-1;
+
+private:
+
+  static const uint64_t recompute_ = 4096;                      // updates between full passes
+
+  void Remove(size_t slot) {
+    //
+    // Take a slot's contribution out of the aggregates
+    //
+    if (!time_[slot]) return;
+
+    double w = weight_[slot];
+    hub_sum_[hub_[slot]] -= temperature_[slot] * w;
+    hub_count_[hub_[slot]] -= w;
+    sum_ -= temperature_[slot] * w;
+    count_ -= w;
+    if (rain_[slot] > 0) raining_--;
+
+    // The maximum can't be updated by difference: find it again when asked
+    if (slot == max_slot_) dirty_ = true;
+  }
+
+  void Insert(size_t slot) {
+    double w = weight_[slot];
+    hub_sum_[hub_[slot]] += temperature_[slot] * w;
+    hub_count_[hub_[slot]] += w;
+    sum_ += temperature_[slot] * w;
+    count_ += w;
+    if (rain_[slot] > 0) raining_++;
+
+    if (!dirty_ && gust_[slot] > -numeric_limits<double>::infinity() && (max_slot_ == npos || gust_[slot] >= max_gust_)) {
+      max_gust_ = gust_[slot];
+      max_slot_ = slot;
+    }
+  }
+
+  const int stale_;
+
+  // Columns, one slot per sensor
+  vector<uint32_t> hub_;
+  vector<time_t> time_;                                         // latest observation (0: not reporting)
+  vector<double> temperature_;                                  // °C
+  vector<double> weight_;                                       // 1 if temperature_ counts, 0 otherwise
+  vector<double> gust_;                                         // m/s (-inf: no wind)
+  vector<double> rain_;                                         // mm/h
+
+  // Aggregates
+  vector<double> hub_sum_;                                      // temperature sum and count by hub
+  vector<double> hub_count_;
+  double sum_{0};
+  double count_{0};
+  size_t raining_{0};
+  double max_gust_{-numeric_limits<double>::infinity()};
+  size_t max_slot_{npos};
+  bool dirty_{false};                                           // max_gust_ must be found again
+
+  uint64_t updates_{0};
+  uint64_t recomputes_{0};
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_FLEET
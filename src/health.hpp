@@ -0,0 +1,191 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: device and hub health analytics
+//
+
+#ifndef TEMPEST_HEALTH
+#define TEMPEST_HEALTH
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "sketch.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Time series of at most one sample per step seconds, the oldest dropped beyond capacity: a sample is the mean of the
+// values added during its step (MEAN) or the latest of them (LAST, for counters)
+//
+
+class Series {
+public:
+
+  enum Mode {
+    MEAN,
+    LAST
+  };
+
+  Series(size_t capacity, int step, Mode mode = Mode::MEAN): capacity_{capacity}, step_{step}, mode_{mode} {}
+
+  void Add(time_t time, double value) {
+    time_t bucket = time - time % step_;
+
+    if (!sample_.empty() && bucket <= sample_.back().time) {
+      // Late values are left out
+      if (bucket < sample_.back().time) return;
+
+      Sample& sample = sample_.back();
+      sample.value = (mode_ == Mode::MEAN)? (float)((sample.value * sample.count + value) / (sample.count + 1)): (float)value;
+      sample.count++;
+      return;
+    }
+
+    if (sample_.size() == capacity_) sample_.pop_front();
+    sample_.push_back({bucket, (float)value, 1});
+  }
+
+  inline size_t Size(void) const { return (sample_.size()); }
+
+  bool Slope(double& slope, int span_min) const {
+    //
+    // Least squares slope, per day: false if the samples span less than span_min seconds
+    //
+    if (sample_.size() < 2 || (sample_.back().time - sample_.front().time) < span_min) return (false);
+
+    double n = sample_.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+    time_t origin = sample_.front().time;
+
+    for (const Sample& sample: sample_) {
+      double x = (sample.time - origin) / 86400.0;
+      sx += x;
+      sy += sample.value;
+      sxx += x * x;
+      sxy += x * sample.value;
+    }
+
+    double d = n * sxx - sx * sx;
+    if (d <= 0) return (false);
+
+    slope = (n * sxy - sx * sy) / d;
+    return (true);
+  }
+
+  bool Rate(double& rate, time_t now, int window) const {
+    //
+    // Increase per hour of a counter over the last window seconds: a counter going back restarted from 0
+    // False if there are less than two samples in the window
+    //
+    double increase = 0;
+    const Sample* first = nullptr;
+    const Sample* prev = nullptr;
+
+    for (const Sample& sample: sample_) {
+      if (sample.time < now - window) continue;
+
+      if (!prev) first = &sample;
+      else increase += (sample.value >= prev->value)? (sample.value - prev->value): sample.value;
+      prev = &sample;
+    }
+
+    if (!first || prev == first) return (false);
+
+    rate = increase * 3600 / (prev->time - first->time);
+    return (true);
+  }
+
+private:
+
+  struct Sample {
+    time_t time;
+    float value;
+    uint32_t count;
+  };
+
+  const size_t capacity_;
+  const int step_;
+  const Mode mode_;
+
+  deque<Sample> sample_;
+};
+
+//
+// Health of a device (sensor or hub) from its status messages:
+// - reboots: uptime going back
+// - battery: hourly voltage for a week, discharge slope in V/day once it spans a day
+// - rssi: distribution over the device's lifetime
+// - errors: a cumulative error counter (hub I2C bus errors) every 10 minutes for a day, per hour rate
+//
+
+class Health {
+public:
+
+  Health(): battery_{168, 3600}, rssi_{64}, errors_{144, 600, Series::Mode::LAST} {}
+
+  bool Uptime(time_t time, int uptime) {
+    //
+    // Return true if the device rebooted since its last status
+    //
+    bool reboot = last_uptime_ >= 0 && uptime < last_uptime_;
+
+    if (reboot) reboots_++;
+    last_uptime_ = uptime;
+    boot_ = time - uptime;
+
+    return (reboot);
+  }
+
+  inline void Battery(time_t time, double voltage) { if (voltage > 0) battery_.Add(time, voltage); }
+  inline void Rssi(int rssi) { if (rssi) rssi_.Add(rssi); }
+  inline void Errors(time_t time, int count) { errors_.Add(time, count); }
+
+  inline uint Reboots(void) const { return (reboots_); }
+  inline time_t Boot(void) const { return (boot_); }
+  inline const Kll& RssiSketch(void) const { return (rssi_); }
+
+  inline bool BatterySlope(double& slope) const { return (battery_.Slope(slope, 86400)); }
+  inline bool ErrorRate(double& rate, time_t now) const { return (errors_.Rate(rate, now, 86400)); }
+
+  string RssiText(void) const {
+    //
+    // p5/p50/p95 dBm (samples)
+    //
+    if (!rssi_.Count()) return ("n/a");
+
+    ostringstream text{""};
+    text << rssi_.Quantile(0.05) << "/" << rssi_.Quantile(0.5) << "/" << rssi_.Quantile(0.95) << " dBm (" << rssi_.Count() << ")";
+
+    return (text.str());
+  }
+
+private:
+
+  Series battery_;
+  Kll rssi_;
+  Series errors_;
+
+  int last_uptime_{-1};
+  time_t boot_{0};
+  uint reboots_{0};
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_HEALTH
@@ -0,0 +1,694 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: lightweight non-blocking HTTP/1.1 POST client
+//
+
+#ifndef TEMPEST_HTTP
+#define TEMPEST_HTTP
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "compress.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+struct HttpResult {
+  size_t tag;                                                   // as passed to Post()
+  int status;                                                   // HTTP status code, 0 if the request failed
+  string error;                                                 // why the request failed
+  double latency;                                               // seconds from Post() to the response
+  Compressor::Encoding encoding;                                // the body was sent with
+  string accept_encoding;                                       // Accept-Encoding of the response (i.e. with a 415)
+};
+
+struct HttpOptions {
+  int timeout = 10;                                             // seconds a request has to get its response
+  int connect_timeout = 5;                                      // seconds to establish a connection
+  int pipeline_max = 8;                                         // requests in flight on the connection
+};
+
+//
+// One client per destination, keeping a single persistent connection to it
+//
+// Post() only queues a request; Run() drives any number of clients from a single poll() and reports each completed request
+// Requests are pipelined on the connection up to pipeline_max and responses are matched in order; bodies are drained and discarded
+// If the server closes the connection after a response (Connection: close or HTTP/1.0) the requests in flight
+// and not answered yet are sent again on a new connection, once, and pipelining is turned off for that destination
+// The host is resolved when the client is built; after a connection failure it's resolved again on a thread of its own,
+// so a slow DNS never stalls Run()
+//
+
+class HttpClient {
+public:
+
+  HttpClient(const string& url, const string& content_type, const HttpOptions& options): options_{options}, pipeline_{options.pipeline_max} {
+    // [http://]host[:port][/path]
+    string rest = url;
+    size_t pos = rest.find("://");
+    if (pos != string::npos) {
+      string scheme = rest.substr(0, pos);
+      transform(scheme.begin(), scheme.end(), scheme.begin(), ::tolower);
+      if (scheme != "http") error_ = "unsupported scheme '" + scheme + "' (use the curl backend)";
+      rest = rest.substr(pos + 3);
+    }
+
+    pos = rest.find('/');
+    path_ = (pos == string::npos)? "/": rest.substr(pos);
+    host_ = rest.substr(0, pos);
+
+    port_ = "80";
+    pos = host_.rfind(':');
+    if (pos != string::npos && host_.find(']', pos) == string::npos) {
+      port_ = host_.substr(pos + 1);
+      authority_ = host_;
+      host_ = host_.substr(0, pos);
+    }
+    else authority_ = host_;
+
+    if (!host_.empty() && host_.front() == '[' && host_.back() == ']') host_ = host_.substr(1, host_.size() - 2);
+    if (host_.empty() && error_.empty()) error_ = "missing host";
+
+    head_ = "POST " + path_ + " HTTP/1.1\r\nHost: " + authority_ + "\r\nAccept: */*\r\nContent-Type: " + content_type + "\r\n";
+
+    if (error_.empty()) {
+      Resolution resolution = Resolve(host_, port_);
+      address_ = move(resolution.address);
+      last_error_ = move(resolution.error);
+    }
+  }
+
+  ~HttpClient() { Close(); }
+
+  HttpClient(const HttpClient&) = delete;
+  HttpClient& operator=(const HttpClient&) = delete;
+
+  inline const string& Error(void) const { return (error_); }
+  inline size_t Pending(void) const { return (waiting_.size() + flight_.size()); }
+
+  void Post(const string& body, size_t tag, Compressor::Encoding encoding = Compressor::Encoding::IDENTITY) {
+    //
+    // Queue a request: it's sent by the next Run()
+    // body must already be compressed with encoding
+    //
+    Request request;
+    request.tag = tag;
+    request.encoding = encoding;
+    request.data.reserve(head_.size() + 64 + body.size());
+    request.data.append(head_);
+    if (encoding != Compressor::Encoding::IDENTITY) request.data.append("Content-Encoding: ").append(Compressor::Name(encoding)).append("\r\n");
+    request.data.append("Content-Length: ").append(to_string(body.size())).append("\r\n\r\n").append(body);
+    request.start = Now();
+    request.deadline = request.start + options_.timeout;
+    request.retried = false;
+
+    waiting_.push_back(move(request));
+  }
+
+  static void Run(const vector<HttpClient*>& client, int timeout_ms, const function<void(size_t, const HttpResult&)>& done) {
+    //
+    // Wait up to timeout_ms for any client to make progress and report the completed requests by client index
+    //
+    vector<struct pollfd> fds(client.size());
+    vector<HttpResult> result;
+    double now = Now();
+    bool active = false;
+
+    for (size_t idx = 0; idx < client.size(); idx++) {
+      client[idx]->Prepare(now, result);
+      Report(idx, result, done);
+
+      fds[idx].fd = client[idx]->sock_;
+      fds[idx].events = client[idx]->Events();
+      fds[idx].revents = 0;
+      active |= (fds[idx].events != 0);
+
+      // Don't sleep past the first deadline
+      double deadline = client[idx]->Deadline();
+      if (deadline) timeout_ms = min(timeout_ms, max((int)((deadline - now) * 1000) + 1, 0));
+    }
+
+    // Nothing to wait for (i.e. all the requests failed to connect)
+    if (!active) return;
+
+    if (poll(fds.data(), fds.size(), timeout_ms) == -1 && errno != EINTR) return;
+
+    now = Now();
+    for (size_t idx = 0; idx < client.size(); idx++) {
+      if (fds[idx].fd != -1 && fds[idx].revents) client[idx]->Process(fds[idx].revents, result);
+      client[idx]->Expire(now, result);
+      Report(idx, result, done);
+    }
+  }
+
+  string Stats(void) const {
+    ostringstream stats{""};
+
+    uint64_t responses = stats_.responses.load(memory_order_relaxed);
+    double latency = responses? (stats_.latency_us.load(memory_order_relaxed) / 1000.0 / responses): 0;
+
+    stats << "     HTTP: " << stats_.connections.load(memory_order_relaxed) << " connection(s), " << stats_.requests.load(memory_order_relaxed) << " request(s), ";
+    stats << responses << " response(s), " << stats_.timeouts.load(memory_order_relaxed) << " timeout(s), " << stats_.retries.load(memory_order_relaxed) << " retried";
+    stats << " (average latency: " << latency << "ms, pipeline: " << pipeline_.load(memory_order_relaxed) << ")" << endl;
+
+    return (stats.str());
+  }
+
+private:
+
+  struct Request {
+    size_t tag;
+    Compressor::Encoding encoding;
+    string data;
+    double start;
+    double deadline;
+    bool retried;
+  };
+
+  enum State {
+    IDLE,                                                       // no connection
+    CONNECTING,
+    CONNECTED
+  };
+
+  struct Address {
+    int family;
+    int socktype;
+    int protocol;
+    struct sockaddr_storage addr;
+    socklen_t len;
+  };
+
+  struct Resolution {
+    vector<Address> address;
+    string error;                                               // empty if resolved
+  };
+
+  static double Now(void) {
+    return (chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  static void Report(size_t idx, vector<HttpResult>& result, const function<void(size_t, const HttpResult&)>& done) {
+    for (const HttpResult& r: result) done(idx, r);
+    result.clear();
+  }
+
+  double Deadline(void) const {
+    //
+    // Earliest request or connect deadline (0: none)
+    //
+    double deadline = 0;
+
+    if (state_ == State::CONNECTING) deadline = connect_deadline_;
+    for (const Request& request: flight_) {
+      if (!deadline || request.deadline < deadline) deadline = request.deadline;
+    }
+    if (!waiting_.empty() && (!deadline || waiting_.front().deadline < deadline)) deadline = waiting_.front().deadline;
+
+    return (deadline);
+  }
+
+  short Events(void) const {
+    if (sock_ == -1) return (0);
+    if (state_ == State::CONNECTING || out_ < out_buffer_.size()) return (POLLIN | POLLOUT);
+    return (POLLIN);
+  }
+
+  void Prepare(double now, vector<HttpResult>& result) {
+    //
+    // Connect if there's something to send and move waiting requests in flight, up to the pipeline depth
+    //
+    if (!error_.empty()) {
+      // The URL is not usable: fail everything
+      while (!waiting_.empty()) Fail(waiting_, error_, result);
+      return;
+    }
+
+    if (waiting_.empty()) return;
+
+    if (state_ == State::IDLE && !Connect(now)) {
+      while (!waiting_.empty()) Fail(waiting_, last_error_, result);
+      return;
+    }
+
+    if (state_ != State::CONNECTED) return;
+
+    while (!waiting_.empty() && flight_.size() < (size_t)pipeline_.load(memory_order_relaxed)) {
+      out_buffer_.append(waiting_.front().data);
+      flight_.push_back(move(waiting_.front()));
+      waiting_.pop_front();
+      stats_.requests.fetch_add(1, memory_order_relaxed);
+    }
+
+    Write(result);
+  }
+
+  static Resolution Resolve(const string& host, const string& port) {
+    //
+    // getaddrinfo() blocks: called when the client is built and, later, off the Run() thread only
+    //
+    Resolution resolution;
+    struct addrinfo hints;
+    struct addrinfo* info = nullptr;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &info);
+    if (err) {
+      resolution.error = string("getaddrinfo(): ") + gai_strerror(err);
+      return (resolution);
+    }
+
+    for (struct addrinfo* ai = info; ai; ai = ai->ai_next) {
+      if (ai->ai_addrlen > sizeof(struct sockaddr_storage)) continue;
+
+      Address address{ai->ai_family, ai->ai_socktype, ai->ai_protocol, {}, (socklen_t)ai->ai_addrlen};
+      memcpy(&address.addr, ai->ai_addr, ai->ai_addrlen);
+      resolution.address.push_back(address);
+    }
+
+    freeaddrinfo(info);
+
+    return (resolution);
+  }
+
+  void Refresh(void) {
+    //
+    // Resolve the host again in the background: connections use the addresses already known until it's done
+    //
+    if (!resolving_.valid()) resolving_ = async(launch::async, Resolve, host_, port_);
+  }
+
+  bool Connect(double now) {
+    if (resolving_.valid() && resolving_.wait_for(chrono::seconds(0)) == future_status::ready) {
+      Resolution resolution = resolving_.get();
+      if (resolution.error.empty()) address_ = move(resolution.address);
+      else last_error_ = move(resolution.error);
+    }
+
+    if (address_.empty()) {
+      Refresh();
+      return (false);
+    }
+
+    for (const Address& address: address_) {
+      sock_ = socket(address.family, address.socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address.protocol);
+      if (sock_ == -1) continue;
+
+      int opt = 1;
+      setsockopt(sock_, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+      if (connect(sock_, (const struct sockaddr*)&address.addr, address.len) == 0) {
+        state_ = State::CONNECTED;
+        break;
+      }
+      if (errno == EINPROGRESS) {
+        state_ = State::CONNECTING;
+        connect_deadline_ = now + options_.connect_timeout;
+        break;
+      }
+
+      last_error_ = string("connect(): ") + strerror(errno);
+      close(sock_);
+      sock_ = -1;
+    }
+
+    if (sock_ == -1) {
+      Refresh();
+      return (false);
+    }
+
+    stats_.connections.fetch_add(1, memory_order_relaxed);
+    return (true);
+  }
+
+  void Close(void) {
+    if (sock_ != -1) close(sock_);
+    sock_ = -1;
+    state_ = State::IDLE;
+    out_buffer_.clear();
+    out_ = 0;
+    in_buffer_.clear();
+    ResetResponse();
+  }
+
+  void Fail(deque<Request>& queue, const string& error, vector<HttpResult>& result) {
+    const Request& request = queue.front();
+    result.push_back({request.tag, 0, error, Now() - request.start, request.encoding, {}});
+    queue.pop_front();
+  }
+
+  void Abort(const string& error, vector<HttpResult>& result, bool retry) {
+    //
+    // Drop the connection: requests in flight are either failed or, if retry and they were not retried already, sent again
+    //
+    Close();
+
+    while (!flight_.empty()) {
+      Request& request = flight_.back();
+      if (retry && !request.retried) {
+        request.retried = true;
+        stats_.retries.fetch_add(1, memory_order_relaxed);
+        waiting_.push_front(move(request));
+        flight_.pop_back();
+      }
+      else {
+        result.push_back({request.tag, 0, error, Now() - request.start, request.encoding, {}});
+        flight_.pop_back();
+      }
+    }
+  }
+
+  void Process(short revents, vector<HttpResult>& result) {
+    if (state_ == State::CONNECTING) {
+      if (!(revents & (POLLOUT | POLLERR | POLLHUP))) return;
+
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(sock_, SOL_SOCKET, SO_ERROR, &err, &len);
+
+      if (err) {
+        last_error_ = string("connect(): ") + strerror(err);
+        Close();
+        Refresh();
+        while (!waiting_.empty()) Fail(waiting_, last_error_, result);
+        return;
+      }
+
+      state_ = State::CONNECTED;
+      Prepare(Now(), result);
+      return;
+    }
+
+    if (revents & POLLOUT) Write(result);
+    if (sock_ != -1 && (revents & (POLLIN | POLLERR | POLLHUP))) Read(result);
+  }
+
+  void Write(vector<HttpResult>& result) {
+    while (out_ < out_buffer_.size()) {
+      ssize_t len = send(sock_, out_buffer_.data() + out_, out_buffer_.size() - out_, MSG_NOSIGNAL);
+      if (len == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        // A stale keep-alive connection: try the requests again on a fresh one
+        Abort(string("send(): ") + strerror(errno), result, true);
+        return;
+      }
+      out_ += len;
+    }
+
+    out_buffer_.clear();
+    out_ = 0;
+  }
+
+  void Read(vector<HttpResult>& result) {
+    char buffer[4096];
+
+    while (sock_ != -1) {
+      ssize_t len = recv(sock_, buffer, sizeof(buffer), 0);
+
+      if (len == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        Abort(string("recv(): ") + strerror(errno), result, true);
+        return;
+      }
+
+      if (len == 0) {
+        // Closed by the server: a body delimited by the connection end is now complete
+        if (response_.state == Response::BODY && response_.until_close) Complete(result);
+        bool retry = !flight_.empty();
+        Abort("connection closed", result, retry);
+        return;
+      }
+
+      in_buffer_.append(buffer, len);
+      Parse(result);
+    }
+  }
+
+  struct Response {
+    enum {
+      STATUS,
+      HEADERS,
+      BODY,
+      CHUNK_SIZE,
+      CHUNK_DATA,
+      CHUNK_TRAILER
+    }
+    state = STATUS;
+
+    int status = 0;
+    bool close = false;
+    bool length = false;                                        // Content-Length received
+    bool chunked = false;
+    bool until_close = false;
+    size_t remaining = 0;
+    string accept_encoding;
+  };
+
+  void ResetResponse(void) { response_ = Response{}; }
+
+  bool Line(string& line) {
+    size_t pos = in_buffer_.find("\r\n");
+    if (pos == string::npos) return (false);
+
+    line = in_buffer_.substr(0, pos);
+    in_buffer_.erase(0, pos + 2);
+
+    return (true);
+  }
+
+  void Parse(vector<HttpResult>& result) {
+    //
+    // Consume as much of the input buffer as possible, completing responses in order
+    //
+    string line;
+
+    while (sock_ != -1) {
+      switch (response_.state) {
+      case Response::STATUS:
+        if (!Line(line)) return;
+        if (line.empty()) continue;
+        if (line.compare(0, 5, "HTTP/") || line.size() < 12) {
+          Abort("malformed status line", result, false);
+          return;
+        }
+        response_.status = atoi(line.c_str() + 9);
+        response_.close = !line.compare(0, 8, "HTTP/1.0");
+        response_.state = Response::HEADERS;
+        break;
+
+      case Response::HEADERS:
+        if (!Line(line)) return;
+        if (!line.empty()) {
+          Header(line);
+          break;
+        }
+
+        // End of headers
+        if (response_.status / 100 == 1) {
+          // Interim response: the real one follows
+          ResetResponse();
+          break;
+        }
+
+        if (response_.status == 204 || response_.status == 304) {
+          // Never a body
+          response_.remaining = 0;
+          response_.chunked = false;
+        }
+        else if (!response_.chunked && !response_.length) {
+          // Neither length nor chunks: the body ends with the connection
+          response_.until_close = true;
+          response_.close = true;
+        }
+
+        response_.state = response_.chunked? Response::CHUNK_SIZE: Response::BODY;
+        break;
+
+      case Response::BODY:
+        if (response_.until_close) {
+          in_buffer_.clear();
+          return;
+        }
+        if (in_buffer_.size() < response_.remaining) {
+          response_.remaining -= in_buffer_.size();
+          in_buffer_.clear();
+          return;
+        }
+        in_buffer_.erase(0, response_.remaining);
+        Complete(result);
+        break;
+
+      case Response::CHUNK_SIZE:
+        if (!Line(line)) return;
+        response_.remaining = strtoul(line.c_str(), nullptr, 16);
+        response_.state = response_.remaining? Response::CHUNK_DATA: Response::CHUNK_TRAILER;
+        break;
+
+      case Response::CHUNK_DATA:
+        // Chunk data followed by CRLF
+        if (in_buffer_.size() < response_.remaining + 2) {
+          size_t drain = min(in_buffer_.size(), response_.remaining);
+          response_.remaining -= drain;
+          in_buffer_.erase(0, drain);
+          return;
+        }
+        in_buffer_.erase(0, response_.remaining + 2);
+        response_.state = Response::CHUNK_SIZE;
+        break;
+
+      case Response::CHUNK_TRAILER:
+        if (!Line(line)) return;
+        if (line.empty()) Complete(result);
+        break;
+      }
+    }
+  }
+
+  void Header(const string& line) {
+    size_t colon = line.find(':');
+    if (colon == string::npos) return;
+
+    string name = line.substr(0, colon);
+    string value = line.substr(colon + 1);
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    transform(value.begin(), value.end(), value.begin(), ::tolower);
+    value.erase(0, value.find_first_not_of(" \t"));
+
+    if (name == "content-length") {
+      response_.remaining = strtoul(value.c_str(), nullptr, 10);
+      response_.length = true;
+    }
+    else if (name == "accept-encoding") response_.accept_encoding = value;
+    else if (name == "transfer-encoding") response_.chunked = (value.find("chunked") != string::npos);
+    else if (name == "connection") {
+      if (value.find("close") != string::npos) response_.close = true;
+      else if (value.find("keep-alive") != string::npos) response_.close = false;
+    }
+  }
+
+  void Complete(vector<HttpResult>& result) {
+    //
+    // A full response has been received: it belongs to the oldest request in flight
+    //
+    bool close = response_.close;
+    int status = response_.status;
+    string accept_encoding = move(response_.accept_encoding);
+    ResetResponse();
+
+    if (flight_.empty()) {
+      Abort("unexpected response", result, false);
+      return;
+    }
+
+    Request& request = flight_.front();
+    double latency = Now() - request.start;
+    result.push_back({request.tag, status, "", latency, request.encoding, move(accept_encoding)});
+    flight_.pop_front();
+
+    stats_.responses.fetch_add(1, memory_order_relaxed);
+    stats_.latency_us.fetch_add((uint64_t)(latency * 1000000), memory_order_relaxed);
+
+    if (close) {
+      // The server won't take more requests on this connection: stop pipelining to it
+      pipeline_.store(1, memory_order_relaxed);
+      Abort("connection closed", result, true);
+    }
+  }
+
+  void Expire(double now, vector<HttpResult>& result) {
+    //
+    // Fail requests past their deadline; a pipelined connection can't skip a response, so it's dropped
+    //
+    if (state_ == State::CONNECTING && now >= connect_deadline_) {
+      last_error_ = "connect(): timeout";
+      Close();
+      Refresh();
+      while (!waiting_.empty()) Fail(waiting_, last_error_, result);
+    }
+
+    bool expired = false;
+    for (const Request& request: flight_) expired |= (now >= request.deadline);
+
+    if (expired) {
+      stats_.timeouts.fetch_add(1, memory_order_relaxed);
+      Close();
+
+      while (!flight_.empty()) {
+        if (now >= flight_.back().deadline) {
+          result.push_back({flight_.back().tag, 0, "timeout", now - flight_.back().start, flight_.back().encoding, {}});
+          flight_.pop_back();
+        }
+        else {
+          waiting_.push_front(move(flight_.back()));
+          flight_.pop_back();
+        }
+      }
+    }
+
+    while (!waiting_.empty() && now >= waiting_.front().deadline) {
+      stats_.timeouts.fetch_add(1, memory_order_relaxed);
+      Fail(waiting_, "timeout", result);
+    }
+  }
+
+  const HttpOptions options_;
+
+  string host_;
+  string port_;
+  string authority_;                                            // host[:port] as in the URL, for the Host header
+  string path_;
+  string head_;                                                 // request line and headers up to Content-Encoding/Length
+  string error_;                                                // URL not usable
+  string last_error_;                                           // last connection error
+
+  vector<Address> address_;                                     // the host resolved
+  future<Resolution> resolving_;                                // resolving it again, after a connection failure
+
+  int sock_{-1};
+  State state_{State::IDLE};
+  double connect_deadline_{0};
+  atomic<int> pipeline_;                                        // lowered by the Run() thread, read by Stats()
+
+  deque<Request> waiting_;                                      // queued, not sent yet
+  deque<Request> flight_;                                       // sent, waiting for the response (in order)
+
+  string out_buffer_;
+  size_t out_{0};                                               // bytes of out_buffer_ already sent
+  string in_buffer_;
+  Response response_;
+
+  // Client Statistics (read by other threads)
+  struct {
+    atomic<uint64_t> connections{0};
+    atomic<uint64_t> requests{0};
+    atomic<uint64_t> responses{0};
+    atomic<uint64_t> timeouts{0};
+    atomic<uint64_t> retries{0};
+    atomic<uint64_t> latency_us{0};                             // sum, for the average
+  }
+  stats_;
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_HTTP
@@ -235,7 +235,9 @@ public:
     NONE = 0,
     STOP = 0,
     STATS = 1,
-    VERSION = 2  
+    VERSION = 2,
+    GAPS = 3,
+    QUANTILES = 4
   };
 
   Rpc(): Ipc() {
@@ -311,7 +313,8 @@ public:
 
         switch (shm_->cmd) {
         case Command::STATS:
-          CopyStringToShm(relay.Stats());
+          if (!shm_->offset) reply_ = relay.Stats();
+          CopyStringToShm(reply_);
           shm_->err = 0;
           break;
 
@@ -320,6 +323,18 @@ public:
           shm_->err = 0;
           break;
 
+        case Command::GAPS:
+          if (!shm_->offset) reply_ = relay.Gaps();
+          CopyStringToShm(reply_);
+          shm_->err = 0;
+          break;
+
+        case Command::QUANTILES:
+          if (!shm_->offset) reply_ = relay.Quantiles();
+          CopyStringToShm(reply_);
+          shm_->err = 0;
+          break;
+
         default:
           shm_->err = EINVAL;
           break;
@@ -343,13 +358,15 @@ public:
     error_t err = 0;
     pid = -1;
 
-    if (!(err = BlockSignals()) && !(err = Acquire((void*&)shm_))) {
+    if (!(err = BlockSignals()) && !(err = AcquireIdle())) {
       if (shm_->srv) {
         pid = shm_->srv;
         shm_->cli = getpid();
         shm_->cmd = cmd;
         shm_->err = 0;
-        shm_->buffer[0] = '\0';                
+        shm_->offset = 0;
+        shm_->size = 0;
+        shm_->buffer[0] = '\0';
       }
       else err = ENOENT;          
 
@@ -365,47 +382,96 @@ public:
   error_t ClientSignals(string& msg) {
     //
     // Client signal handler
-    //    
+    // A reply longer than the shared buffer comes in chunks: ask for the next one until we have it all
+    //
     error_t err = 0;
     msg.clear();
 
     sigset_t set;
     int sig;
-    if (!(err = BlockSignals(&set)) && !(err = sigwait(&set, &sig)) && sig == SIGUSR1 && !(err = Acquire((void*&)shm_))) {
-      if (!(err = shm_->err)) {
-        switch (shm_->cmd) {
-        case Command::STATS:
-          msg = shm_->buffer; 
-          break;
+    bool more = true;
+
+    if (!(err = BlockSignals(&set))) {
+      while (more && !(err = sigwait(&set, &sig)) && sig == SIGUSR1 && !(err = Acquire((void*&)shm_))) {
+        more = false;
+
+        if (!(err = shm_->err)) {
+          switch (shm_->cmd) {
+          case Command::STATS:
+            msg += shm_->buffer;
+            break;
+
+          case Command::VERSION:
+            msg += shm_->buffer;
+            break;
+
+          case Command::GAPS:
+            msg += shm_->buffer;
+            break;
+
+          case Command::QUANTILES:
+            msg += shm_->buffer;
+            break;
+
+          default:
+            err = EINVAL;
+            break;
+          }
+        }
 
-        case Command::VERSION:
-          msg = shm_->buffer; 
-          break;
+        if (!err && shm_->buffer[0] && msg.length() < shm_->size) {
+          // Next chunk
+          shm_->offset = msg.length();
+          shm_->buffer[0] = '\0';
 
-        default:
-          err = EINVAL;
-          break;
+          if (kill(shm_->srv, SIGUSR1) == -1) err = errno;
+          else more = true;
+        }
+        else {
+          shm_->cli = 0;
+          shm_->cmd = Command::NONE;
+          shm_->err = 0;
+          shm_->offset = 0;
+          shm_->size = 0;
+          shm_->buffer[0] = '\0';
         }
-      }
-
-      shm_->cli = 0;
-      shm_->cmd = Command::NONE;
-      shm_->err = 0;   
-      shm_->buffer[0] = '\0';    
 
-      error_t rel = Release((void*&)shm_);
-      if (!err) err = rel;
+        error_t rel = Release((void*&)shm_);
+        if (!err) err = rel;
+      }
     }
-    
+
     return (err);
   }
 
 private:
 
+  error_t AcquireIdle(void) {
+    //
+    // Acquire the shared memory once no other client is waiting for its reply (or the one that was is gone)
+    // Return EBUSY if it takes more than 5 seconds
+    //
+    error_t err;
+
+    for (int retry = 0; !(err = Acquire((void*&)shm_)) && shm_->cli && kill(shm_->cli, 0) != -1; retry++) {
+      if ((err = Release((void*&)shm_))) break;
+      if (retry == 500) return (EBUSY);
+
+      this_thread::sleep_for(chrono::milliseconds(10));
+    }
+
+    return (err);
+  }
+
   void CopyStringToShm(const string& str) {
-    size_t max = min(str.length(), sizeof(shm_->buffer) - 1);
-    strncpy(shm_->buffer, str.c_str(), max);
+    //
+    // Copy the chunk of str starting at the offset asked for by the client, and the length of the whole of it
+    //
+    size_t offset = min(shm_->offset, str.length());
+    size_t max = min(str.length() - offset, sizeof(shm_->buffer) - 1);
+    memcpy(shm_->buffer, str.data() + offset, max);
     shm_->buffer[max] = '\0';
+    shm_->size = str.length();
   }
 
   struct IpcData {
@@ -413,9 +479,13 @@ private:
     pid_t cli;
     Command cmd;
     error_t err;
-    char buffer[2048];  
+    size_t offset;                                              // of the chunk in buffer
+    size_t size;                                                // of the whole reply
+    char buffer[16384];  
   }* shm_;
 
+  string reply_;                                                // being sent in chunks (server)
+
 };
 
 } // namespace tempest
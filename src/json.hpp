@@ -11,6 +11,16 @@
  * order, etc. There are also helper methods Json::dump, to serialize a Json to a string, and
  * Json::parse (static) to parse a std::string as a Json object.
  *
+ * Json::parse also parses a std::string_view (or pointer and length) in place, with no copy of
+ * the input. With JsonStrings::BORROW the string values without escapes reference the input
+ * too, which must then outlive the result: string_view_value() reads them as they are, while
+ * string_value() makes a copy of each, once, the first time it's called.
+ *
+ * Parsed objects of up to 16 members are a flat vector, in order of appearance, each member with
+ * the hash of its key, computed once by the parser: a lookup compares hashes before strings, and
+ * the hash of a string literal key is folded at compile time. object_items() builds the std::map
+ * of such an object, once, the first time it's called.
+ *
  * Internally, the various types of Json object are represented by the JsonValue class
  * hierarchy.
  *
@@ -60,7 +70,22 @@ enum JsonParse {
     STANDARD, COMMENTS
 };
 
+enum class JsonStrings {
+    COPY, BORROW
+};
+
 class JsonValue;
+struct JsonMember;
+
+// FNV-1a hash of an object key
+inline constexpr uint32_t json_key_hash(std::string_view key) {
+    uint32_t hash = 2166136261u;
+    for (char ch : key) {
+        hash ^= static_cast<uint8_t>(ch);
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
 class Json final {
 public:
@@ -71,7 +96,7 @@ public:
 
     // Array and object typedefs
     typedef std::vector<Json> array;
-    typedef std::map<std::string, Json> object;
+    typedef std::map<std::string, Json, std::less<>> object;   // transparent: find() takes a string_view
 
     // Constructors for the various types of JSON value.
     Json() noexcept;                // NUL
@@ -128,6 +153,8 @@ public:
     bool bool_value() const;
     // Return the enclosed string if this is a string, "" otherwise.
     const std::string &string_value() const;
+    // Same, without copying a borrowed string.
+    std::string_view string_view_value() const;
     // Return the enclosed std::vector if this is an array, or an empty vector otherwise.
     const array &array_items() const;
     // Return the enclosed std::map if this is an object, or an empty map otherwise.
@@ -137,6 +164,12 @@ public:
     const Json & operator[](size_t i) const;
     // Return a reference to obj[key] if this is an object, Json() otherwise.
     const Json & operator[](const std::string &key) const;
+    // String literal keys: inlined, the hash folds to a constant.
+    template <size_t N>
+    const Json & operator[](const char (&key)[N]) const {
+        std::string_view k(key, std::char_traits<char>::length(key));
+        return find(k, json_key_hash(k));
+    }
 
     // Serialize.
     void dump(std::string &out) const;
@@ -147,14 +180,27 @@ public:
     }
 
     // Parse. If parse fails, return Json() and assign an error message to err.
+    static Json parse(std::string_view in,
+                      std::string & err,
+                      JsonParse strategy = JsonParse::STANDARD,
+                      JsonStrings strings = JsonStrings::COPY);
     static Json parse(const std::string & in,
                       std::string & err,
-                      JsonParse strategy = JsonParse::STANDARD);
+                      JsonParse strategy = JsonParse::STANDARD) {
+        return parse(std::string_view(in), err, strategy);
+    }
+    static Json parse(const char * in,
+                      size_t length,
+                      std::string & err,
+                      JsonParse strategy = JsonParse::STANDARD,
+                      JsonStrings strings = JsonStrings::COPY) {
+        return parse(std::string_view(in, length), err, strategy, strings);
+    }
     static Json parse(const char * in,
                       std::string & err,
                       JsonParse strategy = JsonParse::STANDARD) {
         if (in) {
-            return parse(std::string(in), err, strategy);
+            return parse(std::string_view(in), err, strategy);
         } else {
             err = "null input";
             return nullptr;
@@ -190,7 +236,14 @@ public:
     typedef std::initializer_list<std::pair<std::string, Type>> shape;
     bool has_shape(const shape & types, std::string & err) const;
 
+    // A STRING referencing value, which must outlive it (see JsonStrings::BORROW).
+    static Json borrowed(std::string_view value);
+    // An OBJECT from members with no duplicate keys (see JsonFlatObject).
+    static Json flat(std::vector<JsonMember> &&members);
+
 private:
+    const Json & find(std::string_view key, uint32_t hash) const;
+
     std::shared_ptr<JsonValue> m_ptr;
 };
 
@@ -200,6 +253,10 @@ protected:
     friend class Json;
     friend class JsonInt;
     friend class JsonDouble;
+    friend class JsonString;
+    friend class JsonBorrowedString;
+    friend class JsonObject;
+    friend class JsonFlatObject;
     virtual Json::Type type() const = 0;
     virtual bool equals(const JsonValue * other) const = 0;
     virtual bool less(const JsonValue * other) const = 0;
@@ -208,10 +265,11 @@ protected:
     virtual int int_value() const;
     virtual bool bool_value() const;
     virtual const std::string &string_value() const;
+    virtual std::string_view string_view_value() const;
     virtual const Json::array &array_items() const;
     virtual const Json &operator[](size_t i) const;
     virtual const Json::object &object_items() const;
-    virtual const Json &operator[](const std::string &key) const;
+    virtual const Json &find(std::string_view key, uint32_t hash) const;
     virtual ~JsonValue() {}
 };
 
@@ -261,7 +319,7 @@ static void dump(bool value, string &out) {
     out += value ? "true" : "false";
 }
 
-static void dump(const string &value, string &out) {
+static void dump(std::string_view value, string &out) {
     out += '"';
     for (size_t i = 0; i < value.length(); i++) {
         const char ch = value[i];
@@ -283,11 +341,11 @@ static void dump(const string &value, string &out) {
             char buf[8];
             snprintf(buf, sizeof buf, "\\u%04x", ch);
             out += buf;
-        } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i+1]) == 0x80
+        } else if (static_cast<uint8_t>(ch) == 0xe2 && i + 2 < value.length() && static_cast<uint8_t>(value[i+1]) == 0x80
                    && static_cast<uint8_t>(value[i+2]) == 0xa8) {
             out += "\\u2028";
             i += 2;
-        } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i+1]) == 0x80
+        } else if (static_cast<uint8_t>(ch) == 0xe2 && i + 2 < value.length() && static_cast<uint8_t>(value[i+1]) == 0x80
                    && static_cast<uint8_t>(value[i+2]) == 0xa9) {
             out += "\\u2029";
             i += 2;
@@ -383,11 +441,29 @@ public:
 
 class JsonString final : public Value<Json::STRING, string> {
     const string &string_value() const override { return m_value; }
+    std::string_view string_view_value() const override { return m_value; }
+    bool equals(const JsonValue * other) const override { return m_value == other->string_view_value(); }
+    bool less(const JsonValue * other)   const override { return m_value <  other->string_view_value(); }
 public:
     explicit JsonString(const string &value) : Value(value) {}
     explicit JsonString(string &&value)      : Value(move(value)) {}
 };
 
+class JsonBorrowedString final : public Value<Json::STRING, std::string_view> {
+    const string &string_value() const override {
+        std::call_once(m_once, [this] { m_copy.assign(m_value); });
+        return m_copy;
+    }
+    std::string_view string_view_value() const override { return m_value; }
+    bool equals(const JsonValue * other) const override { return m_value == other->string_view_value(); }
+    bool less(const JsonValue * other)   const override { return m_value <  other->string_view_value(); }
+
+    mutable std::once_flag m_once;
+    mutable string m_copy;
+public:
+    explicit JsonBorrowedString(std::string_view value) : Value(value) {}
+};
+
 class JsonArray final : public Value<Json::ARRAY, Json::array> {
     const Json::array &array_items() const override { return m_value; }
     const Json & operator[](size_t i) const override;
@@ -398,12 +474,44 @@ public:
 
 class JsonObject final : public Value<Json::OBJECT, Json::object> {
     const Json::object &object_items() const override { return m_value; }
-    const Json & operator[](const string &key) const override;
+    const Json & find(std::string_view key, uint32_t hash) const override;
+    bool equals(const JsonValue * other) const override { return m_value == other->object_items(); }
+    bool less(const JsonValue * other)   const override { return m_value <  other->object_items(); }
 public:
     explicit JsonObject(const Json::object &value) : Value(value) {}
     explicit JsonObject(Json::object &&value)      : Value(move(value)) {}
 };
 
+struct JsonMember {
+    uint32_t hash;
+    string key;
+    Json value;
+};
+
+class JsonFlatObject final : public JsonValue {
+    Json::Type type() const override { return Json::OBJECT; }
+    const Json::object &object_items() const override {
+        std::call_once(m_once, [this] {
+            for (const JsonMember &member : m_value)
+                m_map.emplace(member.key, member.value);
+        });
+        return m_map;
+    }
+    const Json & find(std::string_view key, uint32_t hash) const override;
+    bool equals(const JsonValue * other) const override { return object_items() == other->object_items(); }
+    bool less(const JsonValue * other)   const override { return object_items() <  other->object_items(); }
+    // In key order, as a map
+    void dump(string &out) const override { tempest::dump(object_items(), out); }
+
+    const vector<JsonMember> m_value;                // in order of appearance, unique keys
+    mutable std::once_flag m_once;
+    mutable Json::object m_map;
+public:
+    static const size_t max_members = 16;
+
+    explicit JsonFlatObject(vector<JsonMember> &&value) : m_value(move(value)) {}
+};
+
 class JsonNull final : public Value<Json::NUL, NullStruct> {
 public:
     JsonNull() : Value({}) {}
@@ -418,7 +526,7 @@ struct Statics {
     const std::shared_ptr<JsonValue> f = make_shared<JsonBoolean>(false);
     const string empty_string;
     const vector<Json> empty_vector;
-    const map<string, Json> empty_map;
+    const Json::object empty_map;
     Statics() {}
 };
 
@@ -450,6 +558,18 @@ Json::Json(Json::array &&values)       : m_ptr(make_shared<JsonArray>(move(value
 Json::Json(const Json::object &values) : m_ptr(make_shared<JsonObject>(values)) {}
 Json::Json(Json::object &&values)      : m_ptr(make_shared<JsonObject>(move(values))) {}
 
+Json Json::borrowed(std::string_view value) {
+    Json json;
+    json.m_ptr = make_shared<JsonBorrowedString>(value);
+    return json;
+}
+
+Json Json::flat(vector<JsonMember> &&members) {
+    Json json;
+    json.m_ptr = make_shared<JsonFlatObject>(move(members));
+    return json;
+}
+
 /* * * * * * * * * * * * * * * * * * * *
  * Accessors
  */
@@ -459,24 +579,34 @@ double Json::number_value()                       const { return m_ptr->number_v
 int Json::int_value()                             const { return m_ptr->int_value();    }
 bool Json::bool_value()                           const { return m_ptr->bool_value();   }
 const string & Json::string_value()               const { return m_ptr->string_value(); }
+std::string_view Json::string_view_value()        const { return m_ptr->string_view_value(); }
 const vector<Json> & Json::array_items()          const { return m_ptr->array_items();  }
-const map<string, Json> & Json::object_items()    const { return m_ptr->object_items(); }
+const Json::object & Json::object_items()         const { return m_ptr->object_items(); }
 const Json & Json::operator[] (size_t i)          const { return (*m_ptr)[i];           }
-const Json & Json::operator[] (const string &key) const { return (*m_ptr)[key];         }
+const Json & Json::operator[] (const string &key) const { return m_ptr->find(key, json_key_hash(key)); }
+const Json & Json::find(std::string_view key, uint32_t hash) const { return m_ptr->find(key, hash); }
 
 double                    JsonValue::number_value()              const { return 0; }
 int                       JsonValue::int_value()                 const { return 0; }
 bool                      JsonValue::bool_value()                const { return false; }
 const string &            JsonValue::string_value()              const { return statics().empty_string; }
+std::string_view          JsonValue::string_view_value()         const { return {}; }
 const vector<Json> &      JsonValue::array_items()               const { return statics().empty_vector; }
-const map<string, Json> & JsonValue::object_items()              const { return statics().empty_map; }
+const Json::object &      JsonValue::object_items()              const { return statics().empty_map; }
 const Json &              JsonValue::operator[] (size_t)         const { return static_null(); }
-const Json &              JsonValue::operator[] (const string &) const { return static_null(); }
+const Json &              JsonValue::find(std::string_view, uint32_t) const { return static_null(); }
 
-const Json & JsonObject::operator[] (const string &key) const {
+const Json & JsonObject::find(std::string_view key, uint32_t) const {
     auto iter = m_value.find(key);
     return (iter == m_value.end()) ? static_null() : iter->second;
 }
+const Json & JsonFlatObject::find(std::string_view key, uint32_t hash) const {
+    for (const JsonMember &member : m_value) {
+        if (member.hash == hash && member.key == key)
+            return member.value;
+    }
+    return static_null();
+}
 const Json & JsonArray::operator[] (size_t i) const {
     if (i >= m_value.size()) return static_null();
     else return m_value[i];
@@ -535,11 +665,21 @@ struct JsonParser final {
 
     /* State
      */
-    const string &str;
+    const char *str;
+    size_t size;
     size_t i;
     string &err;
     bool failed;
     const JsonParse strategy;
+    const JsonStrings strings;
+
+    /* at(k)
+     *
+     * The input is not NUL terminated: past its end read 0.
+     */
+    char at(size_t k) const {
+        return (k < size) ? str[k] : 0;
+    }
 
     /* fail(msg, err_ret = Json())
      *
@@ -562,7 +702,7 @@ struct JsonParser final {
      * Advance until the current character is non-whitespace.
      */
     void consume_whitespace() {
-        while (str[i] == ' ' || str[i] == '\r' || str[i] == '\n' || str[i] == '\t')
+        while (at(i) == ' ' || at(i) == '\r' || at(i) == '\n' || at(i) == '\t')
             i++;
     }
 
@@ -572,26 +712,26 @@ struct JsonParser final {
      */
     bool consume_comment() {
       bool comment_found = false;
-      if (str[i] == '/') {
+      if (at(i) == '/') {
         i++;
-        if (i == str.size())
+        if (i == size)
           return fail("unexpected end of input after start of comment", false);
-        if (str[i] == '/') { // inline comment
+        if (at(i) == '/') { // inline comment
           i++;
           // advance until next line, or end of input
-          while (i < str.size() && str[i] != '\n') {
+          while (i < size && at(i) != '\n') {
             i++;
           }
           comment_found = true;
         }
-        else if (str[i] == '*') { // multiline comment
+        else if (at(i) == '*') { // multiline comment
           i++;
-          if (i > str.size()-2)
+          if (i > size-2)
             return fail("unexpected end of input inside multi-line comment", false);
           // advance until closing tokens
-          while (!(str[i] == '*' && str[i+1] == '/')) {
+          while (!(at(i) == '*' && at(i+1) == '/')) {
             i++;
-            if (i > str.size()-2)
+            if (i > size-2)
               return fail(
                 "unexpected end of input inside multi-line comment", false);
           }
@@ -629,10 +769,10 @@ struct JsonParser final {
     char get_next_token() {
         consume_garbage();
         if (failed) return static_cast<char>(0);
-        if (i == str.size())
+        if (i == size)
             return fail("unexpected end of input", static_cast<char>(0));
 
-        return str[i++];
+        return at(i++);
     }
 
     /* encode_utf8(pt, out)
@@ -668,10 +808,10 @@ struct JsonParser final {
         string out;
         long last_escaped_codepoint = -1;
         while (true) {
-            if (i == str.size())
+            if (i == size)
                 return fail("unexpected end of input in string", "");
 
-            char ch = str[i++];
+            char ch = at(i++);
 
             if (ch == '"') {
                 encode_utf8(last_escaped_codepoint, out);
@@ -690,17 +830,17 @@ struct JsonParser final {
             }
 
             // Handle escapes
-            if (i == str.size())
+            if (i == size)
                 return fail("unexpected end of input in string", "");
 
-            ch = str[i++];
+            ch = at(i++);
 
             if (ch == 'u') {
                 // Extract 4-byte escape sequence
-                string esc = str.substr(i, 4);
+                string esc(str + i, std::min<size_t>(4, size - i));
                 // Explicitly check length of the substring. The following loop
                 // relies on std::string returning the terminating NUL when
-                // accessing str[length]. Checking here reduces brittleness.
+                // accessing esc[length]. Checking here reduces brittleness.
                 if (esc.length() < 4) {
                     return fail("bad \\u escape: " + esc, "");
                 }
@@ -760,52 +900,57 @@ struct JsonParser final {
     Json parse_number() {
         size_t start_pos = i;
 
-        if (str[i] == '-')
+        if (at(i) == '-')
             i++;
 
         // Integer part
-        if (str[i] == '0') {
+        if (at(i) == '0') {
             i++;
-            if (in_range(str[i], '0', '9'))
+            if (in_range(at(i), '0', '9'))
                 return fail("leading 0s not permitted in numbers");
-        } else if (in_range(str[i], '1', '9')) {
+        } else if (in_range(at(i), '1', '9')) {
             i++;
-            while (in_range(str[i], '0', '9'))
+            while (in_range(at(i), '0', '9'))
                 i++;
         } else {
-            return fail("invalid " + esc(str[i]) + " in number");
+            return fail("invalid " + esc(at(i)) + " in number");
         }
 
-        if (str[i] != '.' && str[i] != 'e' && str[i] != 'E'
+        if (at(i) != '.' && at(i) != 'e' && at(i) != 'E'
                 && (i - start_pos) <= static_cast<size_t>(std::numeric_limits<int>::digits10)) {
-            return std::atoi(str.c_str() + start_pos);
+            int value = 0;
+            std::from_chars(str + start_pos, str + i, value);
+            return value;
         }
 
         // Decimal part
-        if (str[i] == '.') {
+        if (at(i) == '.') {
             i++;
-            if (!in_range(str[i], '0', '9'))
+            if (!in_range(at(i), '0', '9'))
                 return fail("at least one digit required in fractional part");
 
-            while (in_range(str[i], '0', '9'))
+            while (in_range(at(i), '0', '9'))
                 i++;
         }
 
         // Exponent part
-        if (str[i] == 'e' || str[i] == 'E') {
+        if (at(i) == 'e' || at(i) == 'E') {
             i++;
 
-            if (str[i] == '+' || str[i] == '-')
+            if (at(i) == '+' || at(i) == '-')
                 i++;
 
-            if (!in_range(str[i], '0', '9'))
+            if (!in_range(at(i), '0', '9'))
                 return fail("at least one digit required in exponent");
 
-            while (in_range(str[i], '0', '9'))
+            while (in_range(at(i), '0', '9'))
                 i++;
         }
 
-        return std::strtod(str.c_str() + start_pos, nullptr);
+        double value = 0;
+        if (std::from_chars(str + start_pos, str + i, value).ec == std::errc::result_out_of_range)
+            value = std::strtod(string(str + start_pos, i - start_pos).c_str(), nullptr);
+        return value;
     }
 
     /* expect(str, res)
@@ -816,11 +961,11 @@ struct JsonParser final {
     Json expect(const string &expected, Json res) {
         assert(i != 0);
         i--;
-        if (str.compare(i, expected.length(), expected) == 0) {
+        if (size - i >= expected.length() && memcmp(str + i, expected.data(), expected.length()) == 0) {
             i += expected.length();
             return res;
         } else {
-            return fail("parse error: expected " + expected + ", got " + str.substr(i, expected.length()));
+            return fail("parse error: expected " + expected + ", got " + string(str + i, std::min(expected.length(), size - i)));
         }
     }
 
@@ -851,14 +996,41 @@ struct JsonParser final {
         if (ch == 'n')
             return expect("null", Json());
 
-        if (ch == '"')
+        if (ch == '"') {
+            // Borrow strings with no escapes from the input
+            if (strings == JsonStrings::BORROW) {
+                size_t end = i;
+                while (end < size && str[end] != '"' && str[end] != '\\' && !in_range(str[end], 0, 0x1f))
+                    end++;
+
+                if (end < size && str[end] == '"') {
+                    Json value = Json::borrowed(std::string_view(str + i, end - i));
+                    i = end + 1;
+                    return value;
+                }
+            }
             return parse_string();
+        }
 
         if (ch == '{') {
-            map<string, Json> data;
+            // Members are collected on a stack shared by the nested objects of the thread,
+            // so a small object costs a single allocation
+            static thread_local vector<JsonMember> members;
+            size_t first = members.size();
+
+            struct Unwind {
+                vector<JsonMember> &members;
+                size_t first;
+                ~Unwind() { members.erase(members.begin() + first, members.end()); }
+            } unwind { members, first };
+
+            // Past max_members the object is going to be a map anyway: switch to it, so the duplicate
+            // checks don't grow quadratic
+            Json::object large;
+
             ch = get_next_token();
             if (ch == '}')
-                return data;
+                return Json::object();
 
             while (1) {
                 if (ch != '"')
@@ -872,9 +1044,29 @@ struct JsonParser final {
                 if (ch != ':')
                     return fail("expected ':' in object, got " + esc(ch));
 
-                data[std::move(key)] = parse_json(depth + 1);
+                uint32_t hash = json_key_hash(key);
+                Json value = parse_json(depth + 1);
                 if (failed)
                     return Json();
+                // The last of duplicate keys wins (as in a map)
+                if (!large.empty()) {
+                    large[std::move(key)] = std::move(value);
+                }
+                else {
+                    auto member = std::find_if(members.begin() + first, members.end(), [&](const JsonMember &m) {
+                        return m.hash == hash && m.key == key;
+                    });
+                    if (member != members.end())
+                        member->value = std::move(value);
+                    else
+                        members.push_back({ hash, std::move(key), std::move(value) });
+
+                    if (members.size() - first > JsonFlatObject::max_members) {
+                        for (auto it = members.begin() + first; it != members.end(); ++it)
+                            large.emplace(std::move(it->key), std::move(it->value));
+                        members.erase(members.begin() + first, members.end());
+                    }
+                }
 
                 ch = get_next_token();
                 if (ch == '}')
@@ -884,7 +1076,13 @@ struct JsonParser final {
 
                 ch = get_next_token();
             }
-            return data;
+
+            if (!large.empty())
+                return large;
+
+            auto begin = members.begin() + first;
+            vector<JsonMember> data(std::make_move_iterator(begin), std::make_move_iterator(members.end()));
+            return Json::flat(std::move(data));
         }
 
         if (ch == '[') {
@@ -916,8 +1114,8 @@ struct JsonParser final {
 };
 }//namespace {
 
-Json Json::parse(const string &in, string &err, JsonParse strategy) {
-    JsonParser parser { in, 0, err, false, strategy };
+Json Json::parse(std::string_view in, string &err, JsonParse strategy, JsonStrings strings) {
+    JsonParser parser { in.data(), in.size(), 0, err, false, strategy, strings };
     Json result = parser.parse_json(0);
 
     // Check for any trailing garbage
@@ -935,7 +1133,7 @@ vector<Json> Json::parse_multi(const string &in,
                                std::string::size_type &parser_stop_pos,
                                string &err,
                                JsonParse strategy) {
-    JsonParser parser { in, 0, err, false, strategy };
+    JsonParser parser { in.data(), in.size(), 0, err, false, strategy, JsonStrings::COPY };
     parser_stop_pos = 0;
     vector<Json> json_vec;
     while (parser.i != in.size() && !parser.failed) {
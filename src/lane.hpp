@@ -0,0 +1,245 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: low-latency priority lane to datagram and HTTP sinks
+//
+
+#ifndef TEMPEST_LANE
+#define TEMPEST_LANE
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "http.hpp"
+#include "curl.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Messages pushed to a lane bypass the interval pipeline entirely:
+// - datagram sinks (udp://host:port, unix:/path) are written by the pushing thread itself, non-blocking
+// - HTTP sinks (http://...) are posted by the lane's own thread, so a slow endpoint never stalls the pusher;
+//   its queue is bounded and drops the oldest message when full
+//
+
+class Lane {
+public:
+
+  Lane(const string& name, const vector<string>& url, const HttpOptions& options, size_t queue_max = 256): name_{name}, queue_max_{queue_max} {
+    for (const string& u: url) {
+      if (!u.compare(0, 6, "udp://") || !u.compare(0, 5, "unix:")) {
+        Datagram datagram{u};
+        string error = Open(datagram);
+        if (!error.empty()) error_.push_back(u + ": " + error);
+        else datagram_.push_back(datagram);
+      }
+      else {
+        http_.push_back(make_unique<HttpTransport>(u, "application/json", options));
+        http_url_.push_back(u);
+        if (!http_.back()->Error().empty()) error_.push_back(u + ": " + http_.back()->Error());
+      }
+    }
+
+    if (!http_.empty()) thread_ = thread(&Lane::Work, this);
+  }
+
+  ~Lane() {
+    {
+      scoped_lock<mutex> lock{access_};
+      exit_ = true;
+    }
+    wake_.notify_one();
+
+    if (thread_.joinable()) thread_.join();
+
+    for (const Datagram& datagram: datagram_) close(datagram.sock);
+  }
+
+  Lane(const Lane&) = delete;
+  Lane& operator=(const Lane&) = delete;
+
+  inline const string& Name(void) const { return (name_); }
+  inline const vector<string>& Errors(void) const { return (error_); }
+
+  static bool Supported(const string& url) {
+    //
+    // Return whether a sink url is one we can deliver to (https only with curl built in)
+    //
+    if (!url.compare(0, 6, "udp://") || !url.compare(0, 5, "unix:") || !url.compare(0, 7, "http://")) return (true);
+    #ifdef TEMPEST_CURL
+    if (!url.compare(0, 8, "https://")) return (true);
+    #endif
+    return (false);
+  }
+
+  void Push(const string& message) {
+    //
+    // Deliver a message to every sink: can be called by any thread
+    //
+    stats_.pushed.fetch_add(1, memory_order_relaxed);
+
+    for (const Datagram& datagram: datagram_) {
+      if (sendto(datagram.sock, message.data(), message.size(), MSG_DONTWAIT | MSG_NOSIGNAL, (const struct sockaddr*)&datagram.addr, datagram.len) == -1) {
+        stats_.failed.fetch_add(1, memory_order_relaxed);
+      }
+      else stats_.sent.fetch_add(1, memory_order_relaxed);
+    }
+
+    if (http_.empty()) return;
+
+    {
+      scoped_lock<mutex> lock{access_};
+
+      if (queue_.size() == queue_max_) {
+        queue_.pop_front();
+        stats_.dropped.fetch_add(1, memory_order_relaxed);
+      }
+      queue_.push_back(message);
+    }
+    wake_.notify_one();
+  }
+
+  string Stats(void) const {
+    ostringstream stats{""};
+
+    stats << name_ << " Lane: " << (datagram_.size() + http_.size()) << " sink(s)" << endl;
+    stats << "     Pushed: " << stats_.pushed.load(memory_order_relaxed) << ", Sent: " << stats_.sent.load(memory_order_relaxed);
+    stats << ", Failed: " << stats_.failed.load(memory_order_relaxed) << ", Dropped: " << stats_.dropped.load(memory_order_relaxed) << endl;
+    for (size_t idx = 0; idx < http_.size(); idx++) stats << "     " << http_url_[idx] << endl << http_[idx]->Stats();
+
+    return (stats.str());
+  }
+
+private:
+
+  struct Datagram {
+    string url;
+    int sock{-1};
+    struct sockaddr_storage addr{};
+    socklen_t len{0};
+  };
+
+  static string Open(Datagram& datagram) {
+    //
+    // Resolve the sink address and open its socket
+    //
+    memset(&datagram.addr, 0, sizeof(datagram.addr));
+
+    if (!datagram.url.compare(0, 5, "unix:")) {
+      // unix:/path or unix:///path
+      string path = datagram.url.substr(5);
+      if (!path.compare(0, 2, "//")) path = path.substr(2);
+
+      struct sockaddr_un* addr = (struct sockaddr_un*)&datagram.addr;
+      if (path.empty() || path.size() >= sizeof(addr->sun_path)) return ("invalid path");
+
+      addr->sun_family = AF_UNIX;
+      strcpy(addr->sun_path, path.c_str());
+      datagram.len = sizeof(struct sockaddr_un);
+    }
+    else {
+      // udp://host:port
+      string host = datagram.url.substr(6);
+      size_t pos = host.rfind(':');
+      if (pos == string::npos) return ("missing port");
+
+      string port = host.substr(pos + 1);
+      host = host.substr(0, pos);
+      if (!host.empty() && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+
+      struct addrinfo hints;
+      struct addrinfo* info = nullptr;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_DGRAM;
+
+      int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &info);
+      if (err) return (string("getaddrinfo(): ") + gai_strerror(err));
+
+      memcpy(&datagram.addr, info->ai_addr, info->ai_addrlen);
+      datagram.len = info->ai_addrlen;
+      freeaddrinfo(info);
+    }
+
+    datagram.sock = socket(datagram.addr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (datagram.sock == -1) return (string("socket(): ") + strerror(errno));
+
+    return ("");
+  }
+
+  void Work(void) {
+    //
+    // Post queued messages to the HTTP sinks as soon as they arrive
+    //
+    vector<HttpTransport*> client;
+    for (unique_ptr<HttpTransport>& http: http_) client.push_back(http.get());
+
+    deque<string> batch;
+
+    while (true) {
+      {
+        unique_lock<mutex> lock{access_};
+        wake_.wait(lock, [this]{ return (exit_ || !queue_.empty()); });
+        if (exit_) return;
+        batch.swap(queue_);
+      }
+
+      for (const string& message: batch) {
+        for (HttpTransport* http: client) http->Post(message, 0);
+      }
+      batch.clear();
+
+      while (any_of(client.begin(), client.end(), [](const HttpTransport* c){ return (c->Pending() > 0); })) {
+        HttpTransport::Run(client, 1000, [this](size_t, const HttpResult& result) {
+          ((result.status && result.status < 300)? stats_.sent: stats_.failed).fetch_add(1, memory_order_relaxed);
+        });
+
+        scoped_lock<mutex> lock{access_};
+        if (exit_) return;
+      }
+    }
+  }
+
+  const string name_;
+  const size_t queue_max_;
+
+  vector<Datagram> datagram_;
+  vector<unique_ptr<HttpTransport>> http_;                      // used by the lane thread only
+  vector<string> http_url_;
+  vector<string> error_;                                        // sinks that couldn't be set up
+
+  thread thread_;
+  mutex access_;
+  condition_variable wake_;
+  deque<string> queue_;
+  bool exit_{false};
+
+  // Lane Statistics
+  struct {
+    atomic<uint64_t> pushed{0};
+    atomic<uint64_t> sent{0};                                   // per sink
+    atomic<uint64_t> failed{0};
+    atomic<uint64_t> dropped{0};                                // HTTP queue full
+  }
+  stats_;
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_LANE
@@ -0,0 +1,181 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: per destination rate limiting and circuit breaking
+//
+
+#ifndef TEMPEST_LIMIT
+#define TEMPEST_LIMIT
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Both classes take the current time (monotonic seconds) as an argument instead of reading the clock
+// so the transmitter reads it once per request
+//
+
+class TokenBucket {
+public:
+
+  //
+  // rate: tokens added per second (0: unlimited)
+  // capacity: maximum burst
+  //
+  TokenBucket(double rate = 0, double capacity = 1): rate_{rate}, capacity_{max(capacity, 1.0)}, tokens_{capacity_}, time_{0} {}
+
+  inline bool Unlimited(void) const { return (rate_ <= 0); }
+  inline double Rate(void) const { return (rate_); }
+  inline double Capacity(void) const { return (capacity_); }
+
+  double Tokens(double now) {
+    Refill(now);
+    return (tokens_);
+  }
+
+  bool Take(double now) {
+    //
+    // Return true and consume a token if one is available
+    //
+    if (Unlimited()) return (true);
+
+    Refill(now);
+    if (tokens_ < 1) return (false);
+
+    tokens_ -= 1;
+    return (true);
+  }
+
+private:
+
+  void Refill(double now) {
+    if (time_) tokens_ = min(capacity_, tokens_ + (now - time_) * rate_);
+    time_ = now;
+  }
+
+  const double rate_;
+  const double capacity_;
+
+  double tokens_;
+  double time_;                                                 // last refill
+};
+
+class CircuitBreaker {
+public:
+
+  enum State {
+    CLOSED,                                                     // requests flow
+    OPEN,                                                       // requests rejected until the backoff expires
+    HALF_OPEN                                                   // a single probe request is let through
+  };
+
+  //
+  // threshold: consecutive failures that open the breaker
+  // backoff_min, backoff_max: open time after the first failure, doubled on each failed probe up to the max
+  //
+  CircuitBreaker(int threshold = 5, double backoff_min = 10, double backoff_max = 600):
+    threshold_{threshold}, backoff_min_{backoff_min}, backoff_max_{backoff_max}, backoff_{backoff_min} {}
+
+  inline State GetState(void) const { return (state_); }
+  inline int Failures(void) const { return (failures_); }
+  inline double Backoff(void) const { return (backoff_); }
+  inline uint Trips(void) const { return (trips_); }
+
+  double RetryIn(double now) const { return (state_ == State::OPEN? max(retry_ - now, 0.0): 0); }
+
+  bool Allow(double now) {
+    //
+    // Return whether a request can be sent now: when the backoff expires the breaker goes half-open
+    // and lets exactly one probe through, whose outcome is reported by Success() or Failure()
+    //
+    switch (state_) {
+    case State::CLOSED:
+      return (true);
+
+    case State::OPEN:
+      if (now < retry_) return (false);
+      state_ = State::HALF_OPEN;
+      probe_ = true;
+      return (true);
+
+    case State::HALF_OPEN:
+    default:
+      // Only one probe in flight
+      if (probe_) return (false);
+      probe_ = true;
+      return (true);
+    }
+  }
+
+  void Success(void) {
+    state_ = State::CLOSED;
+    failures_ = 0;
+    backoff_ = backoff_min_;
+    probe_ = false;
+  }
+
+  void Failure(double now) {
+    failures_++;
+
+    if (state_ == State::HALF_OPEN) {
+      // The probe failed: stay away longer
+      backoff_ = min(backoff_ * 2, backoff_max_);
+      Open(now);
+    }
+    else if (state_ == State::CLOSED && failures_ >= threshold_) {
+      backoff_ = backoff_min_;
+      Open(now);
+    }
+  }
+
+  static const char* StateName(State state) {
+    switch (state) {
+    case State::CLOSED:    return ("closed");
+    case State::OPEN:      return ("open");
+    case State::HALF_OPEN: return ("half-open");
+    default:               return ("?");
+    }
+  }
+
+private:
+
+  void Open(double now) {
+    state_ = State::OPEN;
+    retry_ = now + backoff_;
+    probe_ = false;
+    trips_++;
+  }
+
+  const int threshold_;
+  const double backoff_min_;
+  const double backoff_max_;
+
+  State state_{State::CLOSED};
+  int failures_{0};                                             // consecutive
+  double backoff_;
+  double retry_{0};                                             // when an open breaker goes half-open
+  bool probe_{false};
+  uint trips_{0};                                               // times it opened
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_LIMIT
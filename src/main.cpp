@@ -35,9 +35,30 @@
 #include "log.hpp"
 #include "args.hpp"
 #include "convert.hpp"
+#include "meteo.hpp"
 #include "ipc.hpp"
+#include "buffer.hpp"
+#include "ring.hpp"
+#include "worker.hpp"
+#include "sched.hpp"
+#include "wheel.hpp"
+#include "limit.hpp"
+#include "compress.hpp"
+#include "http.hpp"
+#include "curl.hpp"
+#include "check.hpp"
+#include "lane.hpp"
+#include "rules.hpp"
+#include "sketch.hpp"
+#include "fleet.hpp"
+#include "qc.hpp"
+#include "health.hpp"
+#include "clock.hpp"
+#include "channels.hpp"
+#include "stream.hpp"
 #include "codec.hpp"
 #include "relay.hpp"
+#include "config.hpp"
 
 // Source ---------------------------------------------------------------------------------------------------------------------
 
@@ -94,6 +115,41 @@ int main(int argc, char* const argv[]) {
       //
       ostringstream oss;
 
+      //
+      // Read the configuration file, compile the alert rules and load the sensor channels, if any, while errors can still
+      // reach the terminal
+      //
+      if (!args.GetConfigError().empty()) {
+        oss << "Error loading configuration " << args.GetConfigFile() << ": " << args.GetConfigError() << "." << endl;
+        TLOG_ERROR(log) << oss.str();
+        cerr << oss.str();
+        throw runtime_error("Config::Load()");
+      }
+
+      Relay::Options options = args.GetRelayOptions();
+
+      if (!options.alerts_file.empty()) {
+        string error;
+
+        if (!(options.rules = Rules::Load(options.alerts_file, error))) {
+          oss << "Error loading alert rules " << options.alerts_file << ": " << error << "." << endl;
+          TLOG_ERROR(log) << oss.str();
+          cerr << oss.str();
+          throw runtime_error("Rules::Load()");
+        }
+      }
+
+      if (!options.channels_file.empty()) {
+        string error;
+
+        if (!Channels::Load(options.channels_file, options.channels, error)) {
+          oss << "Error loading sensor channels " << options.channels_file << ": " << error << "." << endl;
+          TLOG_ERROR(log) << oss.str();
+          cerr << oss.str();
+          throw runtime_error("Channels::Load()");
+        }
+      }
+
       if (args.IsCommandDaemon() && (err = daemon(0,0))) {
         oss << "Error demonizing " << argv[0] << ": " << strerror(err) << "." << endl;
         TLOG_ERROR(log) << oss.str();
@@ -117,12 +173,15 @@ int main(int argc, char* const argv[]) {
       //
       // Start relay
       // 
-      Relay relay{url, interval, facility, level};
 
-      // Worker thread should not receive signals
+      // No thread but this one should receive signals: block them before the relay starts its own (worker pool, lanes,
+      // stream server), which inherit the mask
       ipc.BlockSignals();
 
+      Relay relay{url, interval, facility, level, options};
+
       future<int> rx = async(launch::async, &Relay::Receiver, &relay);
+      future<int> px = async(launch::async, &Relay::Parser, &relay);
       future<int> tx = async(launch::async, &Relay::Transmitter, &relay);
 
       //
@@ -137,8 +196,9 @@ int main(int argc, char* const argv[]) {
       relay.Stop();
 
       int err_rx = rx.get();
+      int err_px = px.get();
       int err_tx = tx.get();
-      if (!err) err = err_rx? err_rx: err_tx;
+      if (!err) err = err_rx? err_rx: (err_px? err_px: err_tx);
     }
     else if (args.IsCommandStop(text)) {
       //
@@ -181,6 +241,50 @@ int main(int argc, char* const argv[]) {
         cout << text;
       }
     }
+    else if (args.IsCommandGaps(text)) {
+      //
+      // Print missing observation intervals
+      //
+      pid_t pid;
+      ostringstream oss;
+
+      if ((err = ipc.Initialize()) || (err = ipc.ClientCommand(Rpc::Command::GAPS, pid))) {
+        if (err == ENOENT) oss << argv[0] << " not running." << endl;
+        else oss << "Error getting gaps from " << argv[0] << "(" << pid << "): " << strerror(err) << "." << endl;
+        TLOG_ERROR(log) << oss.str();
+        cerr << oss.str();
+      }
+      else if (err = ipc.ClientSignals(text)) {
+        oss << "Error handling IPC: " << strerror(err) << "." << endl;
+        TLOG_ERROR(log) << oss.str();
+        cerr << oss.str();
+      }
+      else {
+        cout << text;
+      }
+    }
+    else if (args.IsCommandQuantiles(text)) {
+      //
+      // Print measurement distributions
+      //
+      pid_t pid;
+      ostringstream oss;
+
+      if ((err = ipc.Initialize()) || (err = ipc.ClientCommand(Rpc::Command::QUANTILES, pid))) {
+        if (err == ENOENT) oss << argv[0] << " not running." << endl;
+        else oss << "Error getting quantiles from " << argv[0] << "(" << pid << "): " << strerror(err) << "." << endl;
+        TLOG_ERROR(log) << oss.str();
+        cerr << oss.str();
+      }
+      else if (err = ipc.ClientSignals(text)) {
+        oss << "Error handling IPC: " << strerror(err) << "." << endl;
+        TLOG_ERROR(log) << oss.str();
+        cerr << oss.str();
+      }
+      else {
+        cout << text;
+      }
+    }
     else if (args.IsCommandVersion(text)) {
       //
       // Version
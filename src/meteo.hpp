@@ -0,0 +1,357 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: derived meteorological quantities
+//
+
+#ifndef TEMPEST_METEO
+#define TEMPEST_METEO
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "convert.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+class Meteo {
+public:
+
+  // -----------------------------------------------------------
+
+  static double DewPoint(double temperature, double humidity) {
+    //
+    // Magnus formula (Alduchov & Eskridge coefficients), in °C
+    //
+    const double b = 17.625, c = 243.04;
+    double gamma = log(max(humidity, 1.0) / 100) + (b * temperature) / (c + temperature);
+
+    return ((c * gamma) / (b - gamma));
+  }
+
+  // -----------------------------------------------------------
+
+  static double HeatIndex(double temperature, double humidity) {
+    //
+    // NWS heat index (Steadman simple formula, Rothfusz regression above 80°F with its adjustments), in °C
+    //
+    double t = Convert::C_to_F(temperature), rh = humidity;
+    double hi = 0.5 * (t + 61 + ((t - 68) * 1.2) + (rh * 0.094));
+
+    if ((hi + t) / 2 >= 80) {
+      hi = -42.379 + 2.04901523 * t + 10.14333127 * rh - 0.22475541 * t * rh - 0.00683783 * t * t - 0.05481717 * rh * rh
+           + 0.00122874 * t * t * rh + 0.00085282 * t * rh * rh - 0.00000199 * t * t * rh * rh;
+
+      if (rh < 13 && t >= 80 && t <= 112) hi -= ((13 - rh) / 4) * sqrt((17 - fabs(t - 95)) / 17);
+      else if (rh > 85 && t >= 80 && t <= 87) hi += ((rh - 85) / 10) * ((87 - t) / 5);
+    }
+
+    return (Convert::F_to_C(hi));
+  }
+
+  // -----------------------------------------------------------
+
+  static double WindChill(double temperature, double wind) {
+    //
+    // NWS wind chill (wind in m/s), in °C: only defined at or below 50°F with wind above 3 mph
+    //
+    double t = Convert::C_to_F(temperature), v = Convert::km_to_mi(Convert::ms_to_kmh(wind));
+
+    if (t > 50 || v <= 3) return (temperature);
+
+    double p = pow(v, 0.16);
+    return (Convert::F_to_C(35.74 + 0.6215 * t - 35.75 * p + 0.4275 * t * p));
+  }
+
+  // -----------------------------------------------------------
+
+  static double WetBulb(double temperature, double humidity) {
+    //
+    // Stull (2011) empirical formula, in °C
+    //
+    double t = temperature, rh = max(humidity, 1.0);
+
+    return (t * atan(0.151977 * sqrt(rh + 8.313659)) + atan(t + rh) - atan(rh - 1.676331) + 0.00391838 * pow(rh, 1.5) * atan(0.023101 * rh) - 4.686035);
+  }
+};
+
+//
+// Per station settings and the constants derived from them, computed once
+//
+
+class Station {
+public:
+
+  //
+  // elevation: meters, for the sea-level pressure
+  // trend_short, trend_long: pressure trend windows in seconds
+  //
+  explicit Station(double elevation = 0, int trend_short = 3600, int trend_long = 10800):
+    elevation_{elevation}, trend_short_{trend_short}, trend_long_{trend_long} {
+    // Sea-level reduction (standard atmosphere): everything but the station pressure is constant
+    const double p0 = 1013.25, rd = 287.05, lapse = 0.0065, g = 9.80665, t0 = 288.15;
+
+    exponent_ = (rd * lapse) / g;
+    height_ = (lapse * elevation) / t0;
+    p0_exp_ = pow(p0, exponent_);
+  }
+
+  inline double Elevation(void) const { return (elevation_); }
+  inline int TrendShort(void) const { return (trend_short_); }
+  inline int TrendLong(void) const { return (trend_long_); }
+
+  double SeaLevel(double pressure) const {
+    //
+    // Station pressure reduced to sea level, in hPa
+    //
+    if (!elevation_ || pressure <= 0) return (pressure);
+
+    return (pressure * pow(1 + (p0_exp_ / pow(pressure, exponent_)) * height_, 1 / exponent_));
+  }
+
+private:
+
+  double elevation_;                                            // meters
+  int trend_short_;                                             // seconds
+  int trend_long_;                                              // seconds
+  double exponent_;                                             // Rd * lapse rate / g
+  double height_;                                               // lapse rate * elevation / T0
+  double p0_exp_;                                               // P0 ^ exponent
+};
+
+//
+// Values derived from an observation, recomputed only when its inputs change so encoders just read them
+//
+
+class Derived {
+public:
+
+  bool Update(const Station& station, double temperature, double humidity, double pressure, double wind) {
+    //
+    // Return true if the inputs changed and the values were recomputed
+    //
+    if (valid_ && temperature == temperature_ && humidity == humidity_ && pressure == pressure_ && wind == wind_) {
+      cached_++;
+      return (false);
+    }
+
+    temperature_ = temperature;
+    humidity_ = humidity;
+    pressure_ = pressure;
+    wind_ = wind;
+    valid_ = true;
+
+    dew_point = Meteo::DewPoint(temperature, humidity);
+    heat_index = Meteo::HeatIndex(temperature, humidity);
+    wind_chill = Meteo::WindChill(temperature, wind);
+    wet_bulb = Meteo::WetBulb(temperature, humidity);
+    sea_level = station.SeaLevel(pressure);
+
+    // Feels like: heat index when hot, wind chill when cold, the air temperature otherwise
+    double t = Convert::C_to_F(temperature);
+    feels_like = (t >= 80)? heat_index: (t <= 50)? wind_chill: temperature;
+
+    updates_++;
+    return (true);
+  }
+
+  inline bool Valid(void) const { return (valid_); }
+  inline uint Updates(void) const { return (updates_); }
+  inline uint Cached(void) const { return (cached_); }
+
+  double dew_point{0};                                          // °C
+  double feels_like{0};                                         // °C
+  double heat_index{0};                                         // °C
+  double wind_chill{0};                                         // °C
+  double wet_bulb{0};                                           // °C
+  double sea_level{0};                                          // hPa
+
+private:
+
+  // Inputs the values were computed from
+  double temperature_{0};
+  double humidity_{0};
+  double pressure_{0};
+  double wind_{0};
+  bool valid_{false};
+
+  uint updates_{0};                                             // recomputed
+  uint cached_{0};                                              // same inputs, nothing to do
+};
+
+//
+// Sliding window least-squares slope of a series (i.e. pressure), in O(1) per sample and fixed memory
+// The running sums are kept relative to the oldest sample, so they stay small, and recomputed from scratch
+// once every capacity samples so rounding errors can't build up
+//
+
+class Trend {
+public:
+
+  enum Tendency {
+    UNKNOWN,                                                    // not enough samples yet
+    FALLING_VERY_RAPIDLY,
+    FALLING_QUICKLY,
+    FALLING,
+    FALLING_SLOWLY,
+    STEADY,
+    RISING_SLOWLY,
+    RISING,
+    RISING_QUICKLY,
+    RISING_VERY_RAPIDLY
+  };
+
+  //
+  // window: seconds of history
+  // resolution: shortest expected spacing between samples, to size the buffer
+  //
+  explicit Trend(int window = 3600, int resolution = 60): window_{window}, sample_((size_t)(window / resolution) + 1) {}
+
+  inline int Window(void) const { return (window_); }
+  inline size_t Size(void) const { return (size_); }
+
+  void Add(time_t time, double value) {
+    //
+    // Samples must come in chronological order: drop the ones out of the window, or the oldest if full
+    //
+    while (size_ && (time - Item(0).time > window_ || size_ == sample_.size())) Evict();
+
+    if (!size_) {
+      origin_ = time;
+      base_ = value;
+    }
+
+    Item(size_++) = {time, value};
+    Sum(time - origin_, value - base_, 1);
+
+    if (++added_ % sample_.size() == 0) Resum();
+  }
+
+  bool Valid(void) const {
+    //
+    // At least three samples covering half the window
+    //
+    return (size_ >= 3 && (Item(size_ - 1).time - Item(0).time) * 2 >= window_);
+  }
+
+  double Slope(void) const {
+    //
+    // Units per second (0 if not valid)
+    //
+    if (!Valid()) return (0);
+
+    double n = size_;
+    double den = n * sum_tt_ - sum_t_ * sum_t_;
+
+    return (den? ((n * sum_tv_ - sum_t_ * sum_v_) / den): 0);
+  }
+
+  inline double Change(void) const { return (Slope() * window_); }
+
+  static Tendency Classify(double change_3h) {
+    //
+    // WMO/Met Office pressure tendency categories from the change over 3 hours (hPa)
+    //
+    double delta = fabs(change_3h);
+    int level = (delta < 0.1)? 0: (delta < 1.6)? 1: (delta < 3.6)? 2: (delta < 6.0)? 3: 4;
+
+    return ((Tendency)(Tendency::STEADY + ((change_3h < 0)? -level: level)));
+  }
+
+  Tendency GetTendency(void) const { return (Valid()? Classify(Slope() * 10800): Tendency::UNKNOWN); }
+
+  static const char* TendencyName(Tendency tendency) {
+    switch (tendency) {
+    case Tendency::FALLING_VERY_RAPIDLY: return ("falling very rapidly");
+    case Tendency::FALLING_QUICKLY:      return ("falling quickly");
+    case Tendency::FALLING:              return ("falling");
+    case Tendency::FALLING_SLOWLY:       return ("falling slowly");
+    case Tendency::STEADY:               return ("steady");
+    case Tendency::RISING_SLOWLY:        return ("rising slowly");
+    case Tendency::RISING:               return ("rising");
+    case Tendency::RISING_QUICKLY:       return ("rising quickly");
+    case Tendency::RISING_VERY_RAPIDLY:  return ("rising very rapidly");
+    default:                             return ("unknown");
+    }
+  }
+
+private:
+
+  struct Sample {
+    time_t time;
+    double value;
+  };
+
+  inline Sample& Item(size_t idx) { return (sample_[(first_ + idx) % sample_.size()]); }
+  inline const Sample& Item(size_t idx) const { return (sample_[(first_ + idx) % sample_.size()]); }
+
+  void Sum(double t, double v, int sign) {
+    sum_t_ += sign * t;
+    sum_v_ += sign * v;
+    sum_tt_ += sign * t * t;
+    sum_tv_ += sign * t * v;
+  }
+
+  void Evict(void) {
+    const Sample& oldest = Item(0);
+    Sum(oldest.time - origin_, oldest.value - base_, -1);
+
+    first_ = (first_ + 1) % sample_.size();
+    size_--;
+
+    if (!size_) {
+      sum_t_ = sum_v_ = sum_tt_ = sum_tv_ = 0;
+      return;
+    }
+
+    // Move the time origin to the new oldest sample: sum((t - d)^2) = sum(t^2) - 2d sum(t) + n d^2 ...
+    double d = Item(0).time - origin_, n = size_;
+    sum_tt_ += -2 * d * sum_t_ + n * d * d;
+    sum_tv_ -= d * sum_v_;
+    sum_t_ -= n * d;
+    origin_ = Item(0).time;
+  }
+
+  void Resum(void) {
+    sum_t_ = sum_v_ = sum_tt_ = sum_tv_ = 0;
+    if (!size_) return;
+
+    origin_ = Item(0).time;
+    base_ = Item(0).value;
+    for (size_t idx = 0; idx < size_; idx++) Sum(Item(idx).time - origin_, Item(idx).value - base_, 1);
+  }
+
+  int window_;
+  vector<Sample> sample_;                                       // ring, allocated once
+  size_t first_{0};
+  size_t size_{0};
+  size_t added_{0};
+
+  // Running sums, time relative to origin_ and value relative to base_
+  time_t origin_{0};
+  double base_{0};
+  double sum_t_{0};
+  double sum_v_{0};
+  double sum_tt_{0};
+  double sum_tv_{0};
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_METEO
@@ -0,0 +1,232 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: sensor data quality control
+//
+
+#ifndef TEMPEST_QC
+#define TEMPEST_QC
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Every observation goes through four checks, each quantity on its own:
+// - range:  outside what the instrument can measure
+// - step:   farther from the median of the last three good values than the quantity can move in the time elapsed
+//           (a spike is a step that comes back); three steps in a row are a real change and the window starts over
+// - stuck:  the same value, bit for bit, for too many observations in a row (values at the edge of the range, like
+//           calm wind or saturated humidity, are left alone)
+// - status: the device reports the sensor failed
+// The state is a few values per quantity: the cost per observation is a handful of comparisons
+//
+
+class Qc {
+public:
+
+  enum Quantity {
+    TEMPERATURE,
+    HUMIDITY,
+    PRESSURE,
+    ILLUMINANCE,
+    UV,
+    SOLAR_RADIATION,
+    RAIN_RATE,
+    WIND_LULL,
+    WIND_SPEED,
+    WIND_GUST,
+    WIND_DIRECTION,
+    LIGHTNING,
+    QUANTITIES
+  };
+
+  enum Check {
+    RANGE,
+    STEP,
+    STUCK,
+    STATUS,
+    CHECKS
+  };
+
+  static const uint32_t wind_ = (1u << WIND_LULL) | (1u << WIND_SPEED) | (1u << WIND_GUST) | (1u << WIND_DIRECTION);
+  static const uint32_t light_ = (1u << ILLUMINANCE) | (1u << UV) | (1u << SOLAR_RADIATION);
+
+  static const char* QuantityName(Quantity quantity) {
+    static const char* const name[Quantity::QUANTITIES] = {
+      "temperature", "humidity", "pressure", "illuminance", "uv", "solar_radiation", "rain_rate",
+      "wind_lull", "wind_speed", "wind_gust", "wind_direction", "lightning"
+    };
+
+    return (name[quantity]);
+  }
+
+  static const char* CheckName(Check check) {
+    static const char* const name[Check::CHECKS] = {"range", "step", "stuck", "status"};
+
+    return (name[check]);
+  }
+
+  static string List(uint32_t mask) {
+    //
+    // Comma separated names of the quantities in mask
+    //
+    string list;
+
+    for (int quantity = 0; quantity < Quantity::QUANTITIES; quantity++) {
+      if (!(mask & (1u << quantity))) continue;
+      if (!list.empty()) list += ',';
+      list += QuantityName((Quantity)quantity);
+    }
+
+    return (list);
+  }
+
+  static inline bool Good(uint32_t flagged, Quantity quantity) { return (!(flagged & (1u << quantity))); }
+
+  uint32_t Verify(time_t time, const double value[], uint32_t measured, uint32_t failed, bool order) {
+    //
+    // Check one observation: value is indexed by Quantity, measured is the mask of the quantities it carries and failed
+    // the ones the device reports as failed; late (out of order) observations only get the range and status checks
+    // Return the mask of the flagged quantities
+    //
+    uint32_t flagged = 0;
+
+    checked_++;
+
+    for (int quantity = 0; quantity < Quantity::QUANTITIES; quantity++) {
+      uint32_t bit = 1u << quantity;
+      if (!(measured & bit)) continue;
+
+      const Limit& limit = limit_[quantity];
+      Track& track = track_[quantity];
+      double v = value[quantity];
+
+      if (failed & bit) {
+        flags_[Check::STATUS]++;
+        flagged |= bit;
+        continue;
+      }
+
+      if (v < limit.low || v > limit.high) {
+        flags_[Check::RANGE]++;
+        flagged |= bit;
+        continue;
+      }
+
+      if (!order) continue;
+
+      // Stuck: identical readings away from the range edges
+      if (limit.stuck && v == track.last && v != limit.low && v != limit.high) {
+        if (++track.repeat >= limit.stuck) {
+          flags_[Check::STUCK]++;
+          flagged |= bit;
+        }
+      }
+      else track.repeat = 0;
+      track.last = v;
+
+      if (flagged & bit) continue;
+
+      // Step: against the median of the last good values, scaled by the minutes elapsed since the latest of them
+      if (limit.step && track.size) {
+        double minutes = max(1.0, difftime(time, track.time) / 60);
+        if (fabs(v - track.Median()) > limit.step * minutes) {
+          if (++track.rejected < 3) {
+            flags_[Check::STEP]++;
+            flagged |= bit;
+            continue;
+          }
+
+          // The new level held: it's real
+          track.size = 0;
+        }
+      }
+
+      track.rejected = 0;
+      track.Push(v, time);
+    }
+
+    flagged_ = flagged;
+    return (flagged);
+  }
+
+  inline uint32_t Flagged(void) const { return (flagged_); }
+  inline uint64_t Checked(void) const { return (checked_); }
+  inline uint64_t Flags(Check check) const { return (flags_[check]); }
+
+private:
+
+  struct Limit {
+    double low;
+    double high;
+    double step;                                                // most a good value moves in a minute (0: no check)
+    uint stuck;                                                 // identical observations in a row (0: no check)
+  };
+
+  struct Track {
+    double window[3];                                           // latest good values
+    uint8_t size{0};
+    uint8_t next{0};
+    time_t time{0};                                             // latest good value
+    double last{0};                                             // latest value
+    uint repeat{0};                                             // times last has been repeated
+    uint rejected{0};                                           // steps in a row
+
+    void Push(double value, time_t t) {
+      window[next] = value;
+      next = (next + 1) % 3;
+      if (size < 3) size++;
+      time = t;
+    }
+
+    double Median(void) const {
+      if (size < 3) return (window[(next + 2) % 3]);
+
+      double a = window[0], b = window[1], c = window[2];
+      return (max(min(a, b), min(max(a, b), c)));
+    }
+  };
+
+  // Instrument ranges (Tempest, Air and Sky specifications, with some headroom)
+  static constexpr Limit limit_[Quantity::QUANTITIES] = {
+    {-40,    60,      3,    120},                               // temperature (°C)
+    {0,      100,     15,   180},                               // humidity (%)
+    {500,    1100,    3,    240},                               // pressure (hPa)
+    {0,      200000,  0,    0},                                 // illuminance (lux)
+    {0,      20,      0,    0},                                 // uv (index)
+    {0,      1800,    0,    0},                                 // solar radiation (W/m²)
+    {0,      300,     0,    0},                                 // rain rate (mm/h)
+    {0,      70,      0,    60},                                // wind lull (m/s)
+    {0,      70,      0,    60},                                // wind speed (m/s)
+    {0,      70,      0,    60},                                // wind gust (m/s)
+    {0,      360,     0,    0},                                 // wind direction (°)
+    {0,      40,      0,    0}                                  // lightning distance (km)
+  };
+
+  Track track_[Quantity::QUANTITIES];
+  uint32_t flagged_{0};                                         // latest observation
+  uint64_t checked_{0};
+  uint64_t flags_[Check::CHECKS]{};
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_QC
@@ -15,6 +15,18 @@
 #include "system.hpp"
 
 #include "log.hpp"
+#include "buffer.hpp"
+#include "ring.hpp"
+#include "worker.hpp"
+#include "sched.hpp"
+#include "wheel.hpp"
+#include "limit.hpp"
+#include "compress.hpp"
+#include "http.hpp"
+#include "curl.hpp"
+#include "rules.hpp"
+#include "lane.hpp"
+#include "stream.hpp"
 #include "codec.hpp"
 
 // Source ---------------------------------------------------------------------------------------------------------------------
@@ -26,8 +38,69 @@ using namespace std;
 class Relay: Tempest {
 public:
 
-  Relay(const string& url, int interval, Log::Facility facility, Log::Level level, int port = 50222, int buffer_max = 1024, int queue_max = 128, int io_timeout = 1):
-    Tempest(queue_max), url_{url}, interval_{interval * 60}, facility_{facility}, level_{level}, port_{port}, buffer_max_{buffer_max}, io_timeout_{io_timeout} {}
+  struct Target {
+    string url;
+    int interval = 5;                                           // minutes
+    Tempest::Format format = Tempest::Format::ECOWITT;
+    double rate_limit = 0;                                      // requests per minute (0: unlimited)
+    int rate_burst = 10;
+    Compressor::Encoding compress = Compressor::Encoding::IDENTITY;
+  };
+
+  struct Options {
+    int port = 50222;
+    int buffer_min = 1024;                                      // smallest receive buffer size class
+    int queue_max = 128;
+    int io_timeout = 1;
+    int receive_buffer = 0;                                     // socket receive buffer in bytes (0: system default)
+    int ring_depth = 256;                                       // datagrams buffered between the receive and parse stages
+    int batch_max = 32;                                         // datagrams parsed per lock acquisition
+    int workers = 0;                                            // parse/encode worker threads (0: one per core)
+    vector<int> cpu_receiver;                                   // CPUs the receiver is pinned to (empty: any)
+    vector<int> cpu_transmitter;                                // CPUs the transmitter is pinned to (empty: any)
+    vector<int> cpu_workers;                                    // CPUs the parser and workers are spread over (empty: any)
+    int fifo_priority = 0;                                      // SCHED_FIFO priority of the receiver (0: SCHED_OTHER)
+    bool lock_memory = false;                                   // mlockall() at startup
+    double rate_limit = 0;                                      // requests per minute per destination (0: unlimited)
+    int rate_burst = 10;                                        // requests a destination can take back to back
+    int breaker_threshold = 5;                                  // consecutive failures that open a destination breaker
+    int backoff_min = 10;                                       // seconds a breaker stays open the first time
+    int backoff_max = 600;                                      // cap of the exponential backoff
+    HttpOptions http;                                           // request timeouts and pipelining
+    Compressor::Encoding compress = Compressor::Encoding::IDENTITY; // preferred request body encoding
+    int compress_min = 256;                                     // smaller bodies are always sent as is
+    double elevation = 0;                                       // station elevation in meters, for sea-level pressure
+    int trend_short = 3600;                                     // pressure trend windows in seconds
+    int trend_long = 10800;
+    string alerts_file;                                         // alert rules file (empty: none)
+    shared_ptr<const Rules> rules;                              // compiled from alerts_file at startup
+    vector<string> strike_sinks;                                // lightning fast path sinks (empty: none)
+    int stream_port = 0;                                        // SSE/WebSocket server port (0: none)
+    string stream_address = "127.0.0.1";                        // SSE/WebSocket server address (0.0.0.0: every interface)
+    int stream_queue = 64;                                      // frames queued per stream subscriber
+    bool deskew = false;                                        // correct the Ecowitt dateutc by the hub clock offset
+    string channels_file;                                       // sensor channel map file (empty: none)
+    map<string, int> channels;                                  // loaded from channels_file at startup
+    map<string, Station> stations;                              // hub serial number -> its own station (others: elevation, trend_*)
+    vector<Target> destinations;                                // besides url (from the configuration file)
+  };
+
+  Relay(const string& url, int interval, Log::Facility facility, Log::Level level, const Options& options):
+    Tempest(options.queue_max, Station{options.elevation, options.trend_short, options.trend_long}, options.rules, Channels{options.channels_file, options.channels}, options.stations),
+    pool_{(size_t)options.buffer_min}, ring_{(size_t)options.ring_depth}, wheel_{Tick()}, io_timeout_{options.io_timeout},
+    receive_buffer_{options.receive_buffer}, batch_max_{(size_t)options.batch_max}, port_{options.port}, url_{url}, interval_{interval * 60}, level_{level}, facility_{facility},
+    cpu_receiver_{options.cpu_receiver}, cpu_transmitter_{options.cpu_transmitter}, cpu_workers_{options.cpu_workers}, fifo_priority_{options.fifo_priority},
+    lock_memory_{options.lock_memory}, compress_min_{(size_t)options.compress_min}, workers_{(size_t)options.workers, [this](size_t idx){ Schedule("Worker " + to_string(idx), WorkerCpu(idx)); }} {
+
+    destination_.reserve(options.destinations.size() + 1);
+    if (!url_.empty()) destination_.emplace_back(Target{url_, interval, Tempest::Format::ECOWITT, options.rate_limit, options.rate_burst, options.compress}, options);
+    for (const Target& target: options.destinations) destination_.emplace_back(target, options);
+    if (options.rules) alert_lane_ = make_unique<Lane>("Alert", options.rules->Sinks(), options.http);
+    if (!options.strike_sinks.empty()) strike_lane_ = make_unique<Lane>("Strike", options.strike_sinks, options.http);
+    if (options.stream_port) stream_ = make_unique<StreamServer>(options.stream_address, options.stream_port, (size_t)options.stream_queue, [this]{ return (Metrics()); });
+
+    SetDeskew(options.deskew);
+  }
 
   inline void Stop(void) { Exit(); }
 
@@ -35,7 +108,7 @@ public:
     int err = EXIT_SUCCESS;
     int sock = -1;
 
-    bool trace = url_.empty() && !interval_;
+    bool trace = destination_.empty() && !interval_;
 
     // Initialize log stream
     Log log{facility_, level_};
@@ -43,6 +116,20 @@ public:
     try {
       TLOG_INFO(log) << "Receiver started." << endl;
 
+      // Lock the address space before the hot path starts so it never page faults
+      if (lock_memory_) {
+        error_t err_lock = Sched::LockMemory();
+        if (err_lock) TLOG_WARNING(log) << "mlockall() failed: " << strerror(err_lock) << "." << endl;
+        memory_locked_ = !err_lock;
+      }
+
+      Schedule("Receiver", cpu_receiver_, fifo_priority_);
+
+      if (strike_lane_) {
+        for (const string& error: strike_lane_->Errors()) TLOG_ERROR(log) << "Strike sink " << error << "." << endl;
+      }
+      string strike;
+
       // Create a best-effort datagram socket using UDP
       if ((sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
         TLOG_ERROR(log) << "socket() failed: " << strerror(errno) << "." << endl;
@@ -61,21 +148,58 @@ public:
         throw runtime_error("bind()");
       }
 
+      // Size the kernel receive queue so bursts don't overflow it
+      int opt = receive_buffer_;
+      socklen_t opt_len = sizeof(opt);
+
+      if (opt && setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &opt, sizeof(opt)) == -1 && setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) == -1) {
+        TLOG_WARNING(log) << "setsockopt(SO_RCVBUF) failed: " << strerror(errno) << "." << endl;
+      }
+
+      if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &opt, &opt_len) == 0) {
+        TLOG_INFO(log) << "Socket receive buffer: " << opt << " bytes." << endl;
+        SetSocketBuffer(opt);
+      }
+
+      // Have the kernel report the number of datagrams it dropped along with each one received
+      opt = 1;
+      if (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof(opt)) == -1) {
+        TLOG_WARNING(log) << "setsockopt(SO_RXQ_OVFL) failed: " << strerror(errno) << "." << endl;
+      }
+
+      // And the time it arrived
+      opt = 1;
+      if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &opt, sizeof(opt)) == -1) {
+        TLOG_WARNING(log) << "setsockopt(SO_TIMESTAMP) failed: " << strerror(errno) << "." << endl;
+      }
+
       // Receive a single datagram from the server
       struct sockaddr_in receive_addr;
-      socklen_t receive_addr_len = sizeof(receive_addr);
-      char receive_buffer[buffer_max_];                         // buffer for received data
-      size_t receive_len;                                       // length of received data
+      Buffer receive_buffer;                                    // pooled buffer for received data
+      ssize_t receive_len;                                      // length of received data
+
+      char receive_control[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct timeval))]; // ancillary data (drop counter, arrival)
+      uint32_t receive_dropped = 0;                             // datagrams dropped by the kernel so far
+      double receive_arrival = 0;                               // wall clock time the datagram arrived at
+
+      struct iovec receive_iov;
+      struct msghdr receive_msg;
+      memset(&receive_msg, 0, sizeof(receive_msg));
+      receive_msg.msg_name = &receive_addr;
+      receive_msg.msg_iov = &receive_iov;
+      receive_msg.msg_iovlen = 1;
 
       struct timeval receive_to;
-      receive_to.tv_sec = io_timeout_;
-      receive_to.tv_usec = 0;
       fd_set receive_fds;
 
       do {
         FD_ZERO(&receive_fds);
         FD_SET(sock, &receive_fds);
 
+        // select() updates the timeout with the time not slept
+        receive_to.tv_sec = io_timeout_;
+        receive_to.tv_usec = 0;
+
         switch (select(sock + 1, &receive_fds, NULL, NULL, &receive_to)) {
         case -1:
           TLOG_ERROR(log) << "select() failed: " << strerror(errno) << "." << endl;
@@ -87,28 +211,84 @@ public:
           break;
 
         default:
-          if ((receive_len = recvfrom(sock, receive_buffer, sizeof(receive_buffer) - 1, 0, (struct sockaddr *) &receive_addr, &receive_addr_len)) == -1) {
-            TLOG_ERROR(log) << "recvfrom() failed: " << strerror(errno) << "." << endl;
-            throw runtime_error("recvfrom()");
+          // Peek the real size of the datagram so we can pick a buffer large enough to hold it
+          if ((receive_len = recv(sock, nullptr, 0, MSG_PEEK | MSG_TRUNC)) == -1) {
+            TLOG_ERROR(log) << "recv() failed: " << strerror(errno) << "." << endl;
+            throw runtime_error("recv()");
           }
 
-          if (receive_len < 0 || receive_len >= sizeof(receive_buffer)) {
-            TLOG_ERROR(log) << "recvfrom() returned: " << receive_len << " bytes." << endl;
-            throw runtime_error("recvfrom()");
+          receive_buffer = pool_.Acquire(receive_len);
+          if (receive_buffer.Empty()) {
+            // Larger than any size class: consume and discard it
+            TLOG_WARNING(log) << "Discarded a " << receive_len << " bytes datagram (maximum: " << pool_.MaxSize() << ")." << endl;
+            recv(sock, nullptr, 0, 0);
+            receive_len = 0;
+            break;
+          }
+
+          receive_iov.iov_base = receive_buffer.Data();
+          receive_iov.iov_len = receive_buffer.Capacity() - 1;
+          receive_msg.msg_namelen = sizeof(receive_addr);
+          receive_msg.msg_control = receive_control;
+          receive_msg.msg_controllen = sizeof(receive_control);
+
+          if ((receive_len = recvmsg(sock, &receive_msg, 0)) == -1) {
+            TLOG_ERROR(log) << "recvmsg() failed: " << strerror(errno) << "." << endl;
+            throw runtime_error("recvmsg()");
+          }
+
+          if (receive_msg.msg_flags & MSG_TRUNC) {
+            TLOG_WARNING(log) << "Discarded a truncated datagram." << endl;
+            receive_len = 0;
+            break;
+          }
+
+          // The kernel only attaches the drop counter once it's non zero
+          receive_arrival = 0;
+          for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&receive_msg); cmsg; cmsg = CMSG_NXTHDR(&receive_msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMP) {
+              struct timeval arrival;
+              memcpy(&arrival, CMSG_DATA(cmsg), sizeof(arrival));
+              receive_arrival = arrival.tv_sec + arrival.tv_usec / 1e6;
+            }
+
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+              uint32_t dropped;
+              memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+
+              if (dropped != receive_dropped) {
+                TLOG_WARNING(log) << "Kernel dropped " << (dropped - receive_dropped) << " datagram(s): consider a larger --rcvbuf." << endl;
+                receive_dropped = dropped;
+              }
+            }
           }
         }
 
         if (receive_len) {
           // We got data, let's terminate it
-          receive_buffer[receive_len] = '\0';
+          receive_buffer.Resize(receive_len);
+
+          // Lightning fast path: the strike goes out from here, the datagram still takes the regular way too
+          if (strike_lane_ && Tempest::EncodeStrike(string_view(receive_buffer.Data(), receive_len), strike)) strike_lane_->Push(strike);
 
           if (trace) {
             // Trace
-            cout << receive_buffer << endl;
+            cout << receive_buffer.Data() << endl;
           }
           else {
-            // Write data to tempest
-            Write(log, receive_buffer, receive_len);
+            // Hand the buffer over to the parse stage: if the ring is full wait for it to drain
+            // (meanwhile datagrams queue up in the socket and kernel drops are accounted for)
+            if (!receive_arrival) receive_arrival = chrono::duration<double>(chrono::system_clock::now().time_since_epoch()).count();
+
+            Datagram datagram{move(receive_buffer), receive_dropped, receive_arrival};
+
+            while (!ring_.Push(move(datagram)) && Continue()) {
+              ring_stats_.stalls.fetch_add(1, memory_order_relaxed);
+              this_thread::sleep_for(chrono::milliseconds(1));
+            }
+
+            size_t size = ring_.Size();
+            if (size > ring_stats_.peak.load(memory_order_relaxed)) ring_stats_.peak.store(size, memory_order_relaxed);
           }
         }
       }
@@ -125,88 +305,114 @@ public:
     return (err);
   }
 
+  int Parser() {
+    //
+    // Consume the datagrams queued by the receiver in batches, parsing and applying each batch under a single lock
+    //
+    int err = EXIT_SUCCESS;
+
+    // Initialize log stream
+    Log log{facility_, level_};
+
+    vector<Datagram> batch;
+    batch.reserve(batch_max_);
+
+    try {
+      TLOG_INFO(log) << "Parser started." << endl;
+
+      // The parser is worker 0 of the pool
+      Schedule("Parser", WorkerCpu(0));
+
+      if (alert_lane_) {
+        for (const string& error: alert_lane_->Errors()) TLOG_ERROR(log) << "Alert sink " << error << "." << endl;
+      }
+      if (stream_ && !stream_->Error().empty()) TLOG_ERROR(log) << "Stream server: " << stream_->Error() << "." << endl;
+
+      while (Continue()) {
+        if (!ring_.Pop(batch, batch_max_)) {
+          ring_.Wait(chrono::seconds(io_timeout_));
+          continue;
+        }
+
+        ring_stats_.batches.fetch_add(1, memory_order_relaxed);
+        ring_stats_.datagrams.fetch_add(batch.size(), memory_order_relaxed);
+
+        Write(log, batch);
+        batch.clear();
+      }
+    }
+    catch (exception const & ex) {
+      err = EXIT_FAILURE;
+    }
+
+    Exit(err != EXIT_SUCCESS, true);
+    TLOG_INFO(log) << "Parser ended with return code = " << err << "." << endl;
+
+    return (err);
+  }
+
   int Transmitter() {
     int err = EXIT_SUCCESS;
-    int err_consecutive = 0;
 
     // Initialize log
     Log log{facility_, level_};
 
-    bool trace = url_.empty() && interval_;
+    bool trace = destination_.empty() && interval_;
 
     vector<string> data;
+    vector<string> encoded[Compressor::Encoding::ENCODINGS];
+    vector<pair<size_t, size_t>> send;
+    vector<pair<size_t, size_t>> retry;                         // (body, destination) rejected for their encoding
+    vector<size_t> flight;                                      // requests of each body not completed yet
     size_t event;
 
-    struct curl_slist* slist = nullptr;
-    CURL* curl = nullptr;
-    CURLcode res;
+    vector<HttpTransport*> client;
+    for (Destination& destination: destination_) client.push_back(destination.client.get());
 
     try {
       TLOG_INFO(log) << "Trasmitter started." << endl;
 
-      if (!trace) {
-        // Initialize CURL library
-        res = curl_global_init(CURL_GLOBAL_ALL);
-        if (res != CURLE_OK) {
-          TLOG_ERROR(log) << "curl_global_init() failed: " << curl_easy_strerror(res) << "." << endl;
-          throw runtime_error("curl_global_init()");
-        }
-
-        // Add slist string
-        slist = curl_slist_append(nullptr, "Content-Type: application/json");
-        if (!slist) {
-          TLOG_ERROR(log) << "curl_slist_append() returned a NULL pointer." << endl;
-          throw runtime_error("curl_slist_append()");
-        }
+      Schedule("Transmitter", cpu_transmitter_);
 
-        // Get a curl handle
-        curl = curl_easy_init();
-        if (!curl) {
-          TLOG_ERROR(log) << "curl_easy_init() returned a NULL pointer." << endl;
-          throw runtime_error("curl_easy_init()");
-        }
+      for (Destination& destination: destination_) {
+        if (!destination.client->Error().empty()) TLOG_ERROR(log) << "Destination " << destination.url << ": " << destination.client->Error() << "." << endl;
+      }
 
-        // Verbose
-        // curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+      while (Continue()) {
 
-        // Set the URL that is about to receive our POST
-        curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
+        // Only the transmitter changes the destination encodings: no need to lock to read them
+        uint encodings = 0;
+        for (const Destination& destination: destination_) encodings |= (1u << destination.encoding);
 
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
+        data.clear();
+        send.clear();
+        event = Read(log, data, encoded, encodings, send);
 
-        // Enable location redirects
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-        curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 1);
-        curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+        if (trace) {
+          // Trace
+          while (event--) cout << data[event] << endl;
+          continue;
+        }
 
-        // Set timeout
-        // curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60);
-      }
+        // Queue the requests the breakers and buckets let through, then drive them all to completion:
+        // a failing destination is only skipped, it doesn't stop the relay
+        flight.assign(data.size(), 0);
 
-      while (Continue()) {
+        for (const auto& [body, idx]: send) {
+          if (Admit(log, idx)) Post(idx, body, data, encoded, flight, false);
+        }
 
-        data.clear();
-        event = Read(log, data);
-        while (event--) {
+        // A body rejected for its encoding goes through the breaker and bucket again, with the encoding negotiated in its place
+        while (Continue() && any_of(client.begin(), client.end(), [](const HttpTransport* c){ return (c->Pending() > 0); })) {
+          HttpTransport::Run(client, io_timeout_ * 1000, [&](size_t idx, const HttpResult& result){
+            flight[result.tag]--;
+            if (Complete(log, idx, result)) retry.emplace_back(result.tag, idx);
+          });
 
-          if (trace) {
-            // Trace
-            cout << data[event] << endl;
-          }
-          else {
-            // Transmit data
-            // Specify the POST data and its lenght
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data[event].c_str());
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data[event].length());
-
-            // Perform the request, res will get the return code
-            res = curl_easy_perform(curl);
-            if (res != CURLE_OK) {
-              TLOG_ERROR(log) << "curl_easy_perform() failed: " << curl_easy_strerror(res) << "." << endl;
-              if (++err_consecutive == 5) throw runtime_error("curl_easy_perform()");
-            }
-            else err_consecutive = 0; 
+          for (const auto& [body, idx]: retry) {
+            if (Admit(log, idx)) Post(idx, body, data, encoded, flight, true);
           }
+          retry.clear();
         }
       }
     }
@@ -214,16 +420,6 @@ public:
       err = EXIT_FAILURE;
     }
 
-    if (!trace) {
-      // Free the list again
-      if (slist) curl_slist_free_all(slist);
-
-      // Cleanup
-      if (curl) curl_easy_cleanup(curl);
-
-      curl_global_cleanup();
-    }
-
     Exit(err != EXIT_SUCCESS);
     TLOG_INFO(log) << "Trasmitter ended with return code = " << err << "." << endl;
 
@@ -234,17 +430,62 @@ public:
     //
     // Return tempest data structure statistics
     //
+    string sched = StatsSched();
+
+    string destination = StatsDestination();
+
+    string alert = alert_lane_? (StatsRules() + alert_lane_->Stats()): "";
+    if (strike_lane_) alert += strike_lane_->Stats();
+    if (stream_) alert += stream_->Stats();
+
     scoped_lock<mutex> lock{tempest_access_};
 
-    return (StatsUdp());
+    return (StatsUdp() + StatsFleet() + StatsRing() + StatsWheel() + destination + alert + pool_.Stats() + workers_.Stats() + sched);
+  }
+
+  string Gaps(void) {
+    //
+    // Return missing observation intervals so they can be backfilled from the archive
+    //
+    scoped_lock<mutex> lock{tempest_access_};
+
+    return (StatsGaps());
+  }
+
+  string Metrics(void) {
+    //
+    // Return the fleet aggregates and the health indicators for the exporters: the latest snapshot published by the
+    // transmitter, so scrapes never wait on (or hold) the tempest lock
+    //
+    scoped_lock<mutex> lock{metrics_access_};
+
+    return (metrics_);
+  }
+
+  string Quantiles(void) {
+    //
+    // Return the measurement distributions of each sensor and of the fleet
+    //
+    scoped_lock<mutex> lock{tempest_access_};
+
+    return (StatsQuantiles());
   }
 
 private:
 
+  struct Datagram {
+    Buffer buffer;
+    uint32_t dropped;                                           // kernel drop counter when the datagram was received
+    double arrival;                                             // wall clock time it was received at
+  };
+
   void Exit(bool notify_parent = false, bool notify_transmitter = false) {
 
     exit_ = true;
 
+    // Wake up the parser if it's parked on an empty ring
+    ring_.Wake();
+
     if (notify_transmitter) {
       // Wake up the transmitter if he's sleeping
       scoped_lock<mutex> lock{tempest_access_};
@@ -260,47 +501,528 @@ private:
 
   inline bool Continue(void) { return (!exit_); }
 
-  size_t Write(Log& log, const char data[], size_t data_len) {
+  void SetSocketBuffer(int size) {
+    scoped_lock<mutex> lock{tempest_access_};
+
+    Tempest::SetSocketBuffer(size);
+  }
+
+  size_t Write(Log& log, vector<Datagram>& batch) {
     //
     // Return the number of events/observation written to tempest
     // or 0 if error/debug/unrecognized
+    // The buffers go back to the pool when the batch is cleared
     //
-    scoped_lock<mutex> lock{tempest_access_};
+    vector<string_view> udp;
+    vector<double> arrival;
+    udp.reserve(batch.size());
+    arrival.reserve(batch.size());
+    for (const Datagram& datagram: batch) {
+      udp.emplace_back(datagram.buffer.Data(), datagram.buffer.Size());
+      arrival.push_back(datagram.arrival);
+    }
 
-    bool notify = false;
+    thread_local vector<string> alert;
+    size_t event;
 
-    size_t event = WriteUdp(log, data, data_len, notify);
+    {
+      scoped_lock<mutex> lock{tempest_access_};
 
-    // wake up the transmitter if he's sleeping
-    if (notify) transmitter_.notify_one();
+      bool notify = false;
+
+      // The drop counter is cumulative: the latest one is all we need
+      UpdateDropped(batch.back().dropped, time(nullptr));
+
+      event = WriteUdp(log, udp, arrival, workers_, notify);
+
+      // wake up the transmitter if he's sleeping
+      if (notify) transmitter_.notify_one();
+
+      TakeAlerts(alert);
+    }
+
+    // Alerts skip the interval pipeline: out of the lock, straight to their lane
+    for (const string& message: alert) alert_lane_->Push(message);
+
+    // Live subscribers get every event as received (each one encoded once, whatever the number of subscribers)
+    if (stream_ && stream_->Subscribed()) {
+      for (const string_view& datagram: udp) stream_->Publish(UdpType(datagram), datagram);
+      for (const string& message: alert) stream_->Publish("alert", message);
+    }
+    alert.clear();
 
     return (event);
   }
 
-  size_t Read(Log& log, vector<string>& data) {
+  string StatsRing(void) const {
+    //
+    // Return receive/parse ring statistics
+    //
+    ostringstream stats{""};
+
+    size_t batches = ring_stats_.batches.load(memory_order_relaxed);
+    size_t datagrams = ring_stats_.datagrams.load(memory_order_relaxed);
+
+    stats << "Receive Ring: " << ring_.Size() << "/" << ring_.Depth() << " (peak: " << ring_stats_.peak.load(memory_order_relaxed) << ")" << endl;
+    stats << "     Stalls: " << ring_stats_.stalls.load(memory_order_relaxed) << endl;
+    stats << "     Batches: " << batches << " (average size: " << (batches? ((double)datagrams / batches): 0) << ")" << endl;
+
+    return (stats.str());
+  }
+
+  vector<int> WorkerCpu(size_t idx) const {
+    //
+    // Spread the parser (worker 0) and the workers over the configured CPUs, one each
+    //
+    if (cpu_workers_.empty()) return (cpu_workers_);
+
+    return (vector<int>{cpu_workers_[idx % cpu_workers_.size()]});
+  }
+
+  void Schedule(const string& name, const vector<int>& cpu, int priority = 0) {
+    //
+    // Apply affinity and scheduling policy to the calling thread and record the effective ones
+    // Failures (i.e. SCHED_FIFO without CAP_SYS_NICE) are logged and the thread keeps running as is
+    //
+    Log log{facility_, level_};
+    error_t err;
+
+    if ((err = Sched::SetAffinity(cpu))) {
+      TLOG_WARNING(log) << name << ": pthread_setaffinity_np() failed: " << strerror(err) << "." << endl;
+    }
+
+    if ((err = Sched::SetFifo(priority))) {
+      TLOG_WARNING(log) << name << ": pthread_setschedparam(SCHED_FIFO, " << priority << ") failed: " << strerror(err) << "." << endl;
+    }
+
+    string effective = Sched::Describe();
+    TLOG_DEBUG(log) << name << " scheduling: " << effective << "." << endl;
+
+    scoped_lock<mutex> lock{sched_access_};
+    sched_[name] = effective;
+  }
+
+  string StatsSched(void) {
+    //
+    // Return the effective affinity and policy of each thread
+    //
+    scoped_lock<mutex> lock{sched_access_};
+    ostringstream stats{""};
+
+    stats << "Threads:" << endl;
+    for (const auto& [name, effective]: sched_) stats << "     " << name << ": " << effective << endl;
+    stats << "Memory Locked: " << (memory_locked_? "yes": "no") << endl;
+
+    return (stats.str());
+  }
+
+  struct Destination {
+    Destination(const Target& target, const Options& options):
+      url{target.url}, interval{target.interval * 60}, format{target.format}, bucket{target.rate_limit / 60, (double)target.rate_burst},
+      breaker{options.breaker_threshold, (double)options.backoff_min, (double)options.backoff_max},
+      encoding{target.compress}, client{make_unique<HttpTransport>(target.url, "application/json", options.http)} {}
+
+    string url;
+    int interval;                                               // in seconds
+    Tempest::Format format;
+    TokenBucket bucket;
+    CircuitBreaker breaker;
+    Compressor::Encoding encoding;                              // negotiated: starts from the preferred one, lowered on a 415
+    unique_ptr<HttpTransport> client;                           // used by the transmitter only
+
+    // Destination Statistics
+    struct {
+      size_t sent{0};
+      size_t failed{0};
+      size_t throttled{0};                                      // skipped: out of tokens
+      size_t rejected{0};                                       // skipped: breaker open
+      size_t compressed{0};                                     // requests sent with a compressed body
+      uint64_t bytes_in{0};                                     // body bytes before compression
+      uint64_t bytes_out{0};                                    // body bytes sent
+    }
+    stats;
+  };
+
+  static double Now(void) {
+    //
+    // Rate limiter and circuit breaker time base: monotonic seconds
+    //
+    return (chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  bool Admit(Log& log, size_t idx) {
+    //
+    // Return whether a request can be sent to a destination now: its breaker must let it through and its bucket have a token
+    //
+    Destination& destination = destination_[idx];
+    double now = Now();
+
+    scoped_lock<mutex> lock{destination_access_};
+
+    // Check tokens before the breaker, so we don't waste a half-open probe on a throttled request
+    if (destination.bucket.Tokens(now) < 1 && !destination.bucket.Unlimited()) {
+      destination.stats.throttled++;
+      TLOG_DEBUG(log) << "Destination " << destination.url << " throttled." << endl;
+      return (false);
+    }
+
+    if (!destination.breaker.Allow(now)) {
+      destination.stats.rejected++;
+      return (false);
+    }
+
+    destination.bucket.Take(now);
+
+    return (true);
+  }
+
+  void Post(size_t idx, size_t event, vector<string>& data, vector<string>* encoded, vector<size_t>& flight, bool retry) {
+    //
+    // Queue a body with the destination encoding, or as is if it wasn't compressed (too small, not worth it or not available)
+    // A retry with no other request of the body in flight is its last use: the body is moved to the request, which the
+    // curl backend keeps as is (the built-in client copies it behind the headers either way)
+    //
+    Destination& destination = destination_[idx];
+    Compressor::Encoding encoding = destination.encoding;
+
+    if (event >= encoded[encoding].size() || encoded[encoding][event].empty()) encoding = Compressor::Encoding::IDENTITY;
+    string& body = (encoding == Compressor::Encoding::IDENTITY)? data[event]: encoded[encoding][event];
+
+    size_t bytes_in = data[event].size();
+    size_t bytes_out = body.size();
+
+    if (retry && !flight[event]) destination.client->Post(move(body), event, encoding);
+    else destination.client->Post(body, event, encoding);
+    flight[event]++;
+
+    scoped_lock<mutex> lock{destination_access_};
+
+    if (encoding != Compressor::Encoding::IDENTITY) destination.stats.compressed++;
+    destination.stats.bytes_in += bytes_in;
+    destination.stats.bytes_out += bytes_out;
+  }
+
+  bool Complete(Log& log, size_t idx, const HttpResult& result) {
+    //
+    // Feed the outcome of a request to its destination breaker
+    // Return true if the body was rejected for its encoding (415) and must be sent again with the one negotiated in its place
+    //
+    Destination& destination = destination_[idx];
+
+    if (result.status == 415 && result.encoding != Compressor::Encoding::IDENTITY) {
+      // Step down to the best encoding the server lists (RFC 7694), or to none
+      Compressor::Encoding encoding = Compressor::Best(result.accept_encoding, (Compressor::Encoding)(result.encoding - 1));
+
+      scoped_lock<mutex> lock{destination_access_};
+
+      if (encoding < destination.encoding) {
+        TLOG_WARNING(log) << "Destination " << destination.url << " doesn't accept " << Compressor::Name(destination.encoding) << " bodies: using " << Compressor::Name(encoding) << "." << endl;
+        destination.encoding = encoding;
+      }
+
+      return (true);
+    }
+
+    if (!result.status) TLOG_ERROR(log) << "Destination " << destination.url << ": " << result.error << "." << endl;
+    else if (result.status >= 500 || result.status == 429) TLOG_ERROR(log) << "Destination " << destination.url << " returned HTTP " << result.status << "." << endl;
+
+    bool ok = (result.status && result.status < 500 && result.status != 429);
+
+    scoped_lock<mutex> lock{destination_access_};
+
+    CircuitBreaker::State state = destination.breaker.GetState();
+
+    if (ok) {
+      destination.stats.sent++;
+      destination.breaker.Success();
+
+      if (state != CircuitBreaker::State::CLOSED) TLOG_INFO(log) << "Destination " << destination.url << " recovered." << endl;
+    }
+    else {
+      destination.stats.failed++;
+      destination.breaker.Failure(Now());
+
+      if (state != CircuitBreaker::State::OPEN && destination.breaker.GetState() == CircuitBreaker::State::OPEN) {
+        TLOG_WARNING(log) << "Destination " << destination.url << " unavailable: retrying in " << destination.breaker.Backoff() << "s." << endl;
+      }
+    }
+
+    return (false);
+  }
+
+  string StatsDestination(void) {
+    //
+    // Return per destination breaker state, tokens and counters
+    //
+    scoped_lock<mutex> lock{destination_access_};
+    ostringstream stats{""};
+    double now = Now();
+
+    stats << "Destinations: " << destination_.size() << endl;
+    for (size_t idx = 0; idx < destination_.size(); idx++) {
+      Destination& destination = destination_[idx];
+      CircuitBreaker& breaker = destination.breaker;
+      TokenBucket& bucket = destination.bucket;
+
+      stats << "[" << idx << "]: " << destination.url << " (" << Tempest::FormatName(destination.format) << " every " << destination.interval << "s)" << endl;
+      stats << "     Breaker: " << CircuitBreaker::StateName(breaker.GetState());
+      if (breaker.GetState() == CircuitBreaker::State::OPEN) stats << " (retry in: " << (int)breaker.RetryIn(now) << "s, backoff: " << breaker.Backoff() << "s)";
+      stats << ", consecutive failures: " << breaker.Failures() << ", trips: " << breaker.Trips() << endl;
+      if (bucket.Unlimited()) stats << "     Tokens: unlimited" << endl;
+      else stats << "     Tokens: " << (int)bucket.Tokens(now) << "/" << bucket.Capacity() << " (rate: " << (bucket.Rate() * 60) << "/min)" << endl;
+      stats << "     Sent: " << destination.stats.sent << ", Failed: " << destination.stats.failed;
+      stats << ", Throttled: " << destination.stats.throttled << ", Rejected: " << destination.stats.rejected << endl;
+      stats << "     Encoding: " << Compressor::Name(destination.encoding) << " (compressed: " << destination.stats.compressed;
+      stats << ", ratio: " << (destination.stats.bytes_in? ((double)destination.stats.bytes_out / destination.stats.bytes_in): 1) << ")" << endl;
+      stats << destination.client->Stats();
+    }
+
+    return (stats.str());
+  }
+
+  struct Slot {
+    uint32_t hub;
+    uint32_t sensor;
+    uint32_t destination;
+  };
+
+  static const uint32_t every_ = UINT32_MAX;                    // Slot::destination of an urgent event
+
+  static uint64_t Tick(void) {
+    //
+    // Transmit scheduler time base: monotonic seconds
+    //
+    return (chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  static uint64_t Phase(const string& sensor_id, size_t destination, uint64_t period) {
+    //
+    // Deterministic offset within the period (FNV-1a of the sensor serial number and destination)
+    // so schedules are spread evenly and each sensor keeps the same slot across restarts
+    //
+    uint64_t hash = 14695981039346656037ull;
+
+    for (char c: sensor_id + "/" + to_string(destination)) {
+      hash ^= (unsigned char)c;
+      hash *= 1099511628211ull;
+    }
+
+    return (hash % period);
+  }
+
+  string StatsWheel(void) const {
+    //
+    // Return transmit scheduler statistics
+    //
+    ostringstream stats{""};
+
+    int64_t next = max((int64_t)wheel_.Next() - (int64_t)Tick(), (int64_t)0);
+
+    // Distinct periods, in order of appearance
+    vector<int> period;
+    if (destination_.empty() && interval_) period.push_back(interval_);
+    for (const Destination& destination: destination_) {
+      if (find(period.begin(), period.end(), destination.interval) == period.end()) period.push_back(destination.interval);
+    }
+
+    stats << "Transmit Schedules: " << wheel_.Size() << " (period: ";
+    for (size_t idx = 0; idx < period.size(); idx++) stats << (idx? "/": "") << period[idx] << "s";
+    if (period.empty()) stats << "none";
+    stats << ", next in: " << next << "s)" << endl;
+    stats << "     Scheduled: " << wheel_stats_.scheduled << endl;
+    stats << "     Urgent: " << wheel_stats_.urgent << endl;
+
+    return (stats.str());
+  }
+
+  size_t Read(Log& log, vector<string>& data, vector<string>* encoded, uint encodings, vector<pair<size_t, size_t>>& send) {
     //
     // Return the number of events/observation read from tempest
     // or 0 if error
+    // send receives the (body, destination) requests due; bodies for the JSON destinations follow the Ecowitt ones
+    // encoded[e] receives the bodies compressed with each encoding e in the encodings mask
+    //
+    // Each (sensor, destination) pair has its own slot in the timing wheel, every interval of its destination, so
+    // transmissions are spread across the interval instead of bursting all at once; urgent events (rain start, lightning)
+    // wake us up and go out right away to every destination
     //
     unique_lock<mutex> lock{tempest_access_};
 
-    transmitter_.wait_for(lock, chrono::seconds(interval_));
-    // == cv_status::timeout
+    uint64_t wake = wheel_.Next();
+    if (stream_) wake = min(wake, metrics_due_);
+
+    transmitter_.wait_until(lock, chrono::steady_clock::time_point{chrono::seconds(wake)});
+
+    if (stream_ && Tick() >= metrics_due_) {
+      string metrics = MetricsFleet() + MetricsHealth();
+      metrics_due_ = Tick() + metrics_period_;
+
+      scoped_lock<mutex> metrics_lock{metrics_access_};
+      metrics_.swap(metrics);
+    }
+
+    vector<pair<size_t, size_t>> added;
+    vector<pair<size_t, size_t>> urgent;
+    vector<Slot> due;
+
+    TakeAdded(added);
+    for (const auto& [hub, sensor]: added) {
+      const string& id = GetSensorId(hub, sensor);
+
+      // Trace: a single schedule, every interval
+      if (destination_.empty() && interval_) wheel_.Add(Slot{(uint32_t)hub, (uint32_t)sensor, 0}, interval_, Phase(id, 0, interval_));
+
+      for (size_t idx = 0; idx < destination_.size(); idx++) {
+        uint64_t period = destination_[idx].interval;
+        wheel_.Add(Slot{(uint32_t)hub, (uint32_t)sensor, (uint32_t)idx}, period, Phase(id, idx, period));
+      }
+    }
+
+    TakeUrgent(urgent);
+    wheel_stats_.urgent += urgent.size();
+    for (const auto& [hub, sensor]: urgent) due.push_back(Slot{(uint32_t)hub, (uint32_t)sensor, every_});
+
+    wheel_stats_.scheduled += wheel_.Advance(Tick(), [&due](const Slot& slot) {
+      due.push_back(slot);
+    });
+
+    // Each sensor is encoded once, whatever the number of destinations it's due to; a sensor due and urgent at the
+    // same time is sent once
+    sort(due.begin(), due.end(), [](const Slot& a, const Slot& b){ return (tie(a.hub, a.sensor, a.destination) < tie(b.hub, b.sensor, b.destination)); });
+
+    vector<pair<size_t, size_t>> target;
+    bool json = false;
+
+    for (const Slot& slot: due) {
+      if (target.empty() || target.back() != pair<size_t, size_t>{slot.hub, slot.sensor}) target.emplace_back(slot.hub, slot.sensor);
+
+      for (size_t idx = 0; idx < destination_.size(); idx++) {
+        if (slot.destination != every_ && slot.destination != idx) continue;
 
-    return (ReadEcowitt(log, data));
+        send.emplace_back(target.size() - 1, idx);
+        json |= (destination_[idx].format == Tempest::Format::JSON);
+      }
+    }
+
+    sort(send.begin(), send.end());
+    send.erase(unique(send.begin(), send.end()), send.end());
+
+    size_t event = ReadEcowitt(log, data, workers_, target);
+
+    // JSON and compression only need the Ecowitt bodies: don't hold up the receiver for them
+    lock.unlock();
+
+    if (json) {
+      data.resize(event * 2);
+      workers_.Run(event, [&data, event](size_t idx) { Tempest::EncodeJson(data[idx], data[event + idx]); });
+
+      for (auto& [body, idx]: send) {
+        if (destination_[idx].format == Tempest::Format::JSON) body += event;
+      }
+    }
+
+    Compress(data, encoded, encodings);
+
+    return (event);
+  }
+
+  void Compress(const vector<string>& data, vector<string>* encoded, uint encodings) {
+    //
+    // Compress the bodies on the worker pool, once per encoding in use by any destination, so the transmitter
+    // gets them ready to send; each thread keeps its own compressor, reset between bodies
+    // A body left empty is sent as is
+    //
+    vector<Compressor::Encoding> encoding;
+
+    for (int idx = Compressor::Encoding::IDENTITY + 1; idx < Compressor::Encoding::ENCODINGS; idx++) {
+      bool used = (encodings & (1u << idx));
+
+      // Keep the strings around for their capacity
+      encoded[idx].resize(used? data.size(): 0);
+      if (used) encoding.push_back((Compressor::Encoding)idx);
+    }
+
+    if (encoding.empty() || data.empty()) return;
+
+    workers_.Run(data.size() * encoding.size(), [&](size_t task) {
+      thread_local Compressor compressor;
+
+      Compressor::Encoding e = encoding[task / data.size()];
+      size_t idx = task % data.size();
+      string& out = encoded[e][idx];
+
+      // Not worth it if it doesn't shrink
+      if (data[idx].size() < compress_min_ || !compressor.Compress(e, data[idx], out) || out.size() >= data[idx].size()) out.clear();
+    });
   }
 
   condition_variable transmitter_;
   mutex tempest_access_;
   atomic<bool> exit_{false};
 
-  const int buffer_max_;
+  // Thread scheduling
+  mutex sched_access_;
+  map<string, string> sched_;                                   // thread name -> effective affinity and policy
+  atomic<bool> memory_locked_{false};
+
+  BufferPool pool_;
+  Ring<Datagram> ring_;
+
+  // Destinations (breakers and buckets are updated by the transmitter and read by Stats())
+  mutex destination_access_;
+  vector<Destination> destination_;
+
+  // Alert firings (nullptr: no rules)
+  unique_ptr<Lane> alert_lane_;
+
+  // Lightning fast path, pushed to by the receiver (nullptr: no sinks)
+  unique_ptr<Lane> strike_lane_;
+
+  // /metrics snapshot, refreshed by the transmitter every metrics_period_ seconds (declared before the stream server
+  // which reads it)
+  static const uint64_t metrics_period_ = 10;
+  uint64_t metrics_due_{0};                                     // tick (only accessed under tempest_access_)
+  mutex metrics_access_;
+  string metrics_;
+
+  // Live event stream (nullptr: none)
+  unique_ptr<StreamServer> stream_;
+
+  // Transmit scheduler (only accessed under tempest_access_)
+  TimingWheel<Slot> wheel_;
+
+  struct {
+    size_t scheduled{0};                                        // sensors sent in their slot
+    size_t urgent{0};                                           // sensors sent right away on an event
+  }
+  wheel_stats_;
+
+  // Ring Statistics
+  struct {
+    atomic<size_t> stalls{0};                                   // receiver found the ring full
+    atomic<size_t> peak{0};                                     // highest occupancy seen by the receiver
+    atomic<size_t> batches{0};
+    atomic<size_t> datagrams{0};
+  }
+  ring_stats_;
+
   const int io_timeout_;
+  const int receive_buffer_;
+  const size_t batch_max_;
   const int port_;
   const string url_;
   const int interval_;                                          // in seconds
   const Log::Level level_;
   const Log::Facility facility_;
+  const vector<int> cpu_receiver_;
+  const vector<int> cpu_transmitter_;
+  const vector<int> cpu_workers_;
+  const int fifo_priority_;
+  const bool lock_memory_;
+  const size_t compress_min_;
+
+  // Last, so its threads start only once everything they use is initialized
+  WorkerPool workers_;
 };
 
 } // namespace tempest
@@ -0,0 +1,133 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: lock-free single-producer/single-consumer ring
+//
+
+#ifndef TEMPEST_RING
+#define TEMPEST_RING
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Bounded ring shared by exactly one producer and one consumer thread
+// Push() and Pop() never lock: the mutex/condition variable pair is only used to park the consumer while the ring is empty
+//
+
+template <typename T>
+class Ring {
+public:
+
+  explicit Ring(size_t depth) {
+    // Round depth up to a power of two so indexes wrap with a mask
+    size_t size = 1;
+    while (size < depth) size <<= 1;
+
+    mask_ = size - 1;
+    slot_ = make_unique<T[]>(size);
+  }
+
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  inline size_t Depth(void) const { return (mask_ + 1); }
+
+  inline size_t Size(void) const {
+    //
+    // Approximate occupancy (exact when called by either the producer or the consumer)
+    //
+    return (tail_.load(memory_order_acquire) - head_.load(memory_order_acquire));
+  }
+
+  bool Push(T&& item) {
+    //
+    // Producer: return false if the ring is full
+    //
+    size_t tail = tail_.load(memory_order_relaxed);
+
+    if (tail - head_.load(memory_order_acquire) > mask_) return (false);
+
+    slot_[tail & mask_] = move(item);
+    tail_.store(tail + 1, memory_order_seq_cst);
+
+    // Wake up the consumer if it's parked
+    if (parked_.load(memory_order_seq_cst)) {
+      scoped_lock<mutex> lock{park_access_};
+      park_.notify_one();
+    }
+
+    return (true);
+  }
+
+  size_t Pop(vector<T>& batch, size_t batch_max) {
+    //
+    // Consumer: move up to batch_max items at the end of batch and return how many
+    //
+    size_t head = head_.load(memory_order_relaxed);
+    size_t size = min(tail_.load(memory_order_acquire) - head, batch_max);
+
+    for (size_t idx = 0; idx < size; idx++) batch.emplace_back(move(slot_[(head + idx) & mask_]));
+    head_.store(head + size, memory_order_release);
+
+    return (size);
+  }
+
+  template <class Rep, class Period>
+  bool Wait(const chrono::duration<Rep, Period>& timeout) {
+    //
+    // Consumer: park until the ring is not empty or timeout expires
+    // Return false on timeout
+    //
+    unique_lock<mutex> lock{park_access_};
+
+    parked_.store(true, memory_order_seq_cst);
+    bool ready = park_.wait_for(lock, timeout, [this]{ return (tail_.load(memory_order_seq_cst) != head_.load(memory_order_relaxed)); });
+    parked_.store(false, memory_order_relaxed);
+
+    return (ready);
+  }
+
+  void Wake(void) {
+    //
+    // Wake up a parked consumer without pushing (i.e. on exit)
+    //
+    scoped_lock<mutex> lock{park_access_};
+    park_.notify_one();
+  }
+
+private:
+
+  // Producer and consumer indexes live on separate cache lines to avoid false sharing
+  alignas(64) atomic<size_t> head_{0};                          // written by the consumer
+  alignas(64) atomic<size_t> tail_{0};                          // written by the producer
+  alignas(64) atomic<bool> parked_{false};
+
+  size_t mask_;
+  unique_ptr<T[]> slot_;
+
+  mutex park_access_;
+  condition_variable park_;
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_RING
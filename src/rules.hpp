@@ -0,0 +1,520 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: alert rules compiled into a predicate program and evaluated on ingest
+//
+
+#ifndef TEMPEST_RULES
+#define TEMPEST_RULES
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "check.hpp"
+#include "lane.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Rules file (JSON):
+//
+// {
+//   "sinks": ["udp://127.0.0.1:5000", "unix:/run/tempest.sock", "http://hubitat.local:39501/alert"],
+//   "rules": [
+//     {"name": "lightning", "when": "lightning_distance < 10", "cooldown": 600},
+//     {"name": "gust", "when": "wind_gust > 20", "hysteresis": 3, "cooldown": 300},
+//     {"name": "battery", "when": "battery < 2.4 and battery > 0", "hysteresis": 0.05, "cooldown": 86400}
+//   ]
+// }
+//
+// "when" compares fields (metric, as in the UDP API) with numbers, combined with and/or and parentheses
+// "hysteresis" (0 or more, in the units of the fields) and "cooldown" (seconds) are optional; the sinks take Lane URLs
+// A rule fires when it becomes true and clears when it's false again by more than its hysteresis; a rule on an event field
+// (a lightning strike) fires on every event that satisfies it; either way it doesn't fire again within its cooldown (seconds)
+//
+
+class Rules {
+public:
+
+  enum Field {
+    TEMPERATURE,
+    HUMIDITY,
+    PRESSURE,
+    SEA_LEVEL_PRESSURE,
+    PRESSURE_TREND,
+    DEW_POINT,
+    FEELS_LIKE,
+    WIND_SPEED,
+    WIND_GUST,
+    WIND_LULL,
+    WIND_DIRECTION,
+    RAPID_WIND_SPEED,
+    RAIN_RATE,
+    RAIN_DAILY,
+    UV,
+    SOLAR_RADIATION,
+    ILLUMINANCE,
+    LIGHTNING_COUNT,
+    LIGHTNING_DISTANCE,
+    LIGHTNING_ENERGY,
+    BATTERY,
+    FIELDS
+  };
+
+  // Fields only valid at the time of their event
+  static const uint32_t event_fields_ = (1u << Field::LIGHTNING_DISTANCE) | (1u << Field::LIGHTNING_ENERGY);
+
+  static const char* FieldName(Field field) {
+    static const char* const name[Field::FIELDS] = {
+      "temperature", "humidity", "pressure", "sea_level_pressure", "pressure_trend", "dew_point", "feels_like",
+      "wind_speed", "wind_gust", "wind_lull", "wind_direction", "rapid_wind_speed", "rain_rate", "rain_daily",
+      "uv", "solar_radiation", "illuminance", "lightning_count", "lightning_distance", "lightning_energy", "battery"
+    };
+
+    return ((field < Field::FIELDS)? name[field]: "?");
+  }
+
+  // Per sensor evaluation state
+  struct State {
+    double value[Field::FIELDS];                                // as of the last evaluation
+    bool valid{false};                                          // value[] was initialized
+
+    struct Rule {
+      bool active{false};
+      bool notified{false};                                     // the activation fired (so its clearing is notified too)
+      time_t fired{0};                                          // last firing, for the cooldown
+      uint64_t stamp{0};                                        // last evaluation pass that visited the rule
+    };
+
+    vector<Rule> rule;
+    uint64_t stamp{0};
+  };
+
+  struct Firing {
+    size_t rule;
+    bool fired;                                                 // false: cleared
+  };
+
+  static shared_ptr<const Rules> Load(const string& path, string& error) {
+    //
+    // Read and compile a rules file: return nullptr and the reason if it's not valid
+    //
+    ifstream file{path};
+    if (!file) {
+      error = strerror(errno);
+      return (nullptr);
+    }
+
+    stringstream text;
+    text << file.rdbuf();
+
+    Json config = Json::parse(text.str(), error);
+    if (config == nullptr) return (nullptr);
+
+    shared_ptr<Rules> rules{new Rules()};
+    if (!rules->Compile(config, error)) return (nullptr);
+
+    return (rules);
+  }
+
+  inline size_t Size(void) const { return (rule_.size()); }
+  inline const string& Name(size_t rule) const { return (rule_[rule].name); }
+  inline uint32_t Depends(size_t rule) const { return (rule_[rule].depends); }
+  inline const vector<string>& Sinks(void) const { return (sink_); }
+
+  void Evaluate(const double value[], uint32_t changed, uint32_t known, time_t now, State& state, vector<Firing>& firing) const {
+    //
+    // Evaluate the rules depending on the changed fields, and only those, appending what fired or cleared
+    // Rules reading fields the sensor hasn't reported (known mask) are left alone
+    //
+    if (!changed) return;
+    if (state.rule.size() != rule_.size()) state.rule.resize(rule_.size());
+
+    uint64_t stamp = ++state.stamp;
+
+    for (int field = 0; changed; field++, changed >>= 1) {
+      if (!(changed & 1)) continue;
+
+      for (uint32_t idx: by_field_[field]) {
+        State::Rule& rs = state.rule[idx];
+        if (rs.stamp == stamp) continue;
+        rs.stamp = stamp;
+
+        const Rule& rule = rule_[idx];
+        if (rule.depends & ~known) continue;
+
+        bool cool = (now - rs.fired >= rule.cooldown);
+
+        if (rule.depends & event_fields_) {
+          // Edge: every event satisfying the rule is a firing
+          if (!Run(rule, value, 0)) continue;
+
+          if (cool) {
+            rs.fired = now;
+            stats_[idx].fired.fetch_add(1, memory_order_relaxed);
+            firing.push_back({idx, true});
+          }
+          else stats_[idx].suppressed.fetch_add(1, memory_order_relaxed);
+          continue;
+        }
+
+        if (!rs.active) {
+          if (!Run(rule, value, 0)) continue;
+
+          rs.active = true;
+          rs.notified = cool;
+          if (cool) {
+            rs.fired = now;
+            stats_[idx].fired.fetch_add(1, memory_order_relaxed);
+            firing.push_back({idx, true});
+          }
+          else stats_[idx].suppressed.fetch_add(1, memory_order_relaxed);
+        }
+        else if (!Run(rule, value, rule.hysteresis)) {
+          rs.active = false;
+          if (rs.notified) {
+            stats_[idx].cleared.fetch_add(1, memory_order_relaxed);
+            firing.push_back({idx, false});
+          }
+        }
+      }
+    }
+  }
+
+  string Stats(void) const {
+    ostringstream stats{""};
+
+    stats << "Alert Rules: " << rule_.size() << endl;
+    for (size_t idx = 0; idx < rule_.size(); idx++) {
+      stats << "     " << rule_[idx].name << ": fired " << stats_[idx].fired.load(memory_order_relaxed);
+      stats << ", cleared " << stats_[idx].cleared.load(memory_order_relaxed) << ", suppressed " << stats_[idx].suppressed.load(memory_order_relaxed) << endl;
+    }
+
+    return (stats.str());
+  }
+
+private:
+
+  Rules() = default;
+
+  enum Code : uint8_t {
+    GT,                                                         // push value[field] > operand
+    GE,
+    LT,
+    LE,
+    EQ,
+    NE,
+    AND,                                                        // pop two, push the result
+    OR
+  };
+
+  struct Instruction {
+    Code code;
+    uint8_t field;
+    double operand;
+  };
+
+  struct Rule {
+    string name;
+    uint32_t first;                                             // instructions in program_ (postfix)
+    uint32_t size;
+    uint32_t depends;                                           // field mask
+    double hysteresis;
+    time_t cooldown;
+  };
+
+  static const size_t stack_max_ = 64;
+
+  bool Run(const Rule& rule, const double value[], double relax) const {
+    //
+    // Execute a rule program: comparisons are relaxed by relax in the direction that keeps an active rule true
+    //
+    bool stack[stack_max_];
+    size_t top = 0;
+
+    for (uint32_t pc = rule.first; pc < rule.first + rule.size; pc++) {
+      const Instruction& ins = program_[pc];
+      double v = value[ins.field];
+
+      switch (ins.code) {
+      case Code::GT:  stack[top++] = (v > ins.operand - relax); break;
+      case Code::GE:  stack[top++] = (v >= ins.operand - relax); break;
+      case Code::LT:  stack[top++] = (v < ins.operand + relax); break;
+      case Code::LE:  stack[top++] = (v <= ins.operand + relax); break;
+      case Code::EQ:  stack[top++] = (v == ins.operand); break;
+      case Code::NE:  stack[top++] = (v != ins.operand); break;
+      case Code::AND: top--; stack[top - 1] = (stack[top - 1] && stack[top]); break;
+      case Code::OR:  top--; stack[top - 1] = (stack[top - 1] || stack[top]); break;
+      }
+    }
+
+    return (top && stack[top - 1]);
+  }
+
+  bool Compile(const Json& config, string& error) {
+    //
+    // As strict as the configuration file: unknown keys, wrong types and values out of range are errors
+    //
+    if (config.is_null() || !Check::Keys(config, "rules file", {"sinks", "rules"}, error)) {
+      if (error.empty()) error = "rules file: expected an object";
+      return (false);
+    }
+
+    const Json& sinks = config["sinks"];
+    if (!sinks.is_null() && !sinks.is_array()) {
+      error = "sinks: expected a list";
+      return (false);
+    }
+
+    for (size_t idx = 0; idx < sinks.array_items().size(); idx++) {
+      const string& url = sinks[idx].string_value();
+
+      if (!Lane::Supported(url)) {
+        error = "sinks[" + to_string(idx) + "]: invalid sink '" + url + "'";
+        return (false);
+      }
+      sink_.push_back(url);
+    }
+
+    const Json& rules = config["rules"];
+    if (!rules.is_null() && !rules.is_array()) {
+      error = "rules: expected a list";
+      return (false);
+    }
+
+    for (size_t idx = 0; idx < rules.array_items().size(); idx++) {
+      const Json& item = rules[idx];
+      string where = "rules[" + to_string(idx) + "]";
+      string when;
+      int cooldown = 0;
+
+      Rule rule;
+      rule.hysteresis = 0;
+      rule.first = program_.size();
+      rule.depends = 0;
+
+      if (!item.is_object()) {
+        error = where + ": expected an object";
+        return (false);
+      }
+
+      if (!Check::Keys(item, where, {"name", "when", "hysteresis", "cooldown"}, error) ||
+          !Check::Text(item["name"], where + ".name", rule.name, error) ||
+          !Check::Text(item["when"], where + ".when", when, error) ||
+          !Check::Number(item["hysteresis"], where + ".hysteresis", 0, 1e6, rule.hysteresis, error) ||
+          !Check::Integer(item["cooldown"], where + ".cooldown", 0, 31536000, cooldown, error)) return (false);
+
+      rule.cooldown = cooldown;
+
+      if (rule.name.empty() || rule.name.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-. ") != string::npos) {
+        error = where + ": missing or invalid name";
+        return (false);
+      }
+
+      if (when.empty()) {
+        error = where + ": missing when";
+        return (false);
+      }
+
+      Parser parser{when, program_, rule.depends};
+      if (!parser.Compile(error)) {
+        error = "rule '" + rule.name + "': " + error;
+        return (false);
+      }
+
+      rule.size = program_.size() - rule.first;
+      rule_.push_back(rule);
+    }
+
+    if (rule_.empty()) {
+      error = "no rules";
+      return (false);
+    }
+
+    // Dependency index: field -> rules reading it
+    for (size_t idx = 0; idx < rule_.size(); idx++) {
+      for (int field = 0; field < Field::FIELDS; field++) {
+        if (rule_[idx].depends & (1u << field)) by_field_[field].push_back(idx);
+      }
+    }
+
+    stats_ = make_unique<Counters[]>(rule_.size());
+
+    return (true);
+  }
+
+  class Parser {
+  public:
+    //
+    // Recursive descent, emitting postfix:
+    // expr   := term { "or" term }
+    // term   := factor { "and" factor }
+    // factor := "(" expr ")" | field op number
+    //
+    Parser(const string& text, vector<Instruction>& program, uint32_t& depends): text_{text}, program_{program}, depends_{depends} {}
+
+    bool Compile(string& error) {
+      if (!Next() || !Expr() || token_ != Token::END) {
+        error = error_.empty()? ("unexpected '" + value_ + "'"): error_;
+        return (false);
+      }
+      if (depth_max_ > stack_max_) {
+        error = "expression too complex";
+        return (false);
+      }
+
+      return (true);
+    }
+
+  private:
+
+    enum Token {
+      END,
+      IDENT,
+      NUMBER,
+      OP,
+      OPEN,
+      CLOSE
+    };
+
+    bool Next(void) {
+      while (pos_ < text_.size() && isspace((unsigned char)text_[pos_])) pos_++;
+
+      size_t begin = pos_;
+      if (pos_ == text_.size()) {
+        token_ = Token::END;
+        value_ = "end";
+        return (true);
+      }
+
+      char c = text_[pos_];
+      if (isalpha((unsigned char)c) || c == '_') {
+        while (pos_ < text_.size() && (isalnum((unsigned char)text_[pos_]) || text_[pos_] == '_')) pos_++;
+        token_ = Token::IDENT;
+      }
+      else if (isdigit((unsigned char)c) || c == '-' || c == '.') {
+        char* end;
+        strtod(text_.c_str() + pos_, &end);
+        if (end == text_.c_str() + pos_) return (Fail("invalid number"));
+        pos_ = end - text_.c_str();
+        token_ = Token::NUMBER;
+      }
+      else if (c == '(' || c == ')') {
+        pos_++;
+        token_ = (c == '(')? Token::OPEN: Token::CLOSE;
+      }
+      else if (strchr("<>=!", c)) {
+        pos_++;
+        if (pos_ < text_.size() && text_[pos_] == '=') pos_++;
+        token_ = Token::OP;
+      }
+      else return (Fail(string("unexpected '") + c + "'"));
+
+      value_ = text_.substr(begin, pos_ - begin);
+      return (true);
+    }
+
+    bool Fail(const string& error) {
+      if (error_.empty()) error_ = error;
+      return (false);
+    }
+
+    bool Expr(void) {
+      if (!Term()) return (false);
+      while (token_ == Token::IDENT && value_ == "or") {
+        if (!Next() || !Term()) return (false);
+        Emit({Code::OR, 0, 0}, -1);
+      }
+      return (true);
+    }
+
+    bool Term(void) {
+      if (!Factor()) return (false);
+      while (token_ == Token::IDENT && value_ == "and") {
+        if (!Next() || !Factor()) return (false);
+        Emit({Code::AND, 0, 0}, -1);
+      }
+      return (true);
+    }
+
+    bool Factor(void) {
+      if (token_ == Token::OPEN) {
+        if (!Next() || !Expr()) return (false);
+        if (token_ != Token::CLOSE) return (Fail("missing ')'"));
+        return (Next());
+      }
+
+      if (token_ != Token::IDENT) return (Fail("expected a field, found '" + value_ + "'"));
+
+      int field = 0;
+      while (field < Field::FIELDS && value_ != FieldName((Field)field)) field++;
+      if (field == Field::FIELDS) return (Fail("unknown field '" + value_ + "'"));
+
+      if (!Next()) return (false);
+      if (token_ != Token::OP) return (Fail("expected a comparison, found '" + value_ + "'"));
+
+      static const pair<const char*, Code> op[] = {{">", Code::GT}, {">=", Code::GE}, {"<", Code::LT}, {"<=", Code::LE}, {"==", Code::EQ}, {"!=", Code::NE}};
+      const pair<const char*, Code>* it = find_if(begin(op), end(op), [this](const pair<const char*, Code>& o){ return (value_ == o.first); });
+      if (it == end(op)) return (Fail("invalid comparison '" + value_ + "'"));
+
+      if (!Next()) return (false);
+      if (token_ != Token::NUMBER) return (Fail("expected a number, found '" + value_ + "'"));
+
+      Emit({it->second, (uint8_t)field, strtod(value_.c_str(), nullptr)}, 1);
+      depends_ |= (1u << field);
+
+      return (Next());
+    }
+
+    void Emit(const Instruction& ins, int push) {
+      program_.push_back(ins);
+      depth_ += push;
+      depth_max_ = max(depth_max_, (size_t)depth_);
+    }
+
+    const string& text_;
+    vector<Instruction>& program_;
+    uint32_t& depends_;
+
+    size_t pos_{0};
+    Token token_{Token::END};
+    string value_;
+    string error_;
+    int depth_{0};
+    size_t depth_max_{0};
+  };
+
+  vector<Instruction> program_;                                 // all the rules, back to back
+  vector<Rule> rule_;
+  vector<uint32_t> by_field_[Field::FIELDS];
+  vector<string> sink_;
+
+  // Rule Statistics (rules are evaluated by the workers)
+  struct Counters {
+    atomic<uint> fired{0};
+    atomic<uint> cleared{0};
+    atomic<uint> suppressed{0};                                 // within the cooldown
+  };
+
+  unique_ptr<Counters[]> stats_;
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_RULES
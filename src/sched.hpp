@@ -0,0 +1,133 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: thread CPU affinity, real-time scheduling and memory locking
+//
+
+#ifndef TEMPEST_SCHED
+#define TEMPEST_SCHED
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+class Sched {
+public:
+
+  static vector<int> ParseCpuList(const string& list) {
+    //
+    // Parse a CPU list such as "0,2-3"
+    // Throw invalid_argument or out_of_range if the list is malformed
+    //
+    vector<int> cpu;
+    stringstream items{list};
+    string item;
+
+    while (getline(items, item, ',')) {
+      size_t dash = item.find('-');
+      int first = stoi(item.substr(0, dash));
+      int last = (dash == string::npos)? first: stoi(item.substr(dash + 1));
+
+      if (first < 0 || last < first || last >= CPU_SETSIZE) throw out_of_range(item);
+      for (int idx = first; idx <= last; idx++) cpu.push_back(idx);
+    }
+
+    if (cpu.empty()) throw invalid_argument(list);
+
+    return (cpu);
+  }
+
+  static error_t SetAffinity(const vector<int>& cpu) {
+    //
+    // Pin the calling thread to the given CPUs (no-op if empty)
+    //
+    if (cpu.empty()) return (0);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int idx: cpu) CPU_SET(idx, &set);
+
+    return (pthread_setaffinity_np(pthread_self(), sizeof(set), &set));
+  }
+
+  static error_t SetFifo(int priority) {
+    //
+    // Run the calling thread with the SCHED_FIFO real-time policy (no-op if priority is 0)
+    //
+    if (!priority) return (0);
+
+    struct sched_param param;
+    param.sched_priority = priority;
+
+    return (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param));
+  }
+
+  static error_t LockMemory(void) {
+    //
+    // Lock current and future pages in RAM so the hot path never page faults
+    //
+    return (mlockall(MCL_CURRENT | MCL_FUTURE) == -1? errno: 0);
+  }
+
+  static string Describe(void) {
+    //
+    // Return the effective affinity and scheduling policy of the calling thread
+    //
+    ostringstream text{""};
+
+    cpu_set_t set;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set)) text << "cpus ?";
+    else {
+      text << "cpus ";
+
+      // Print ranges: 0-3,6
+      int count = 0;
+      for (int idx = 0; idx < CPU_SETSIZE; idx++) {
+        if (!CPU_ISSET(idx, &set)) continue;
+
+        int last = idx;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set)) last++;
+
+        if (count++) text << ",";
+        text << idx;
+        if (last > idx) text << "-" << last;
+        idx = last;
+      }
+    }
+
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param)) text << ", policy ?";
+    else {
+      switch (policy) {
+      case SCHED_FIFO:  text << ", SCHED_FIFO/" << param.sched_priority; break;
+      case SCHED_RR:    text << ", SCHED_RR/" << param.sched_priority; break;
+      case SCHED_OTHER: text << ", SCHED_OTHER"; break;
+      default:          text << ", policy " << policy; break;
+      }
+    }
+
+    return (text.str());
+  }
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_SCHED
@@ -0,0 +1,702 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: live event streaming to Server-Sent Events and WebSocket subscribers
+//
+
+#ifndef TEMPEST_STREAM
+#define TEMPEST_STREAM
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// GET /events[?types=obs_st,rapid_wind,...]                  Server-Sent Events ("event: <type>" + "data: <json>")
+// GET /events[?types=...] with Upgrade: websocket            WebSocket, one text message per event
+// GET /metrics                                               Prometheus text exposition (if a metrics source is given)
+//
+// Publish() encodes an event once, into both framings, and the server thread hands the same frame to every subscriber
+// whose filter matches; each subscriber has its own bounded queue that drops the oldest frame when a slow client falls behind
+//
+
+class StreamServer {
+public:
+
+  enum Type {
+    HUB_STATUS,
+    EVT_PRECIP,
+    EVT_STRIKE,
+    RAPID_WIND,
+    OBS_AIR,
+    OBS_SKY,
+    OBS_ST,
+    DEVICE_STATUS,
+    ALERT,
+    OTHER,
+    TYPES
+  };
+
+  static const char* TypeName(Type type) {
+    static const char* const name[Type::TYPES] = {
+      "hub_status", "evt_precip", "evt_strike", "rapid_wind", "obs_air", "obs_sky", "obs_st", "device_status", "alert", "other"
+    };
+
+    return ((type < Type::TYPES)? name[type]: "other");
+  }
+
+  static Type GetType(string_view name) {
+    for (int type = 0; type < Type::OTHER; type++) {
+      if (name == TypeName((Type)type)) return ((Type)type);
+    }
+
+    return (Type::OTHER);
+  }
+
+  //
+  // address: IPv4 address to listen on (0.0.0.0: every interface)
+  // port: TCP port to listen on
+  // queue_max: frames queued per subscriber (at least 2: the one being written and the latest)
+  // client_max: concurrent subscribers
+  // metrics: /metrics body, called by the server thread
+  //
+  StreamServer(const string& address, int port, size_t queue_max = 64, const function<string()>& metrics = nullptr, size_t client_max = 1024):
+    port_{port}, queue_max_{max(queue_max, (size_t)2)}, client_max_{client_max}, metrics_{metrics} {
+    if ((wake_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+      error_ = string("eventfd(): ") + strerror(errno);
+      return;
+    }
+
+    if ((listen_ = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)) == -1) {
+      error_ = string("socket(): ") + strerror(errno);
+      return;
+    }
+
+    int opt = 1;
+    setsockopt(listen_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+      error_ = "invalid address " + address;
+      return;
+    }
+
+    if (bind(listen_, (const struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(listen_, 64) == -1) {
+      error_ = string("bind(): ") + strerror(errno);
+      return;
+    }
+
+    thread_ = thread(&StreamServer::Work, this);
+  }
+
+  ~StreamServer() {
+    exit_ = true;
+    Wake();
+
+    if (thread_.joinable()) thread_.join();
+
+    for (const Client& client: client_) close(client.sock);
+    if (listen_ != -1) close(listen_);
+    if (wake_ != -1) close(wake_);
+  }
+
+  StreamServer(const StreamServer&) = delete;
+  StreamServer& operator=(const StreamServer&) = delete;
+
+  inline const string& Error(void) const { return (error_); }
+  inline bool Subscribed(void) const { return (subscribers_.load(memory_order_relaxed) > 0); }
+
+  void Publish(string_view type, string_view json) {
+    //
+    // Queue an event (a single JSON object) for the subscribers: can be called by any thread
+    // Nothing is encoded if nobody is listening
+    //
+    if (!Subscribed()) return;
+
+    shared_ptr<Frame> frame = make_shared<Frame>();
+    frame->type = GetType(type);
+
+    // SSE: the data line can't contain line breaks
+    frame->sse.reserve(json.size() + type.size() + 16);
+    frame->sse.append("event: ").append(type).append("\ndata: ");
+    for (char c: json) frame->sse.push_back((c == '\r' || c == '\n')? ' ': c);
+    frame->sse.append("\n\n");
+
+    // WebSocket: unmasked final text frame
+    WsFrame(0x81, json, frame->ws);
+
+    stats_.published.fetch_add(1, memory_order_relaxed);
+
+    {
+      scoped_lock<mutex> lock{access_};
+
+      // The server thread should never be this far behind, but don't grow without bound if it is
+      if (pending_.size() == pending_max_) {
+        pending_.pop_front();
+        stats_.dropped.fetch_add(1, memory_order_relaxed);
+      }
+      pending_.push_back(move(frame));
+    }
+
+    Wake();
+  }
+
+  string Stats(void) const {
+    ostringstream stats{""};
+
+    stats << "Stream Server: port " << port_ << ", " << subscribers_.load(memory_order_relaxed) << " subscriber(s) (sse: " << stats_.sse.load(memory_order_relaxed);
+    stats << ", websocket: " << stats_.ws.load(memory_order_relaxed) << ")" << endl;
+    stats << "     Published: " << stats_.published.load(memory_order_relaxed) << ", Delivered: " << stats_.delivered.load(memory_order_relaxed);
+    stats << ", Dropped: " << stats_.dropped.load(memory_order_relaxed) << ", Rejected: " << stats_.rejected.load(memory_order_relaxed);
+    if (metrics_) stats << ", Scrapes: " << stats_.scrapes.load(memory_order_relaxed);
+    stats << endl;
+
+    return (stats.str());
+  }
+
+private:
+
+  // An event encoded once and shared by all the subscribers
+  struct Frame {
+    Type type;
+    string sse;
+    string ws;
+  };
+
+  struct Client {
+    enum Mode {
+      REQUEST,                                                  // reading the HTTP request
+      SSE,
+      WS
+    };
+
+    int sock;
+    Mode mode{Mode::REQUEST};
+    uint32_t filter{0};                                         // Type mask
+    string in;                                                  // request, or WebSocket frames from the client
+    string out;                                                 // response header and control frames, sent between frames
+    size_t out_sent{0};
+    deque<shared_ptr<const Frame>> queue;
+    size_t offset{0};                                           // bytes of the front frame already sent
+    bool close{false};                                          // close once out is sent
+  };
+
+  static const size_t pending_max_ = 4096;
+  static const size_t request_max_ = 8192;
+  static const int heartbeat_ = 30;                             // seconds
+
+  void Wake(void) {
+    uint64_t one = 1;
+    if (wake_ != -1 && write(wake_, &one, sizeof(one)) == -1) {}
+  }
+
+  static void WsFrame(uint8_t head, string_view payload, string& frame) {
+    frame.clear();
+    frame.reserve(payload.size() + 10);
+    frame.push_back((char)head);
+
+    if (payload.size() < 126) frame.push_back((char)payload.size());
+    else if (payload.size() < 65536) {
+      frame.push_back((char)126);
+      for (int shift = 8; shift >= 0; shift -= 8) frame.push_back((char)(payload.size() >> shift));
+    }
+    else {
+      frame.push_back((char)127);
+      for (int shift = 56; shift >= 0; shift -= 8) frame.push_back((char)((uint64_t)payload.size() >> shift));
+    }
+
+    frame.append(payload);
+  }
+
+  void Work(void) {
+    //
+    // Accept subscribers, fan the published frames out and write them, all from one poll()
+    //
+    vector<struct pollfd> fds;
+    deque<shared_ptr<const Frame>> batch;
+    time_t heartbeat = time(nullptr);
+
+    // Keep-alive so proxies don't time idle streams out
+    shared_ptr<Frame> ping = make_shared<Frame>();
+    ping->type = Type::OTHER;
+    ping->sse = ":\n\n";
+    WsFrame(0x89, "", ping->ws);
+
+    while (!exit_) {
+      fds.resize(client_.size() + 2);
+      fds[0] = {wake_, POLLIN, 0};
+      fds[1] = {listen_, POLLIN, 0};
+
+      for (size_t idx = 0; idx < client_.size(); idx++) {
+        const Client& client = client_[idx];
+        bool pending = (client.out_sent < client.out.size()) || (client.mode != Client::Mode::REQUEST && !client.queue.empty());
+        fds[idx + 2] = {client.sock, (short)(POLLIN | (pending? POLLOUT: 0)), 0};
+      }
+
+      if (poll(fds.data(), fds.size(), 1000) == -1 && errno != EINTR) {
+        error_ = string("poll(): ") + strerror(errno);
+        return;
+      }
+
+      if (fds[0].revents & POLLIN) {
+        uint64_t count;
+        if (read(wake_, &count, sizeof(count)) == -1) {}
+
+        {
+          scoped_lock<mutex> lock{access_};
+          batch.swap(pending_);
+        }
+
+        for (const shared_ptr<const Frame>& frame: batch) Deliver(frame, 1u << frame->type);
+        batch.clear();
+      }
+
+      time_t now = time(nullptr);
+      if (now - heartbeat >= heartbeat_) {
+        heartbeat = now;
+        Deliver(ping, ~0u);
+      }
+
+      for (size_t idx = 0; idx < client_.size(); idx++) {
+        Client& client = client_[idx];
+        short revents = fds[idx + 2].revents;
+
+        if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+          client.close = true;
+          client.out.clear();
+        }
+        else {
+          if (revents & POLLIN) Receive(client);
+          if (!client.close || client.out_sent < client.out.size()) Send(client);
+        }
+      }
+
+      // Drop the closed clients (their poll slots are rebuilt on the next round)
+      for (size_t idx = client_.size(); idx-- > 0;) {
+        Client& client = client_[idx];
+        if (!client.close || client.out_sent < client.out.size()) continue;
+
+        Unsubscribe(client);
+        close(client.sock);
+        client_[idx] = move(client_.back());
+        client_.pop_back();
+      }
+
+      if (fds[1].revents & POLLIN) Accept();
+    }
+  }
+
+  void Accept(void) {
+    int sock;
+
+    while ((sock = accept4(listen_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+      if (client_.size() >= client_max_) {
+        stats_.rejected.fetch_add(1, memory_order_relaxed);
+        close(sock);
+        continue;
+      }
+
+      int opt = 1;
+      setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+      client_.emplace_back();
+      client_.back().sock = sock;
+    }
+  }
+
+  void Deliver(const shared_ptr<const Frame>& frame, uint32_t mask) {
+    //
+    // Hand a frame to every subscriber whose filter matches
+    //
+    for (Client& client: client_) {
+      if (client.mode == Client::Mode::REQUEST || client.close || !(client.filter & mask)) continue;
+
+      if (client.queue.size() >= queue_max_) {
+        // Drop the oldest frame not being written (queue_max_ >= 2, so there's always one)
+        client.queue.erase(client.queue.begin() + (client.offset? 1: 0));
+        stats_.dropped.fetch_add(1, memory_order_relaxed);
+      }
+      client.queue.push_back(frame);
+    }
+  }
+
+  void Receive(Client& client) {
+    char buffer[4096];
+    ssize_t len;
+
+    while ((len = recv(client.sock, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) client.in.append(buffer, len);
+
+    if (len == 0 || (len == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      client.close = true;
+      client.out.clear();
+      return;
+    }
+
+    if (client.mode == Client::Mode::REQUEST) Request(client);
+    else if (client.mode == Client::Mode::WS) Control(client);
+    else client.in.clear();
+  }
+
+  void Request(Client& client) {
+    //
+    // Parse the HTTP request and answer it: a stream, a WebSocket upgrade or an error
+    //
+    size_t end = client.in.find("\r\n\r\n");
+    if (end == string::npos) {
+      if (client.in.size() > request_max_) Reply(client, "431 Request Header Fields Too Large");
+      return;
+    }
+
+    string_view request{client.in.data(), end + 2};
+    string_view line = request.substr(0, request.find("\r\n"));
+
+    if (line.compare(0, 4, "GET ")) return (Reply(client, "405 Method Not Allowed"));
+
+    string_view target = line.substr(4, line.find(' ', 4) - 4);
+    string_view path = target.substr(0, target.find('?'));
+    string_view query = (path.size() < target.size())? target.substr(path.size() + 1): string_view{};
+
+    if (path == "/metrics" && metrics_) {
+      string body = metrics_();
+      client.out = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+      client.out_sent = 0;
+      client.close = true;
+      stats_.scrapes.fetch_add(1, memory_order_relaxed);
+      return;
+    }
+
+    if (path != "/events" && path != "/") return (Reply(client, "404 Not Found"));
+
+    // ?types=a,b,c (all of them if omitted)
+    client.filter = ~0u;
+    for (size_t pos = 0; pos < query.size();) {
+      size_t next = min(query.find('&', pos), query.size());
+      string_view param = query.substr(pos, next - pos);
+      pos = next + 1;
+
+      if (param.compare(0, 6, "types=")) continue;
+
+      client.filter = 0;
+      param.remove_prefix(6);
+      while (!param.empty()) {
+        size_t comma = min(param.find(','), param.size());
+        string_view name = param.substr(0, comma);
+        param.remove_prefix(min(comma + 1, param.size()));
+
+        Type type = GetType(name);
+        if (type == Type::OTHER && name != TypeName(Type::OTHER)) return (Reply(client, "400 Bad Request"));
+        client.filter |= (1u << type);
+      }
+    }
+
+    string upgrade, key;
+    Header(request, "upgrade", upgrade);
+    Header(request, "sec-websocket-key", key);
+    transform(upgrade.begin(), upgrade.end(), upgrade.begin(), ::tolower);
+
+    if (upgrade == "websocket") {
+      if (key.empty()) return (Reply(client, "400 Bad Request"));
+
+      client.mode = Client::Mode::WS;
+      client.out = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + WsAccept(key) + "\r\n\r\n";
+      stats_.ws.fetch_add(1, memory_order_relaxed);
+    }
+    else {
+      client.mode = Client::Mode::SSE;
+      client.out = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\nAccess-Control-Allow-Origin: *\r\n\r\n";
+      stats_.sse.fetch_add(1, memory_order_relaxed);
+    }
+
+    client.out_sent = 0;
+    client.in.erase(0, end + 4);
+    subscribers_.fetch_add(1, memory_order_relaxed);
+  }
+
+  void Reply(Client& client, const char* status) {
+    client.out = string("HTTP/1.1 ") + status + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    client.out_sent = 0;
+    client.close = true;
+  }
+
+  static bool Header(string_view request, const char* name, string& value) {
+    //
+    // Value of a request header, by its lower case name
+    //
+    size_t len = strlen(name);
+
+    for (size_t pos = request.find("\r\n"); pos != string_view::npos && pos + 2 < request.size(); pos = request.find("\r\n", pos + 2)) {
+      string_view line = request.substr(pos + 2, request.find("\r\n", pos + 2) - pos - 2);
+      if (line.size() <= len || line[len] != ':') continue;
+
+      bool match = true;
+      for (size_t idx = 0; idx < len && match; idx++) match = (tolower(line[idx]) == name[idx]);
+      if (!match) continue;
+
+      line.remove_prefix(len + 1);
+      while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) line.remove_prefix(1);
+      while (!line.empty() && (line.back() == ' ' || line.back() == '\t')) line.remove_suffix(1);
+
+      value = string(line);
+      return (true);
+    }
+
+    return (false);
+  }
+
+  void Control(Client& client) {
+    //
+    // Frames from a WebSocket client: answer pings and close requests, ignore anything else
+    //
+    while (client.in.size() >= 2) {
+      const uint8_t* data = (const uint8_t*)client.in.data();
+      uint8_t opcode = data[0] & 0x0F;
+      uint64_t len = data[1] & 0x7F;
+      size_t head = 2;
+
+      if (len == 126) head = 4;
+      else if (len == 127) head = 10;
+      if (data[1] & 0x80) head += 4;
+      if (client.in.size() < head) return;
+
+      if (len >= 126) {
+        len = 0;
+        for (size_t idx = 2; idx < ((data[1] & 0x7F) == 126? 4: 10); idx++) len = (len << 8) | data[idx];
+      }
+      if (len > request_max_) {
+        client.close = true;
+        client.out.clear();
+        return;
+      }
+      if (client.in.size() < head + len) return;
+
+      // Unmask the payload
+      string payload = client.in.substr(head, len);
+      if (data[1] & 0x80) {
+        for (size_t idx = 0; idx < payload.size(); idx++) payload[idx] ^= data[head - 4 + (idx % 4)];
+      }
+      client.in.erase(0, head + len);
+
+      if (opcode == 0x8) {
+        string frame;
+        WsFrame(0x88, payload.substr(0, 2), frame);
+        Enqueue(client, frame);
+        client.close = true;
+        return;
+      }
+      if (opcode == 0x9) {
+        string frame;
+        WsFrame(0x8A, payload, frame);
+        Enqueue(client, frame);
+      }
+    }
+  }
+
+  void Enqueue(Client& client, const string& frame) {
+    // Control frames go out between event frames
+    if (client.out_sent == client.out.size()) {
+      client.out.clear();
+      client.out_sent = 0;
+    }
+    client.out.append(frame);
+  }
+
+  void Send(Client& client) {
+    //
+    // Write as much as the socket takes: the pending response/control bytes, then the queued frames in one sendmsg()
+    // Once closing, only the frame already started is finished, and the close frame follows it
+    //
+    static const size_t iov_max = 64;
+    struct iovec iov[iov_max];
+    size_t count = 0;
+
+    bool between = (client.offset == 0);
+    if (between && client.out_sent < client.out.size()) {
+      iov[count++] = {(void*)(client.out.data() + client.out_sent), client.out.size() - client.out_sent};
+    }
+
+    size_t frames = 0;
+    if (client.mode != Client::Mode::REQUEST) {
+      frames = client.close? (between? 0: 1): min(client.queue.size(), iov_max - count);
+      for (size_t idx = 0; idx < frames; idx++) {
+        const string& data = (client.mode == Client::Mode::SSE)? client.queue[idx]->sse: client.queue[idx]->ws;
+        size_t skip = idx? 0: client.offset;
+        iov[count++] = {(void*)(data.data() + skip), data.size() - skip};
+      }
+    }
+
+    bool after = !between && client.close && client.out_sent < client.out.size();
+    if (after) {
+      iov[count++] = {(void*)(client.out.data() + client.out_sent), client.out.size() - client.out_sent};
+    }
+
+    if (!count) return;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    ssize_t sent = sendmsg(client.sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        client.close = true;
+        client.out.clear();
+      }
+      return;
+    }
+
+    // Account for what went out
+    size_t left = sent;
+
+    if (between && client.out_sent < client.out.size()) {
+      size_t take = min(left, client.out.size() - client.out_sent);
+      client.out_sent += take;
+      left -= take;
+    }
+
+    for (; left && frames; frames--) {
+      const string& data = (client.mode == Client::Mode::SSE)? client.queue.front()->sse: client.queue.front()->ws;
+      size_t take = min(left, data.size() - client.offset);
+      client.offset += take;
+      left -= take;
+
+      if (client.offset < data.size()) break;
+
+      client.queue.pop_front();
+      client.offset = 0;
+      stats_.delivered.fetch_add(1, memory_order_relaxed);
+    }
+
+    if (after) client.out_sent += left;
+  }
+
+  void Unsubscribe(const Client& client) {
+    if (client.mode == Client::Mode::REQUEST) return;
+
+    subscribers_.fetch_sub(1, memory_order_relaxed);
+    (client.mode == Client::Mode::SSE? stats_.sse: stats_.ws).fetch_sub(1, memory_order_relaxed);
+  }
+
+  static string WsAccept(const string& key) {
+    //
+    // Sec-WebSocket-Accept: base64(sha1(key + GUID)) (RFC 6455)
+    //
+    uint8_t digest[20];
+    Sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", digest);
+
+    static const char* const alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string text;
+
+    for (size_t idx = 0; idx < sizeof(digest); idx += 3) {
+      uint32_t group = (digest[idx] << 16) | ((idx + 1 < sizeof(digest)? digest[idx + 1]: 0) << 8) | (idx + 2 < sizeof(digest)? digest[idx + 2]: 0);
+
+      text.push_back(alphabet[(group >> 18) & 0x3F]);
+      text.push_back(alphabet[(group >> 12) & 0x3F]);
+      text.push_back((idx + 1 < sizeof(digest))? alphabet[(group >> 6) & 0x3F]: '=');
+      text.push_back((idx + 2 < sizeof(digest))? alphabet[group & 0x3F]: '=');
+    }
+
+    return (text);
+  }
+
+  static void Sha1(const string& text, uint8_t digest[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    // Pad to a multiple of 64 bytes: 0x80, zeros, bit length (big endian)
+    string data = text;
+    data.push_back((char)0x80);
+    while (data.size() % 64 != 56) data.push_back(0);
+    uint64_t bits = (uint64_t)text.size() * 8;
+    for (int shift = 56; shift >= 0; shift -= 8) data.push_back((char)(bits >> shift));
+
+    auto rol = [](uint32_t value, int bits){ return ((value << bits) | (value >> (32 - bits))); };
+
+    for (size_t block = 0; block < data.size(); block += 64) {
+      uint32_t w[80];
+      for (int idx = 0; idx < 16; idx++) {
+        const uint8_t* p = (const uint8_t*)data.data() + block + idx * 4;
+        w[idx] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+      }
+      for (int idx = 16; idx < 80; idx++) w[idx] = rol(w[idx - 3] ^ w[idx - 8] ^ w[idx - 14] ^ w[idx - 16], 1);
+
+      uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+      for (int idx = 0; idx < 80; idx++) {
+        uint32_t f, k;
+        if (idx < 20)      f = (b & c) | (~b & d),          k = 0x5A827999;
+        else if (idx < 40) f = b ^ c ^ d,                   k = 0x6ED9EBA1;
+        else if (idx < 60) f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+        else               f = b ^ c ^ d,                   k = 0xCA62C1D6;
+
+        uint32_t t = rol(a, 5) + f + e + k + w[idx];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+      }
+
+      h[0] += a;
+      h[1] += b;
+      h[2] += c;
+      h[3] += d;
+      h[4] += e;
+    }
+
+    for (int idx = 0; idx < 20; idx++) digest[idx] = (uint8_t)(h[idx / 4] >> (24 - (idx % 4) * 8));
+  }
+
+  const int port_;
+  const size_t queue_max_;
+  const size_t client_max_;
+  const function<string()> metrics_;
+
+  string error_;
+  int listen_{-1};
+  int wake_{-1};                                                // eventfd: frames published
+  thread thread_;
+  atomic<bool> exit_{false};
+
+  mutex access_;
+  deque<shared_ptr<const Frame>> pending_;                      // published, not yet handed to the subscribers
+
+  vector<Client> client_;                                       // used by the server thread only
+  atomic<size_t> subscribers_{0};
+
+  // Stream Statistics
+  struct {
+    atomic<uint64_t> published{0};
+    atomic<uint64_t> delivered{0};                              // frames written to a subscriber
+    atomic<uint64_t> dropped{0};                                // oldest frames dropped for slow subscribers
+    atomic<uint64_t> rejected{0};                               // connections over client_max
+    atomic<uint64_t> scrapes{0};                                // /metrics requests
+    atomic<size_t> sse{0};
+    atomic<size_t> ws{0};
+  }
+  stats_;
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_STREAM
@@ -26,12 +26,19 @@
 #include <cmath>
 #include <cstdlib>
 #include <limits>
+#include <climits>
 
 #include <string>
 #include <regex>
+#include <algorithm>
 
 #include <vector>
+#include <deque>
 #include <map>
+#include <set>
+#include <functional>
+#include <string_view>
+#include <charconv>
 #include <initializer_list>
 
 #include <chrono>
@@ -45,6 +52,7 @@
 
 #include <memory>
 #include <iosfwd>
+#include <iomanip>
 #include <type_traits>
 
 #include <getopt.h>
@@ -54,14 +62,30 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
 
 #include <semaphore.h>
+#include <pthread.h>
+#include <sched.h>
 #include <fcntl.h>
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
+#ifdef TEMPEST_CURL
 #include <curl/curl.h>
+#endif
+#ifdef TEMPEST_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TEMPEST_ZSTD
+#include <zstd.h>
+#endif
 #include <dirent.h>
 
 #include <signal.h>
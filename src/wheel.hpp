@@ -0,0 +1,238 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: hierarchical timing wheel for periodic schedules
+//
+
+#ifndef TEMPEST_WHEEL
+#define TEMPEST_WHEEL
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Three levels of 64 slots each: level 0 holds the schedules due within 64 ticks, level 1 within 4096 and level 2 within 262144
+// Every 64 ticks a level 1 slot is cascaded down to level 0 (and every 4096 a level 2 slot down to level 1)
+// so adding, removing and expiring a schedule are all O(1) regardless of how many there are
+// Schedules are kept in a node vector and linked by index: no allocation once the vector has grown
+//
+
+template <typename T>
+class TimingWheel {
+public:
+
+  static constexpr uint64_t period_max = (uint64_t)1 << 18;      // 64^3 ticks
+
+  explicit TimingWheel(uint64_t now): current_{now} {
+    for (size_t level = 0; level < levels_; level++) {
+      occupied_[level] = 0;
+      for (size_t slot = 0; slot < slots_; slot++) head_[level][slot] = npos_;
+    }
+  }
+
+  TimingWheel(const TimingWheel&) = delete;
+  TimingWheel& operator=(const TimingWheel&) = delete;
+
+  inline size_t Size(void) const { return (size_); }
+  inline uint64_t Current(void) const { return (current_); }
+
+  size_t Add(const T& item, uint64_t period, uint64_t phase) {
+    //
+    // Schedule item every period ticks, at the ticks where (tick % period) == phase
+    // Return a handle for Remove()
+    //
+    assert(period > 0 && period < period_max);
+
+    uint32_t idx;
+
+    if (free_ != npos_) {
+      idx = free_;
+      free_ = node_[idx].next;
+    }
+    else {
+      idx = node_.size();
+      node_.emplace_back();
+    }
+
+    Node& node = node_[idx];
+    node.item = item;
+    node.period = period;
+    node.active = true;
+
+    // First tick after the current one in phase
+    phase %= period;
+    node.deadline = current_ + 1 + (phase + period - (current_ + 1) % period) % period;
+
+    Link(idx);
+    size_++;
+
+    return (idx);
+  }
+
+  void Remove(size_t handle) {
+    Node& node = node_[handle];
+    if (!node.active) return;
+
+    Unlink(handle);
+    node.active = false;
+    node.next = free_;
+    free_ = handle;
+    size_--;
+  }
+
+  uint64_t Next(void) const {
+    //
+    // Return the next tick that needs an Advance(): either the first occupied level 0 slot
+    // or the next cascade if level 0 is empty (a lower bound of the next expiry)
+    //
+    uint64_t cascade = ((current_ >> bits_) + 1) << bits_;
+    uint64_t occupied = occupied_[0];
+    if (!occupied) return (cascade);
+
+    // Rotate so bit 0 is the slot right after the current tick
+    unsigned shift = (current_ + 1) & mask_;
+    uint64_t rotated = shift? ((occupied >> shift) | (occupied << (slots_ - shift))): occupied;
+
+    return (min(current_ + 1 + __builtin_ctzll(rotated), cascade));
+  }
+
+  template <typename F>
+  size_t Advance(uint64_t now, F&& expire) {
+    //
+    // Move the wheel forward to now, calling expire(item) for every schedule due and rescheduling it one period later
+    // Return the number of expired schedules
+    //
+    size_t count = 0;
+
+    while (current_ < now) {
+      uint64_t tick = ++current_;
+
+      // Cascade higher levels first, so a level 2 slot can land in the level 1 slot being cascaded right after
+      for (size_t level = levels_ - 1; level > 0; level--) {
+        if (tick & ((1ull << (bits_ * level)) - 1)) continue;
+        Cascade(level, (tick >> (bits_ * level)) & mask_);
+      }
+
+      size_t slot = tick & mask_;
+      uint32_t idx = head_[0][slot];
+      head_[0][slot] = npos_;
+      occupied_[0] &= ~(1ull << slot);
+
+      while (idx != npos_) {
+        Node& node = node_[idx];
+        uint32_t next = node.next;
+
+        node.deadline += node.period;
+        Link(idx);
+
+        expire(node.item);
+        count++;
+
+        idx = next;
+      }
+    }
+
+    return (count);
+  }
+
+private:
+
+  static constexpr size_t levels_ = 3;
+  static constexpr size_t bits_ = 6;
+  static constexpr size_t slots_ = 1 << bits_;
+  static constexpr uint64_t mask_ = slots_ - 1;
+  static constexpr uint32_t npos_ = numeric_limits<uint32_t>::max();
+
+  struct Node {
+    T item;
+    uint64_t deadline;
+    uint64_t period;
+    uint32_t prev;
+    uint32_t next;
+    uint8_t level;
+    uint8_t slot;
+    bool active;
+  };
+
+  void Link(uint32_t idx) {
+    //
+    // Insert a node in the slot of its deadline, at the lowest level able to hold it
+    // (a deadline equal to the current tick is only possible while cascading, just before that slot expires)
+    //
+    Node& node = node_[idx];
+    if (node.deadline < current_) node.deadline = current_;
+
+    uint64_t delta = node.deadline - current_;
+
+    size_t level = 0;
+    while (level < levels_ - 1 && delta >= (1ull << (bits_ * (level + 1)))) level++;
+
+    size_t slot = (node.deadline >> (bits_ * level)) & mask_;
+
+    node.level = level;
+    node.slot = slot;
+    node.prev = npos_;
+    node.next = head_[level][slot];
+    if (node.next != npos_) node_[node.next].prev = idx;
+
+    head_[level][slot] = idx;
+    occupied_[level] |= (1ull << slot);
+  }
+
+  void Unlink(uint32_t idx) {
+    Node& node = node_[idx];
+
+    if (node.prev != npos_) node_[node.prev].next = node.next;
+    else head_[node.level][node.slot] = node.next;
+
+    if (node.next != npos_) node_[node.next].prev = node.prev;
+
+    if (head_[node.level][node.slot] == npos_) occupied_[node.level] &= ~(1ull << node.slot);
+  }
+
+  void Cascade(size_t level, size_t slot) {
+    //
+    // Relink all the nodes of a slot: they are now close enough to land on a lower level
+    //
+    uint32_t idx = head_[level][slot];
+    head_[level][slot] = npos_;
+    occupied_[level] &= ~(1ull << slot);
+
+    while (idx != npos_) {
+      uint32_t next = node_[idx].next;
+      Link(idx);
+      idx = next;
+    }
+  }
+
+  uint64_t current_;                                            // last tick processed
+  size_t size_{0};
+
+  vector<Node> node_;
+  uint32_t free_{npos_};                                        // free nodes, linked by next
+
+  uint32_t head_[levels_][slots_];
+  uint64_t occupied_[levels_];                                  // one bit per non empty slot
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_WHEEL
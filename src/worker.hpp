@@ -0,0 +1,211 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: work-stealing worker pool
+//
+
+#ifndef TEMPEST_WORKER
+#define TEMPEST_WORKER
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+namespace tempest {
+
+using namespace std;
+
+//
+// Fork-join pool: Run() spreads count tasks over the per-worker queues and returns when all of them are done
+// Each worker pops from the back of its own queue and, when that's empty, steals from the front of the others
+// The calling thread acts as worker 0, so a pool of size 1 runs everything inline without any thread
+// If provided, start(idx) runs first thing on each worker thread (i.e. to set its affinity)
+//
+
+class WorkerPool {
+public:
+
+  explicit WorkerPool(size_t workers = 0, const function<void(size_t)>& start = nullptr): start_{start} {
+    if (!workers) workers = max(thread::hardware_concurrency(), 1u);
+
+    queue_ = make_unique<Queue[]>(workers);
+    size_ = workers;
+
+    for (size_t idx = 1; idx < size_; idx++) thread_.emplace_back(&WorkerPool::Work, this, idx);
+  }
+
+  ~WorkerPool() {
+    {
+      scoped_lock<mutex> lock{idle_access_};
+      exit_ = true;
+    }
+    idle_.notify_all();
+
+    for (thread& t: thread_) t.join();
+  }
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  inline size_t Size(void) const { return (size_); }
+
+  void Run(size_t count, const function<void(size_t)>& task) {
+    //
+    // Execute task(0) ... task(count - 1) and wait for all of them to complete
+    // Concurrent callers are fine: each waits for its own tasks only, helping with whatever is queued meanwhile
+    //
+    if (!count) return;
+
+    if (size_ == 1 || count == 1) {
+      for (size_t idx = 0; idx < count; idx++) task(idx);
+      queue_[0].executed.fetch_add(count, memory_order_relaxed);
+      return;
+    }
+
+    Group group{task, count};
+
+    // Account for the tasks before they can be picked up
+    {
+      scoped_lock<mutex> lock{idle_access_};
+      pending_ += count;
+    }
+
+    // Deal the tasks round-robin
+    for (size_t idx = 0; idx < count; idx++) {
+      Queue& queue = queue_[idx % size_];
+      scoped_lock<mutex> lock{queue.access};
+      queue.task.push_back({&group, idx});
+    }
+
+    idle_.notify_all();
+
+    // Help until there's nothing left to pick up, then wait for the tasks still running
+    Task item;
+    while (Next(0, item)) Execute(0, item);
+
+    unique_lock<mutex> lock{group.done_access};
+    group.done.wait(lock, [&group]{ return (!group.remaining.load(memory_order_acquire)); });
+  }
+
+  string Stats(void) const {
+    //
+    // Return per worker statistics
+    //
+    ostringstream stats{""};
+
+    stats << "Workers: " << size_ << endl;
+    for (size_t idx = 0; idx < size_; idx++) {
+      stats << "     [" << idx << "]: executed " << queue_[idx].executed.load(memory_order_relaxed) << ", stolen " << queue_[idx].stolen.load(memory_order_relaxed) << endl;
+    }
+
+    return (stats.str());
+  }
+
+private:
+
+  struct Group {
+    Group(const function<void(size_t)>& fn, size_t count): task{fn}, remaining{count} {}
+
+    const function<void(size_t)>& task;
+    atomic<size_t> remaining;
+    mutex done_access;
+    condition_variable done;
+  };
+
+  struct Task {
+    Group* group;
+    size_t idx;
+  };
+
+  struct Queue {
+    mutex access;
+    deque<Task> task;
+
+    atomic<size_t> executed{0};
+    atomic<size_t> stolen{0};
+  };
+
+  bool Next(size_t self, Task& item) {
+    //
+    // Pop from our own queue first (LIFO), then steal from the other workers (FIFO)
+    //
+    for (size_t offset = 0; offset < size_; offset++) {
+      Queue& queue = queue_[(self + offset) % size_];
+      scoped_lock<mutex> lock{queue.access};
+
+      if (queue.task.empty()) continue;
+
+      if (!offset) {
+        item = queue.task.back();
+        queue.task.pop_back();
+      }
+      else {
+        item = queue.task.front();
+        queue.task.pop_front();
+        queue_[self].stolen.fetch_add(1, memory_order_relaxed);
+      }
+
+      scoped_lock<mutex> idle_lock{idle_access_};
+      pending_--;
+
+      return (true);
+    }
+
+    return (false);
+  }
+
+  void Execute(size_t self, const Task& item) {
+    Group& group = *item.group;
+
+    group.task(item.idx);
+    queue_[self].executed.fetch_add(1, memory_order_relaxed);
+
+    // Decrement under the lock: Run() may return, and the group go out of scope, as soon as it's released
+    scoped_lock<mutex> lock{group.done_access};
+    if (group.remaining.fetch_sub(1, memory_order_acq_rel) == 1) group.done.notify_one();
+  }
+
+  void Work(size_t self) {
+    Task item;
+
+    if (start_) start_(self);
+
+    while (true) {
+      {
+        unique_lock<mutex> lock{idle_access_};
+        idle_.wait(lock, [this]{ return (exit_ || pending_); });
+        if (exit_) return;
+      }
+
+      while (Next(self, item)) Execute(self, item);
+    }
+  }
+
+  const function<void(size_t)> start_;
+
+  size_t size_;
+  unique_ptr<Queue[]> queue_;
+  vector<thread> thread_;
+
+  mutex idle_access_;
+  condition_variable idle_;
+  size_t pending_{0};                                           // tasks queued and not picked up yet
+  bool exit_{false};
+};
+
+} // namespace tempest
+
+// Recycle Bin ----------------------------------------------------------------------------------------------------------------
+
+/*
+
+*/
+
+// EOF ------------------------------------------------------------------------------------------------------------------------
+
+#endif // TEMPEST_WORKER
@@ -0,0 +1,122 @@
+//
+// App:         WeatherFlow Tempest UDP Relay
+// Author:      Mirco Caramori
+// Copyright:   (c) 2020 Mirco Caramori
+// Repository:  https://github.com/mircolino/tempest
+//
+// Description: stream server test: a WebSocket Close that arrives while an event frame is half written must get the rest of
+//              the frame, the close frame and the end of the connection
+//
+// Usage:       stream                          exits with 0 if passed
+//
+
+// Includes --------------------------------------------------------------------------------------------------------------------
+
+#include "system.hpp"
+
+#include "stream.hpp"
+
+// Source ----------------------------------------------------------------------------------------------------------------------
+
+using namespace std;
+using namespace tempest;
+
+static int Port(void) {
+  //
+  // A free loopback port (0 if error)
+  //
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int port = (sock >= 0 && !bind(sock, (sockaddr*)&addr, sizeof(addr)) && !getsockname(sock, (sockaddr*)&addr, &len))? ntohs(addr.sin_port): 0;
+  if (sock >= 0) close(sock);
+
+  return (port);
+}
+
+static bool Read(int sock, string& in, int timeout_ms) {
+  //
+  // Read until the peer closes the connection (false if it's still open after timeout_ms)
+  //
+  char buffer[65536];
+  auto end = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+
+  for (;;) {
+    int left = (int)chrono::duration_cast<chrono::milliseconds>(end - chrono::steady_clock::now()).count();
+    struct pollfd fd = {sock, POLLIN, 0};
+    if (left <= 0 || poll(&fd, 1, left) <= 0) return (false);
+
+    ssize_t len = recv(sock, buffer, sizeof(buffer), 0);
+    if (len <= 0) return (true);
+    in.append(buffer, len);
+  }
+}
+
+static bool Fail(const char* error) {
+  printf("FAILED: %s.\n", error);
+  return (false);
+}
+
+static bool CloseMidFrame(void) {
+  int port = Port();
+  StreamServer server{"127.0.0.1", port, 4};
+  if (!port || !server.Error().empty()) return (Fail("server not started"));
+
+  // A small receive window, so the server can't write a large frame in one go
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  int window = 4096;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &window, sizeof(window));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(sock, (sockaddr*)&addr, sizeof(addr))) return (Fail("connect()"));
+
+  string request = "GET /events HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+  send(sock, request.data(), request.size(), MSG_NOSIGNAL);
+
+  string in;
+  char buffer[4096];
+  while (in.find("\r\n\r\n") == string::npos) {
+    ssize_t len = recv(sock, buffer, sizeof(buffer), 0);
+    if (len <= 0) return (Fail("no handshake"));
+    in.append(buffer, len);
+  }
+  if (in.compare(0, 12, "HTTP/1.1 101")) return (Fail("handshake refused"));
+  in.erase(0, in.find("\r\n\r\n") + 4);
+
+  // An event far larger than the socket buffers, then a masked Close (code 1000) while it's being written
+  string json = "{\"type\":\"obs_st\",\"pad\":\"" + string(16 << 20, 'x') + "\"}";
+  server.Publish("obs_st", json);
+  this_thread::sleep_for(chrono::milliseconds(200));
+
+  static const uint8_t closing[] = {0x88, 0x82, 0x01, 0x02, 0x03, 0x04, 0x03 ^ 0x01, 0xE8 ^ 0x02};
+  send(sock, closing, sizeof(closing), MSG_NOSIGNAL);
+
+  bool ended = Read(sock, in, 10000);
+  close(sock);
+  if (!ended) return (Fail("connection not closed"));
+
+  // The whole event frame (64-bit length), then the close frame echoing the code
+  string frame = string("\x81\x7F", 2);
+  for (int shift = 56; shift >= 0; shift -= 8) frame.push_back((char)((uint64_t)json.size() >> shift));
+  frame += json + string("\x88\x02\x03\xE8", 4);
+
+  if (in != frame) return (Fail("event or close frame corrupted"));
+
+  return (true);
+}
+
+int main(void) {
+  if (!CloseMidFrame()) return (EXIT_FAILURE);
+
+  printf("stream: passed\n");
+  return (EXIT_SUCCESS);
+}
+
+// EOF -------------------------------------------------------------------------------------------------------------------------